@@ -18,23 +18,42 @@
 
 #define BLOCKING 1024
 
+/*
+ * The nodes are carved out of blocks of BLOCKING nodes, which belong to
+ * the current object pool and are only freed with it.
+ */
+static void *alloc_node(struct alloc_state *s, size_t node_size)
+{
+	void *ret;
+
+	if (!s->nr) {
+		s->nr = BLOCKING;
+		s->next = xmalloc(BLOCKING * node_size);
+		ALLOC_GROW(s->blocks, s->blocks_nr + 1, s->blocks_alloc);
+		s->blocks[s->blocks_nr++] = s->next;
+	}
+	s->nr--;
+	ret = s->next;
+	s->next = (char *)s->next + node_size;
+	memset(ret, 0, node_size);
+	return ret;
+}
+
+void clear_alloc_state(struct alloc_state *s)
+{
+	while (s->blocks_nr > 0)
+		free(s->blocks[--s->blocks_nr]);
+	free(s->blocks);
+	memset(s, 0, sizeof(*s));
+}
+
 #define DEFINE_ALLOCATOR(name, type)				\
 static unsigned int name##_allocs;				\
 void *alloc_##name##_node(void)					\
 {								\
-	static int nr;						\
-	static type *block;					\
-	void *ret;						\
-								\
-	if (!nr) {						\
-		nr = BLOCKING;					\
-		block = xmalloc(BLOCKING * sizeof(type));	\
-	}							\
-	nr--;							\
 	name##_allocs++;					\
-	ret = block++;						\
-	memset(ret, 0, sizeof(type));				\
-	return ret;						\
+	return alloc_node(&current_object_pool->name##_state,	\
+			  sizeof(type));			\
 }
 
 union any_object {
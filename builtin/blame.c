@@ -8,6 +8,7 @@
 #include "builtin.h"
 #include "blob.h"
 #include "commit.h"
+#include "refs.h"
 #include "tag.h"
 #include "tree-walk.h"
 #include "diff.h"
@@ -40,6 +41,8 @@ static int show_root;
 static int reverse;
 static int blank_boundary;
 static int incremental;
+static int blame_cache;
+static int use_blame_cache;
 static int xdl_opts;
 static int abbrev = -1;
 
@@ -251,6 +254,13 @@ struct scoreboard {
 	/* look-up a line in the final buffer */
 	int num_lines;
 	int *lineno;
+
+	/*
+	 * The lines [viewport_bottom, viewport_top) are resolved before
+	 * the others; an empty range means no preference.
+	 */
+	int viewport_bottom;
+	int viewport_top;
 };
 
 static inline int same_suspect(struct origin *a, struct origin *b)
@@ -1426,7 +1436,8 @@ static void get_commit_info(struct commit *commit,
 {
 	int len;
 	const char *subject, *encoding;
-	char *reencoded, *message;
+	const char *buffer, *message;
+	char *reencoded;
 	static char author_name[1024];
 	static char author_mail[1024];
 	static char committer_name[1024];
@@ -1435,20 +1446,12 @@ static void get_commit_info(struct commit *commit,
 
 	/*
 	 * We've operated without save_commit_buffer, so
-	 * we now need to populate them for output.
+	 * this may need to read the commit for output.
 	 */
-	if (!commit->buffer) {
-		enum object_type type;
-		unsigned long size;
-		commit->buffer =
-			read_sha1_file(commit->object.sha1, &type, &size);
-		if (!commit->buffer)
-			die("Cannot read commit %s",
-			    sha1_to_hex(commit->object.sha1));
-	}
+	buffer = get_commit_buffer(commit, NULL);
 	encoding = get_log_output_encoding();
 	reencoded = logmsg_reencode(commit, encoding);
-	message   = reencoded ? reencoded : commit->buffer;
+	message   = reencoded ? reencoded : buffer;
 	ret->author = author_name;
 	ret->author_mail = author_mail;
 	get_ac_line(message, "\nauthor ",
@@ -1457,6 +1460,7 @@ static void get_commit_info(struct commit *commit,
 		    &ret->author_time, &ret->author_tz);
 
 	if (!detailed) {
+		unuse_commit_buffer(commit, buffer);
 		free(reencoded);
 		return;
 	}
@@ -1476,6 +1480,7 @@ static void get_commit_info(struct commit *commit,
 	} else {
 		sprintf(summary_buf, "(%s)", sha1_to_hex(commit->object.sha1));
 	}
+	unuse_commit_buffer(commit, buffer);
 	free(reencoded);
 }
 
@@ -1544,6 +1549,272 @@ static void found_guilty_entry(struct blame_entry *ent)
 	}
 }
 
+/*
+ * The blame cache remembers, for a <commit, path> pair, which commit
+ * each line of the file came from.  Each file in $GIT_DIR/blame-cache
+ * starts with a "blame-cache 1 <lines>" header, followed by one record
+ * per group of lines:
+ *
+ *   <lno> <num_lines> <s_lno> <commit> <previous commit> <path> NUL
+ *   <previous path> NUL
+ *
+ * where a null <previous commit> and an empty <previous path> stand
+ * for an origin without a previous one.
+ */
+struct cached_blame {
+	int lno;
+	int num_lines;
+	int s_lno;
+	struct commit *commit;
+	struct commit *previous;
+	const char *path;
+	const char *previous_path;
+};
+
+static int has_replace_ref(const char *refname, const unsigned char *sha1,
+			   int flags, void *cb_data)
+{
+	return 1;
+}
+
+/*
+ * Grafts, a shallow repository and replace refs change the history
+ * behind a commit without changing its name, so a cached result may
+ * not match it; do not use the cache at all while any is in effect.
+ */
+static int history_is_altered(void)
+{
+	if (!access(get_graft_file(), F_OK) || is_repository_shallow())
+		return 1;
+	return read_replace_refs && for_each_replace_ref(has_replace_ref, NULL);
+}
+
+static char *blame_cache_path(struct commit *commit, const char *path)
+{
+	git_SHA_CTX ctx;
+	unsigned char sha1[20];
+	char opts[32];
+	const char *hex;
+
+	git_SHA1_Init(&ctx);
+	git_SHA1_Update(&ctx, commit->object.sha1, 20);
+	git_SHA1_Update(&ctx, path, strlen(path) + 1);
+	snprintf(opts, sizeof(opts), "%d", xdl_opts);
+	git_SHA1_Update(&ctx, opts, strlen(opts));
+	git_SHA1_Final(sha1, &ctx);
+	hex = sha1_to_hex(sha1);
+	return git_path("blame-cache/%.2s/%s", hex, hex + 2);
+}
+
+static struct commit *cached_commit(const char *hex)
+{
+	unsigned char sha1[20];
+	struct commit *commit;
+
+	if (get_sha1_hex(hex, sha1))
+		return NULL;
+	commit = lookup_commit(sha1);
+	if (!commit || parse_commit(commit))
+		return NULL;
+	return commit;
+}
+
+/*
+ * Parse the cache file in buf; the records point into buf.  Returns
+ * the number of records, or -1 if the file is not one we wrote.
+ */
+static int parse_blame_cache(struct strbuf *buf, struct cached_blame **cb_p,
+			     int *num_lines)
+{
+	struct cached_blame *cb = NULL;
+	int nr = 0, alloc = 0, lno = 0;
+	char *p, *end = buf->buf + buf->len;
+
+	if (prefixcmp(buf->buf, "blame-cache 1 "))
+		return -1;
+	*num_lines = strtol(buf->buf + 14, &p, 10);
+	if (*p++ != '\n')
+		return -1;
+	while (p < end) {
+		struct cached_blame *c;
+		char *q;
+
+		ALLOC_GROW(cb, nr + 1, alloc);
+		c = &cb[nr++];
+		c->lno = strtol(p, &q, 10);
+		if (*q != ' ' || c->lno != lno)
+			goto bad;
+		c->num_lines = strtol(q + 1, &q, 10);
+		if (*q != ' ' || c->num_lines <= 0)
+			goto bad;
+		c->s_lno = strtol(q + 1, &q, 10);
+		if (*q != ' ' || c->s_lno < 0 || end - q < 84 ||
+		    q[41] != ' ' || q[82] != ' ' ||
+		    !(c->commit = cached_commit(q + 1)))
+			goto bad;
+		c->previous = NULL;
+		if (prefixcmp(q + 42, sha1_to_hex(null_sha1)) &&
+		    !(c->previous = cached_commit(q + 42)))
+			goto bad;
+		c->path = q + 83;
+		q = memchr(c->path, '\0', end - c->path);
+		if (!q++ || q == end)
+			goto bad;
+		c->previous_path = q;
+		q = memchr(q, '\0', end - q);
+		if (!q || !*c->path || !*c->previous_path != !c->previous)
+			goto bad;
+		p = q + 1;
+		lno += c->num_lines;
+	}
+	if (lno != *num_lines)
+		goto bad;
+	*cb_p = cb;
+	return nr;
+
+bad:
+	free(cb);
+	return -1;
+}
+
+/*
+ * Replace the blame entry ent, whose lines came from a commit that
+ * has a cached blame, with the groups the cache assigns them to.
+ */
+static void split_by_cache(struct scoreboard *sb, struct blame_entry *ent,
+			   struct cached_blame *cb, int nr)
+{
+	struct blame_entry *prev = ent->prev, *e;
+	int end = ent->s_lno + ent->num_lines;
+	int i;
+
+	for (i = 0; i < nr && cb[i].lno + cb[i].num_lines <= ent->s_lno; i++)
+		; /* skip groups before this entry */
+	for (; i < nr && cb[i].lno < end; i++) {
+		int start = ent->s_lno < cb[i].lno ? cb[i].lno : ent->s_lno;
+		int stop = cb[i].lno + cb[i].num_lines;
+		struct origin *o;
+
+		if (end < stop)
+			stop = end;
+		o = get_origin(sb, cb[i].commit, cb[i].path);
+		if (!o->previous && cb[i].previous)
+			o->previous = make_origin(cb[i].previous,
+						  cb[i].previous_path);
+		if (!cb[i].commit->parents && !show_root)
+			cb[i].commit->object.flags |= UNINTERESTING;
+
+		e = xcalloc(1, sizeof(*e));
+		e->lno = ent->lno + start - ent->s_lno;
+		e->num_lines = stop - start;
+		e->s_lno = cb[i].s_lno + start - cb[i].lno;
+		e->suspect = o;
+		e->prev = prev;
+		if (prev)
+			prev->next = e;
+		else
+			sb->ent = e;
+		prev = e;
+	}
+	prev->next = ent->next;
+	if (ent->next)
+		ent->next->prev = prev;
+	e = ent->prev ? ent->prev->next : sb->ent;
+	origin_decref(ent->suspect);
+	free(ent);
+
+	for (; e != prev->next; e = e->next)
+		found_guilty_entry(e);
+}
+
+/*
+ * If the blame for the suspect's <commit, path> is in the cache, take
+ * it from there instead of digging through the history again.
+ */
+static int blame_from_cache(struct scoreboard *sb, struct origin *suspect)
+{
+	struct strbuf buf = STRBUF_INIT;
+	struct cached_blame *cb = NULL;
+	struct blame_entry *e, *next;
+	int nr, num_lines;
+
+	if (strbuf_read_file(&buf, blame_cache_path(suspect->commit,
+						    suspect->path), 0) < 0)
+		return 0;
+	nr = parse_blame_cache(&buf, &cb, &num_lines);
+	for (e = sb->ent; 0 <= nr && e; e = e->next)
+		if (!e->guilty && same_suspect(e->suspect, suspect) &&
+		    num_lines < e->s_lno + e->num_lines)
+			nr = -1;
+	if (nr < 0) {
+		trace_printf("blame: ignoring bad cached blame for %s %s\n",
+			     sha1_to_hex(suspect->commit->object.sha1),
+			     suspect->path);
+		strbuf_release(&buf);
+		return 0;
+	}
+
+	trace_printf("blame: using cached blame for %s %s\n",
+		     sha1_to_hex(suspect->commit->object.sha1), suspect->path);
+	for (e = sb->ent; e; e = next) {
+		next = e->next;
+		if (!e->guilty && same_suspect(e->suspect, suspect))
+			split_by_cache(sb, e, cb, nr);
+	}
+	free(cb);
+	strbuf_release(&buf);
+	return 1;
+}
+
+static void write_blame_cache(struct scoreboard *sb)
+{
+	static struct lock_file lock;
+	struct strbuf buf = STRBUF_INIT;
+	struct blame_entry *e;
+	char *path;
+	int fd;
+
+	path = blame_cache_path(sb->final, sb->path);
+	if (!access(path, F_OK) || safe_create_leading_directories(path))
+		return;
+	fd = hold_lock_file_for_update(&lock, path, 0);
+	if (fd < 0)
+		return;
+
+	strbuf_addf(&buf, "blame-cache 1 %d\n", sb->num_lines);
+	for (e = sb->ent; e; e = e->next) {
+		struct origin *o = e->suspect;
+
+		strbuf_addf(&buf, "%d %d %d %s ", e->lno, e->num_lines,
+			    e->s_lno, sha1_to_hex(o->commit->object.sha1));
+		strbuf_addf(&buf, "%s ", sha1_to_hex(o->previous ?
+			    o->previous->commit->object.sha1 : null_sha1));
+		strbuf_add(&buf, o->path, strlen(o->path) + 1);
+		if (o->previous)
+			strbuf_addstr(&buf, o->previous->path);
+		strbuf_addch(&buf, '\0');
+	}
+	if (write_in_full(fd, buf.buf, buf.len) != buf.len ||
+	    commit_lock_file(&lock))
+		rollback_lock_file(&lock);
+	strbuf_release(&buf);
+}
+
+/* Pick the suspect to work on next, preferring one in the viewport. */
+static struct origin *pick_suspect(struct scoreboard *sb)
+{
+	struct blame_entry *ent;
+
+	for (ent = sb->ent; ent && ent->lno < sb->viewport_top; ent = ent->next)
+		if (!ent->guilty &&
+		    sb->viewport_bottom < ent->lno + ent->num_lines)
+			return ent->suspect;
+	for (ent = sb->ent; ent; ent = ent->next)
+		if (!ent->guilty)
+			return ent->suspect;
+	return NULL;
+}
+
 /*
  * The main loop -- while the scoreboard has lines whose true origin
  * is still unknown, pick one blame_entry, and allow its current
@@ -1556,12 +1827,10 @@ static void assign_blame(struct scoreboard *sb, int opt)
 	while (1) {
 		struct blame_entry *ent;
 		struct commit *commit;
-		struct origin *suspect = NULL;
+		struct origin *suspect;
 
-		/* find one suspect to break down */
-		for (ent = sb->ent; !suspect && ent; ent = ent->next)
-			if (!ent->guilty)
-				suspect = ent->suspect;
+		/* find one suspect to break down, the viewport first */
+		suspect = pick_suspect(sb);
 		if (!suspect)
 			return; /* all done */
 
@@ -1573,7 +1842,9 @@ static void assign_blame(struct scoreboard *sb, int opt)
 		commit = suspect->commit;
 		if (!commit->object.parsed)
 			parse_commit(commit);
-		if (reverse ||
+		if (use_blame_cache && blame_from_cache(sb, suspect))
+			; /* the cache has assigned all of its lines */
+		else if (reverse ||
 		    (!(commit->object.flags & UNINTERESTING) &&
 		     !(revs->max_age != -1 && commit->date < revs->max_age)))
 			pass_blame(sb, suspect, opt);
@@ -2057,6 +2328,10 @@ static int git_blame_config(const char *var, const char *value, void *cb)
 		blank_boundary = git_config_bool(var, value);
 		return 0;
 	}
+	if (!strcmp(var, "blame.cache")) {
+		blame_cache = git_config_bool(var, value);
+		return 0;
+	}
 	if (!strcmp(var, "blame.date")) {
 		if (!value)
 			return config_error_nonbool(var);
@@ -2167,7 +2442,10 @@ static struct commit *fake_working_tree_commit(struct diff_options *opt,
 		    ident, ident, path,
 		    (!contents_from ? path :
 		     (!strcmp(contents_from, "-") ? "standard input" : contents_from)));
-	commit->buffer = strbuf_detach(&msg, NULL);
+	set_commit_buffer(commit, msg.buf, msg.len);
+	strbuf_init(&msg, 0);
+	/* there is no object to read it back from; never let it go */
+	get_commit_buffer(commit, NULL);
 
 	if (!contents_from || strcmp("-", contents_from)) {
 		struct stat st;
@@ -2363,9 +2641,11 @@ int cmd_blame(int argc, const char **argv, const char *prefix)
 	struct blame_entry *ent;
 	long dashdash_pos, bottom, top, lno;
 	const char *final_commit_name = NULL;
+	int i;
 	enum object_type type;
 
 	static const char *bottomtop = NULL;
+	static const char *viewport = NULL;
 	static int output_option = 0, opt = 0;
 	static int show_stats = 0;
 	static const char *revs_file = NULL;
@@ -2392,6 +2672,7 @@ int cmd_blame(int argc, const char **argv, const char *prefix)
 		{ OPTION_CALLBACK, 'C', NULL, &opt, N_("score"), N_("Find line copies within and across files"), PARSE_OPT_OPTARG, blame_copy_callback },
 		{ OPTION_CALLBACK, 'M', NULL, &opt, N_("score"), N_("Find line movements within and across files"), PARSE_OPT_OPTARG, blame_move_callback },
 		OPT_CALLBACK('L', NULL, &bottomtop, N_("n,m"), N_("Process only line range n,m, counting from 1"), blame_bottomtop_callback),
+		OPT_STRING(0, "viewport", &viewport, N_("n,m"), N_("Resolve line range n,m before the other lines")),
 		OPT__ABBREV(&abbrev),
 		OPT_END()
 	};
@@ -2550,6 +2831,18 @@ parse_done:
 	else if (contents_from)
 		die("Cannot use --contents with final commit object name");
 
+	/*
+	 * The cache only knows about a plain blame of all of the
+	 * history; boundaries, line movements and textconv would all
+	 * change the result.
+	 */
+	use_blame_cache = blame_cache && !reverse && !opt && !revs_file &&
+		revs.max_age == -1 && !is_null_sha1(sb.final->object.sha1) &&
+		!history_is_altered();
+	for (i = 0; i < revs.pending.nr; i++)
+		if (revs.pending.objects[i].item->flags & UNINTERESTING)
+			use_blame_cache = 0;
+
 	/*
 	 * If we have bottom, this will mark the ancestors of the
 	 * bottom commits we would reach while traversing as
@@ -2574,7 +2867,7 @@ parse_done:
 		if (DIFF_OPT_TST(&sb.revs->diffopt, ALLOW_TEXTCONV) &&
 		    textconv_object(path, o->mode, o->blob_sha1, 1, (char **) &sb.final_buf,
 				    &sb.final_buf_size))
-			;
+			use_blame_cache = 0;
 		else
 			sb.final_buf = read_sha1_file(o->blob_sha1, &type,
 						      &sb.final_buf_size);
@@ -2602,6 +2895,24 @@ parse_done:
 	if (lno < top || lno < bottom)
 		die("file %s has only %lu lines", path, lno);
 
+	if (viewport) {
+		long vbottom = 0, vtop = 0;
+
+		prepare_blame_range(&sb, viewport, lno, &vbottom, &vtop);
+		if (vbottom && vtop && vtop < vbottom) {
+			long tmp;
+			tmp = vtop; vtop = vbottom; vbottom = tmp;
+		}
+		if (vbottom < 1)
+			vbottom = 1;
+		if (vtop < 1)
+			vtop = lno;
+		if (lno < vtop || lno < vbottom)
+			die("file %s has only %lu lines", path, lno);
+		sb.viewport_bottom = vbottom - 1;
+		sb.viewport_top = vtop;
+	}
+
 	ent = xcalloc(1, sizeof(*ent));
 	ent->lno = bottom;
 	ent->num_lines = top - bottom;
@@ -2618,6 +2929,9 @@ parse_done:
 
 	assign_blame(&sb, opt);
 
+	if (use_blame_cache && !bottom && top == lno)
+		write_blame_cache(&sb);
+
 	if (incremental)
 		return 0;
 
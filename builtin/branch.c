@@ -585,7 +585,11 @@ static int print_ref_list(int kinds, int detached, int verbose, int abbrev, stru
 	cb.ref_list = &ref_list;
 	cb.pattern = pattern;
 	cb.ret = 0;
-	for_each_rawref(append_ref, &cb);
+	/* look only at the parts of the ref namespace that can match */
+	if (kinds & REF_LOCAL_BRANCH)
+		for_each_rawref_in("refs/heads/", append_ref, &cb);
+	if (kinds & REF_REMOTE_BRANCH)
+		for_each_rawref_in("refs/remotes/", append_ref, &cb);
 	if (merge_filter != NO_FILTER) {
 		struct commit *filter;
 		filter = lookup_commit_reference_gently(merge_filter_ref, 0);
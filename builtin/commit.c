@@ -962,8 +962,11 @@ static const char *read_commit_message(const char *name)
 	 * This also handles the case where input and output
 	 * encodings are identical.
 	 */
-	if (out == NULL)
-		out = xstrdup(commit->buffer);
+	if (out == NULL) {
+		const char *buffer = get_commit_buffer(commit, NULL);
+		out = xstrdup(buffer);
+		unuse_commit_buffer(commit, buffer);
+	}
 	return out;
 }
 
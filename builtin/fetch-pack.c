@@ -13,6 +13,7 @@ int cmd_fetch_pack(int argc, const char **argv, const char *prefix)
 	struct ref *ref = NULL;
 	const char *dest = NULL;
 	struct string_list sought = STRING_LIST_INIT_DUP;
+	const struct string_list *prefixes = NULL;
 	int fd[2];
 	char *pack_lockfile = NULL;
 	char **pack_lockfile_ptr = NULL;
@@ -124,14 +125,24 @@ int cmd_fetch_pack(int argc, const char **argv, const char *prefix)
 		fd[0] = 0;
 		fd[1] = 1;
 	} else {
+		/* we only need to hear about the refs we were asked for */
+		if (!args.fetch_all && sought.nr)
+			prefixes = &sought;
 		conn = git_connect(fd, dest, args.uploadpack,
-				   args.verbose ? CONNECT_VERBOSE : 0);
+				   (args.verbose ? CONNECT_VERBOSE : 0) |
+				   (prefixes ? CONNECT_LS_REFS : 0));
 	}
 
-	get_remote_heads(fd[0], &ref, 0, NULL);
+	get_remote_heads_by_prefix(fd, &ref, 0, NULL, prefixes);
 
-	ref = fetch_pack(&args, fd, conn, ref, dest,
-			 &sought, pack_lockfile_ptr);
+	if (!ref && prefixes && server_supports("ls-refs")) {
+		/* the server has none of the refs we asked for */
+		packet_flush(fd[1]);
+		sort_string_list(&sought);
+		string_list_remove_duplicates(&sought, 0);
+	} else
+		ref = fetch_pack(&args, fd, conn, ref, dest,
+				 &sought, pack_lockfile_ptr);
 	if (pack_lockfile) {
 		printf("lock %s\n", pack_lockfile);
 		fflush(stdout);
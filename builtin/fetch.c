@@ -145,6 +145,61 @@ static void find_non_local_tags(struct transport *transport,
 			struct ref **head,
 			struct ref ***tail);
 
+static void add_refspec_prefix(struct string_list *prefixes,
+			       const struct refspec *rs)
+{
+	const char *src = rs->src;
+	const char **p;
+
+	if (!src || !*src) {
+		string_list_append(prefixes, "HEAD");
+		return;
+	}
+	if (rs->pattern) {
+		char *prefix = xmemdupz(src, strchrnul(src, '*') - src);
+		string_list_append(prefixes, prefix);
+		free(prefix);
+		return;
+	}
+	/* a short name may match any of the refs it can be expanded to */
+	for (p = ref_rev_parse_rules; *p; p++)
+		string_list_append(prefixes, mkpath(*p, (int)strlen(src), src));
+}
+
+/*
+ * Collect the prefixes of the remote refs get_ref_map() may look at, so
+ * that the server does not need to advertise the others.
+ */
+static void get_ref_prefixes(struct transport *transport,
+			     struct refspec *refs, int ref_count, int tags,
+			     struct string_list *prefixes)
+{
+	int i;
+
+	if (ref_count || tags == TAGS_SET) {
+		for (i = 0; i < ref_count; i++)
+			add_refspec_prefix(prefixes, &refs[i]);
+	} else {
+		struct remote *remote = transport->remote;
+		struct branch *branch = branch_get(NULL);
+		int has_merge = branch_has_merge_config(branch);
+		if (remote &&
+		    (remote->fetch_refspec_nr ||
+		     (has_merge && !strcmp(branch->remote_name, remote->name)))) {
+			for (i = 0; i < remote->fetch_refspec_nr; i++)
+				add_refspec_prefix(prefixes, &remote->fetch[i]);
+			if (has_merge &&
+			    !strcmp(branch->remote_name, remote->name))
+				for (i = 0; i < branch->merge_nr; i++)
+					add_refspec_prefix(prefixes,
+							   branch->merge[i]);
+		} else
+			string_list_append(prefixes, "HEAD");
+	}
+	if (tags != TAGS_UNSET)
+		string_list_append(prefixes, "refs/tags/");
+}
+
 static struct ref *get_ref_map(struct transport *transport,
 			       struct refspec *refs, int ref_count, int tags,
 			       int *autotags)
@@ -568,7 +623,8 @@ static int add_existing(const char *refname, const unsigned char *sha1,
 {
 	struct string_list *list = (struct string_list *)cbdata;
 	struct string_list_item *item = string_list_insert(list, refname);
-	item->util = (void *)sha1;
+	item->util = xmalloc(20);
+	hashcpy(item->util, sha1);
 	return 0;
 }
 
@@ -587,7 +643,7 @@ static void find_non_local_tags(struct transport *transport,
 			struct ref **head,
 			struct ref ***tail)
 {
-	struct string_list existing_refs = STRING_LIST_INIT_NODUP;
+	struct string_list existing_refs = STRING_LIST_INIT_DUP;
 	struct string_list remote_refs = STRING_LIST_INIT_NODUP;
 	const struct ref *ref;
 	struct string_list_item *item = NULL;
@@ -633,7 +689,7 @@ static void find_non_local_tags(struct transport *transport,
 		item = string_list_insert(&remote_refs, ref->name);
 		item->util = (void *)ref->old_sha1;
 	}
-	string_list_clear(&existing_refs, 0);
+	string_list_clear(&existing_refs, 1);
 
 	/*
 	 * We may have a final lightweight tag that needs to be
@@ -690,11 +746,13 @@ static int truncate_fetch_head(void)
 static int do_fetch(struct transport *transport,
 		    struct refspec *refs, int ref_count)
 {
-	struct string_list existing_refs = STRING_LIST_INIT_NODUP;
+	struct string_list existing_refs = STRING_LIST_INIT_DUP;
+	struct string_list ref_prefixes = STRING_LIST_INIT_DUP;
 	struct string_list_item *peer_item = NULL;
 	struct ref *ref_map;
 	struct ref *rm;
 	int autotags = (transport->remote->fetch_tags == 1);
+	int retcode = 0;
 
 	for_each_ref(add_existing, &existing_refs);
 
@@ -715,6 +773,8 @@ static int do_fetch(struct transport *transport,
 			return errcode;
 	}
 
+	get_ref_prefixes(transport, refs, ref_count, tags, &ref_prefixes);
+	transport->ref_prefixes = &ref_prefixes;
 	ref_map = get_ref_map(transport, refs, ref_count, tags, &autotags);
 	if (!update_head_ok)
 		check_not_current_branch(ref_map);
@@ -733,7 +793,8 @@ static int do_fetch(struct transport *transport,
 		transport_set_option(transport, TRANS_OPT_FOLLOWTAGS, "1");
 	if (fetch_refs(transport, ref_map)) {
 		free_refs(ref_map);
-		return 1;
+		retcode = 1;
+		goto cleanup;
 	}
 	if (prune) {
 		/* If --tags was specified, pretend the user gave us the canonical tags refspec */
@@ -776,7 +837,11 @@ static int do_fetch(struct transport *transport,
 		free_refs(ref_map);
 	}
 
-	return 0;
+ cleanup:
+	transport->ref_prefixes = NULL;
+	string_list_clear(&ref_prefixes, 0);
+	string_list_clear(&existing_refs, 1);
+	return retcode;
 }
 
 static void set_option(const char *name, const char *value)
@@ -9,6 +9,7 @@
 #include "quote.h"
 #include "parse-options.h"
 #include "exec_cmd.h"
+#include "string-list.h"
 
 static void hash_fd(int fd, const char *type, int write_object, const char *path)
 {
@@ -38,19 +39,133 @@ static void hash_object(const char *path, const char *type, int write_object,
 
 static int no_filters;
 
+/*
+ * Without -w, small blobs named on stdin are read into memory up to
+ * HASH_BATCH at a time, so that hash_sha1_files() can hash them
+ * together.  Files larger than HASH_BATCH_SIZE are left to index_fd(),
+ * which handles them one at a time as before.
+ */
+#define HASH_BATCH 32
+#define HASH_BATCH_SIZE (64 * 1024)
+
+static void hash_paths(struct string_list *paths)
+{
+	struct hash_sha1_job jobs[HASH_BATCH];
+	struct strbuf data[HASH_BATCH];
+	unsigned char sha1[HASH_BATCH][20];
+	int batched[HASH_BATCH];
+	int i, nr = 0;
+
+	if (!paths->nr)
+		return;
+
+	for (i = 0; i < paths->nr; i++) {
+		const char *path = paths->items[i].string;
+		const char *vpath = no_filters ? NULL : path;
+		struct stat st;
+		int fd;
+
+		strbuf_init(&data[i], 0);
+		batched[i] = -1;
+		fd = open(path, O_RDONLY);
+		if (fd < 0)
+			die_errno("Cannot open '%s'", path);
+		if (fstat(fd, &st) < 0)
+			die("Unable to hash %s", path);
+		if (!S_ISREG(st.st_mode) || st.st_size > HASH_BATCH_SIZE) {
+			if (index_fd(sha1[i], fd, &st, OBJ_BLOB, vpath,
+				     HASH_FORMAT_CHECK))
+				die("Unable to hash %s", path);
+			continue;
+		}
+		if (strbuf_read(&data[i], fd, st.st_size) < 0)
+			die_errno("Unable to hash %s", path);
+		close(fd);
+		if (vpath) {
+			struct strbuf nbuf = STRBUF_INIT;
+			if (convert_to_git(vpath, data[i].buf, data[i].len,
+					   &nbuf, SAFE_CRLF_FALSE))
+				strbuf_swap(&data[i], &nbuf);
+			strbuf_release(&nbuf);
+		}
+		jobs[nr].buf = data[i].buf;
+		jobs[nr].len = data[i].len;
+		jobs[nr].type = blob_type;
+		batched[i] = nr++;
+	}
+	hash_sha1_files(jobs, nr);
+
+	for (i = 0; i < paths->nr; i++) {
+		if (batched[i] >= 0)
+			hashcpy(sha1[i], jobs[batched[i]].sha1);
+		printf("%s\n", sha1_to_hex(sha1[i]));
+		strbuf_release(&data[i]);
+	}
+	maybe_flush_or_die(stdout, "hash to stdout");
+	string_list_clear(paths, 0);
+}
+
+static void unquote_path(struct strbuf *buf, struct strbuf *nbuf)
+{
+	if (buf->buf[0] == '"') {
+		strbuf_reset(nbuf);
+		if (unquote_c_style(nbuf, buf->buf, NULL))
+			die("line is badly quoted");
+		strbuf_swap(buf, nbuf);
+	}
+}
+
+/*
+ * Batch only the paths that have already arrived: whatever one read(2)
+ * returns is hashed, and the names are flushed before reading again, so
+ * that a caller writing one path at a time still gets each answer.
+ */
+static void hash_stdin_paths_batched(void)
+{
+	struct strbuf in = STRBUF_INIT, buf = STRBUF_INIT, nbuf = STRBUF_INIT;
+	struct string_list paths = STRING_LIST_INIT_DUP;
+	ssize_t n;
+
+	do {
+		char *eol;
+		size_t used = 0;
+
+		strbuf_grow(&in, 8192);
+		n = xread(0, in.buf + in.len, 8192);
+		if (n < 0)
+			die_errno("read error on stdin");
+		strbuf_setlen(&in, in.len + n);
+		if (!n && in.len)
+			strbuf_addch(&in, '\n');
+		while ((eol = memchr(in.buf + used, '\n', in.len - used))) {
+			strbuf_reset(&buf);
+			strbuf_add(&buf, in.buf + used, eol - (in.buf + used));
+			used = eol + 1 - in.buf;
+			unquote_path(&buf, &nbuf);
+			string_list_append(&paths, buf.buf);
+			if (paths.nr == HASH_BATCH)
+				hash_paths(&paths);
+		}
+		strbuf_remove(&in, 0, used);
+		hash_paths(&paths);
+	} while (n);
+	strbuf_release(&in);
+	strbuf_release(&buf);
+	strbuf_release(&nbuf);
+}
+
 static void hash_stdin_paths(const char *type, int write_objects)
 {
 	struct strbuf buf = STRBUF_INIT, nbuf = STRBUF_INIT;
 
+	if (!write_objects && !strcmp(type, blob_type)) {
+		hash_stdin_paths_batched();
+		return;
+	}
 	while (strbuf_getline(&buf, stdin, '\n') != EOF) {
-		if (buf.buf[0] == '"') {
-			strbuf_reset(&nbuf);
-			if (unquote_c_style(&nbuf, buf.buf, NULL))
-				die("line is badly quoted");
-			strbuf_swap(&buf, &nbuf);
-		}
+		unquote_path(&buf, &nbuf);
 		hash_object(buf.buf, type, write_objects,
-		    no_filters ? NULL : buf.buf);
+			    no_filters ? NULL : buf.buf);
 	}
 	strbuf_release(&buf);
 	strbuf_release(&nbuf);
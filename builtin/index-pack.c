@@ -74,6 +74,20 @@ static int nr_objects;
 static int nr_deltas;
 static int nr_resolved_deltas;
 static int nr_threads;
+static int first_pass_threads;
+
+/*
+ * The delta bases that all threads keep in memory together take up
+ * base_cache_used bytes, which prune_base_data() keeps within
+ * base_cache_limit.  Each thread is entitled to base_cache_share of
+ * it, and may use more only while the others leave it unused.
+ */
+static size_t base_cache_limit, base_cache_share;
+static size_t base_cache_used, base_cache_peak;
+static unsigned long nr_base_evictions;
+
+/* see count_dependents() */
+static uint32_t *dependents;
 
 static int from_stdin;
 static int strict;
@@ -340,24 +354,57 @@ static struct base_data *alloc_base_data(void)
 	return base;
 }
 
+static void base_cache_grow(unsigned long size)
+{
+	get_thread_data()->base_cache_used += size;
+	counter_lock();
+	base_cache_used += size;
+	if (base_cache_peak < base_cache_used)
+		base_cache_peak = base_cache_used;
+	counter_unlock();
+}
+
+static int base_cache_full(void)
+{
+	int full;
+
+	counter_lock();
+	full = base_cache_used > base_cache_limit;
+	counter_unlock();
+	return full;
+}
+
 static void free_base_data(struct base_data *c)
 {
 	if (c->data) {
 		free(c->data);
 		c->data = NULL;
 		get_thread_data()->base_cache_used -= c->size;
+		counter_lock();
+		base_cache_used -= c->size;
+		counter_unlock();
 	}
 }
 
+/*
+ * A thread can only drop the bases on its own chain, oldest first.  It
+ * does so only while it holds more than its share, so a thread that
+ * took the memory the others left unused gives it back the next time
+ * it adds a base, instead of the others having to drop all of theirs.
+ */
 static void prune_base_data(struct base_data *retain)
 {
 	struct base_data *b;
 	struct thread_local *data = get_thread_data();
 	for (b = data->base_cache;
-	     data->base_cache_used > delta_base_cache_limit && b;
+	     b && data->base_cache_used > base_cache_share && base_cache_full();
 	     b = b->child) {
-		if (b->data && b != retain)
+		if (b->data && b != retain) {
 			free_base_data(b);
+			counter_lock();
+			nr_base_evictions++;
+			counter_unlock();
+		}
 	}
 }
 
@@ -371,7 +418,7 @@ static void link_base_data(struct base_data *base, struct base_data *c)
 	c->base = base;
 	c->child = NULL;
 	if (c->data)
-		get_thread_data()->base_cache_used += c->size;
+		base_cache_grow(c->size);
 	prune_base_data(c);
 }
 
@@ -401,16 +448,18 @@ static void *unpack_entry_data(unsigned long offset, unsigned long size,
 	char hdr[32];
 	int hdrlen;
 
-	if (!is_delta_type(type)) {
+	if (type == OBJ_BLOB && size > big_file_threshold)
+		buf = fixed_buf;
+	else
+		buf = xmalloc(size);
+
+	/* with first_pass_threads, whole objects are hashed by them */
+	if (!is_delta_type(type) && (buf == fixed_buf || !first_pass_threads)) {
 		hdrlen = sprintf(hdr, "%s %lu", typename(type), size) + 1;
 		git_SHA1_Init(&c);
 		git_SHA1_Update(&c, hdr, hdrlen);
 	} else
 		sha1 = NULL;
-	if (type == OBJ_BLOB && size > big_file_threshold)
-		buf = fixed_buf;
-	else
-		buf = xmalloc(size);
 
 	memset(&stream, 0, sizeof(stream));
 	git_inflate_init(&stream);
@@ -756,7 +805,7 @@ static void sha1_object(const void *data, struct object_entry *obj_entry,
 			}
 			if (obj->type == OBJ_COMMIT) {
 				struct commit *commit = (struct commit *) obj;
-				commit->buffer = NULL;
+				detach_commit_buffer(commit, NULL);
 			}
 			obj->flags |= FLAG_CHECKED;
 		}
@@ -803,7 +852,7 @@ static void *get_base_data(struct base_data *c)
 		if (!delta_nr) {
 			c->data = get_data_from_pack(obj);
 			c->size = obj->size;
-			get_thread_data()->base_cache_used += c->size;
+			base_cache_grow(c->size);
 			prune_base_data(c);
 		}
 		for (; delta_nr > 0; delta_nr--) {
@@ -819,7 +868,7 @@ static void *get_base_data(struct base_data *c)
 			free(raw);
 			if (!c->data)
 				bad_object(obj->idx.offset, _("failed to apply delta"));
-			get_thread_data()->base_cache_used += c->size;
+			base_cache_grow(c->size);
 			prune_base_data(c);
 		}
 		free(delta);
@@ -931,10 +980,68 @@ static int compare_delta_entry(const void *a, const void *b)
 	const struct delta_entry *delta_a = a;
 	const struct delta_entry *delta_b = b;
 
+	int cmp;
+
 	/* group by type (ref vs ofs) and then by value (sha-1 or offset) */
-	return compare_delta_bases(&delta_a->base, &delta_b->base,
-				   objects[delta_a->obj_no].type,
-				   objects[delta_b->obj_no].type);
+	cmp = compare_delta_bases(&delta_a->base, &delta_b->base,
+				  objects[delta_a->obj_no].type,
+				  objects[delta_b->obj_no].type);
+	if (cmp)
+		return cmp;
+
+	/*
+	 * The children of a base are resolved in this order, each along
+	 * with everything that depends on it.  The base can be dropped
+	 * once its last child is resolved, so have the children that
+	 * many objects depend on come last: the smaller subtrees are
+	 * done while the base is still likely to be in memory, and the
+	 * largest one does not compete with the base for the cache.
+	 */
+	if (dependents[delta_a->obj_no] != dependents[delta_b->obj_no])
+		return dependents[delta_a->obj_no] < dependents[delta_b->obj_no] ? -1 : 1;
+	return delta_a->obj_no - delta_b->obj_no;
+}
+
+static int find_object_by_offset(off_t offset)
+{
+	int first = 0, last = nr_objects;
+
+	while (first < last) {
+		int next = (first + last) / 2;
+		off_t cur = objects[next].idx.offset;
+
+		if (cur == offset)
+			return next;
+		if (offset < cur)
+			last = next;
+		else
+			first = next + 1;
+	}
+	return -1;
+}
+
+/*
+ * Count the objects that depend on each object, directly or through
+ * other deltas.  Only deltas against an offset are known to depend on
+ * a particular object before the deltas are resolved, and as a delta
+ * always comes after its base in the pack, going backwards through the
+ * deltas sees every object after all of its dependents.
+ */
+static void count_dependents(void)
+{
+	int i;
+
+	dependents = xcalloc(nr_objects, sizeof(*dependents));
+	for (i = nr_deltas - 1; i >= 0; i--) {
+		struct delta_entry *delta = &deltas[i];
+		int base;
+
+		if (objects[delta->obj_no].type != OBJ_OFS_DELTA)
+			continue;
+		base = find_object_by_offset(delta->base.offset);
+		if (base >= 0)
+			dependents[base] += dependents[delta->obj_no] + 1;
+	}
 }
 
 static void resolve_base(struct object_entry *obj)
@@ -969,6 +1076,125 @@ static void *threaded_second_pass(void *data)
 }
 #endif
 
+#ifndef NO_PTHREADS
+/*
+ * Only inflating an object finds where it ends, so the first pass reads
+ * and inflates the objects in order.  Hashing and checking the inflated
+ * non-delta objects is left to first_pass_threads threads, which take
+ * them from a queue.  The queue holds at most FIRST_PASS_QUEUE_BYTES of
+ * inflated data (or a single larger object), so that the input is still
+ * streamed instead of being buffered in memory.  A thread takes up to
+ * FIRST_PASS_BATCH objects at a time, which hash_sha1_files() may hash
+ * side by side.
+ */
+#define FIRST_PASS_QUEUE_ITEMS 1024
+#define FIRST_PASS_QUEUE_BYTES (32 * 1024 * 1024)
+#define FIRST_PASS_BATCH 8
+
+struct first_pass_item {
+	struct object_entry *obj;
+	void *data;
+};
+static struct first_pass_item first_pass_queue[FIRST_PASS_QUEUE_ITEMS];
+static int first_pass_head, first_pass_nr, first_pass_done;
+static unsigned long first_pass_bytes;
+static pthread_cond_t first_pass_more;
+static pthread_cond_t first_pass_room;
+
+static void *threaded_first_pass(void *data)
+{
+	for (;;) {
+		struct first_pass_item items[FIRST_PASS_BATCH];
+		struct hash_sha1_job jobs[FIRST_PASS_BATCH];
+		int i, nr;
+
+		work_lock();
+		while (!first_pass_nr && !first_pass_done)
+			pthread_cond_wait(&first_pass_more, &work_mutex);
+		if (!first_pass_nr) {
+			work_unlock();
+			break;
+		}
+		for (nr = 0; nr < FIRST_PASS_BATCH && first_pass_nr; nr++) {
+			items[nr] = first_pass_queue[first_pass_head];
+			first_pass_head = (first_pass_head + 1) % FIRST_PASS_QUEUE_ITEMS;
+			first_pass_nr--;
+			first_pass_bytes -= items[nr].obj->size;
+		}
+		pthread_cond_signal(&first_pass_room);
+		work_unlock();
+
+		for (i = 0; i < nr; i++) {
+			jobs[i].buf = items[i].data;
+			jobs[i].len = items[i].obj->size;
+			jobs[i].type = typename(items[i].obj->type);
+		}
+		hash_sha1_files(jobs, nr);
+		for (i = 0; i < nr; i++) {
+			struct object_entry *obj = items[i].obj;
+
+			hashcpy(obj->idx.sha1, jobs[i].sha1);
+			sha1_object(items[i].data, NULL, obj->size, obj->type,
+				    obj->idx.sha1);
+			free(items[i].data);
+		}
+	}
+	return NULL;
+}
+
+static void queue_first_pass(struct object_entry *obj, void *data)
+{
+	struct first_pass_item *item;
+
+	work_lock();
+	while (first_pass_nr == FIRST_PASS_QUEUE_ITEMS ||
+	       (first_pass_nr &&
+		first_pass_bytes + obj->size > FIRST_PASS_QUEUE_BYTES))
+		pthread_cond_wait(&first_pass_room, &work_mutex);
+	item = &first_pass_queue[(first_pass_head + first_pass_nr) %
+				 FIRST_PASS_QUEUE_ITEMS];
+	item->obj = obj;
+	item->data = data;
+	first_pass_nr++;
+	first_pass_bytes += obj->size;
+	pthread_cond_signal(&first_pass_more);
+	work_unlock();
+}
+
+static void start_first_pass_threads(void)
+{
+	int i;
+
+	init_thread();
+	pthread_cond_init(&first_pass_more, NULL);
+	pthread_cond_init(&first_pass_room, NULL);
+	first_pass_head = first_pass_nr = first_pass_done = 0;
+	first_pass_bytes = 0;
+	for (i = 0; i < first_pass_threads; i++) {
+		int ret = pthread_create(&thread_data[i].thread, NULL,
+					 threaded_first_pass, thread_data + i);
+		if (ret)
+			die(_("unable to create thread: %s"), strerror(ret));
+	}
+}
+
+static void finish_first_pass_threads(void)
+{
+	int i;
+
+	work_lock();
+	first_pass_done = 1;
+	pthread_cond_broadcast(&first_pass_more);
+	work_unlock();
+	for (i = 0; i < first_pass_threads; i++)
+		pthread_join(thread_data[i].thread, NULL);
+	pthread_cond_destroy(&first_pass_more);
+	pthread_cond_destroy(&first_pass_room);
+	cleanup_thread();
+	first_pass_threads = 0;
+}
+#endif
+
 /*
  * First pass:
  * - find locations of all objects;
@@ -985,6 +1211,12 @@ static void parse_pack_objects(unsigned char *sha1)
 		progress = start_progress(
 				from_stdin ? _("Receiving objects") : _("Indexing objects"),
 				nr_objects);
+#ifndef NO_PTHREADS
+	if (nr_threads > 1 || getenv("GIT_FORCE_THREADS")) {
+		first_pass_threads = nr_threads;
+		start_first_pass_threads();
+	}
+#endif
 	for (i = 0; i < nr_objects; i++) {
 		struct object_entry *obj = &objects[i];
 		void *data = unpack_raw_entry(obj, &delta->base, obj->idx.sha1);
@@ -997,12 +1229,21 @@ static void parse_pack_objects(unsigned char *sha1)
 			/* large blobs, check later */
 			obj->real_type = OBJ_BAD;
 			nr_delays++;
+#ifndef NO_PTHREADS
+		} else if (first_pass_threads) {
+			queue_first_pass(obj, data);
+			data = NULL;
+#endif
 		} else
 			sha1_object(data, NULL, obj->size, obj->type, obj->idx.sha1);
 		free(data);
 		display_progress(progress, i+1);
 	}
 	objects[i].idx.offset = consumed_bytes;
+#ifndef NO_PTHREADS
+	if (first_pass_threads)
+		finish_first_pass_threads();
+#endif
 	stop_progress(&progress);
 
 	/* Check pack integrity */
@@ -1039,16 +1280,39 @@ static void parse_pack_objects(unsigned char *sha1)
  *   recursively checking if the resulting object is used as a base
  *   for some more deltas.
  */
+static void report_delta_resolution(const struct timeval *start)
+{
+	struct timeval end;
+	long ms;
+
+	gettimeofday(&end, NULL);
+	ms = (end.tv_sec - start->tv_sec) * 1000 +
+		(end.tv_usec - start->tv_usec) / 1000;
+	trace_printf("index-pack: resolved %d deltas in %ld ms; "
+		     "delta bases used up to %lu of %lu bytes, "
+		     "dropped %lu times\n",
+		     nr_resolved_deltas, ms,
+		     (unsigned long)base_cache_peak,
+		     (unsigned long)base_cache_limit, nr_base_evictions);
+}
+
 static void resolve_deltas(void)
 {
+	struct timeval start;
 	int i;
 
 	if (!nr_deltas)
 		return;
 
+	gettimeofday(&start, NULL);
+	base_cache_limit = base_cache_share = delta_base_cache_limit;
+
 	/* Sort deltas by base SHA1/offset for fast searching */
+	count_dependents();
 	qsort(deltas, nr_deltas, sizeof(struct delta_entry),
 	      compare_delta_entry);
+	free(dependents);
+	dependents = NULL;
 
 	if (verbose)
 		progress = start_progress(_("Resolving deltas"), nr_deltas);
@@ -1056,6 +1320,8 @@ static void resolve_deltas(void)
 #ifndef NO_PTHREADS
 	nr_dispatched = 0;
 	if (nr_threads > 1 || getenv("GIT_FORCE_THREADS")) {
+		/* the threads share what each would have had on its own */
+		base_cache_limit = delta_base_cache_limit * nr_threads;
 		init_thread();
 		for (i = 0; i < nr_threads; i++) {
 			int ret = pthread_create(&thread_data[i].thread, NULL,
@@ -1067,6 +1333,7 @@ static void resolve_deltas(void)
 		for (i = 0; i < nr_threads; i++)
 			pthread_join(thread_data[i].thread, NULL);
 		cleanup_thread();
+		report_delta_resolution(&start);
 		return;
 	}
 #endif
@@ -1079,6 +1346,7 @@ static void resolve_deltas(void)
 		resolve_base(obj);
 		display_progress(progress, nr_resolved_deltas);
 	}
+	report_delta_resolution(&start);
 }
 
 /*
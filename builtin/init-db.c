@@ -183,10 +183,12 @@ static int create_default_files(const char *template_path)
 	unsigned len = strlen(git_dir);
 	static char path[PATH_MAX];
 	struct stat st1;
-	char repo_version_string[10];
+	struct strbuf repo_version_string = STRBUF_INIT;
 	char junk[2];
 	int reinit;
 	int filemode;
+	/* copy_templates() overwrites repository_format_version */
+	int repo_version = repository_format_version;
 
 	if (len > sizeof(path)-50)
 		die(_("insane git directory %s"), git_dir);
@@ -241,9 +243,14 @@ static int create_default_files(const char *template_path)
 			exit(1);
 	}
 
-	/* This forces creation of new config file */
-	sprintf(repo_version_string, "%d", GIT_REPO_VERSION);
-	git_config_set("core.repositoryformatversion", repo_version_string);
+	/*
+	 * This forces creation of new config file; a repository that
+	 * uses a newer format keeps it when it is reinitialized.
+	 */
+	strbuf_addf(&repo_version_string, "%d",
+		    repo_version > GIT_REPO_VERSION ? repo_version : GIT_REPO_VERSION);
+	git_config_set("core.repositoryformatversion", repo_version_string.buf);
+	strbuf_release(&repo_version_string);
 
 	path[len] = 0;
 	strcpy(path + len, "config");
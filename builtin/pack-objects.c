@@ -18,6 +18,7 @@
 #include "refs.h"
 #include "streaming.h"
 #include "thread-utils.h"
+#include "delta-islands.h"
 
 static const char *pack_usage[] = {
 	N_("git pack-objects --stdout [options...] [< ref-list | < object-list]"),
@@ -68,6 +69,7 @@ static unsigned long unpack_unreachable_expiration;
 static int local;
 static int incremental;
 static int ignore_packed_keep;
+static int use_delta_islands;
 static int allow_ofs_delta;
 static struct pack_idx_option pack_idx_opts;
 static const char *base_name;
@@ -151,6 +153,290 @@ static unsigned long do_compress(void **pptr, unsigned long size)
 	return stream.total_out;
 }
 
+#ifndef NO_PTHREADS
+
+/*
+ * Objects that are not reused from an existing pack and are not stored
+ * as deltas have to be deflated from scratch while the pack is written.
+ * To keep that off the single writer thread, the writer reads such
+ * objects a little ahead of itself in write order and hands them to a
+ * pool of threads, which deflate them into a bounded queue.  The writer
+ * then picks the results up when it gets to the objects.
+ */
+struct compress_job {
+	struct object_entry *entry;
+	void *data;		/* raw, then deflated object data */
+	unsigned long size;	/* uncompressed size */
+	unsigned long datalen;	/* compressed size */
+	enum object_type type;
+	enum {
+		COMPRESS_UNREAD = 0,
+		COMPRESS_QUEUED,
+		COMPRESS_BUSY,
+		COMPRESS_DONE
+	} state;
+};
+
+static struct compress_job *compress_jobs;
+static uint32_t compress_jobs_nr;
+/* jobs before these have been taken by the writer, read, handed out */
+static uint32_t compress_consumed, compress_filled, compress_next;
+static uint32_t compress_ahead_max;
+static unsigned long compress_ahead_size;
+static unsigned long compress_ahead_limit = 64 * 1024 * 1024;
+static int compress_stopping;
+
+static pthread_t *compress_threads;
+static int compress_threads_nr;
+static pthread_t writer_thread;
+static pthread_mutex_t compress_mutex;
+static pthread_cond_t compress_cond;
+#define compress_lock()		pthread_mutex_lock(&compress_mutex)
+#define compress_unlock()	pthread_mutex_unlock(&compress_mutex)
+
+static try_to_free_t old_try_to_free_for_compression;
+
+/*
+ * Only the writer thread looks at the object store while the pipeline
+ * runs, so only it may release pack windows to satisfy an allocation.
+ */
+static void try_to_free_from_writer(size_t size)
+{
+	if (pthread_equal(pthread_self(), writer_thread))
+		release_pack_memory(size, -1);
+}
+
+static void *threaded_compress(void *arg)
+{
+	compress_lock();
+	for (;;) {
+		struct compress_job *job;
+
+		while (compress_next < compress_filled &&
+		       compress_jobs[compress_next].state != COMPRESS_QUEUED)
+			compress_next++;
+		if (compress_next == compress_filled) {
+			if (compress_stopping)
+				break;
+			pthread_cond_wait(&compress_cond, &compress_mutex);
+			continue;
+		}
+
+		job = &compress_jobs[compress_next++];
+		job->state = COMPRESS_BUSY;
+		compress_unlock();
+		job->datalen = do_compress(&job->data, job->size);
+		compress_lock();
+		job->state = COMPRESS_DONE;
+		pthread_cond_broadcast(&compress_cond);
+	}
+	compress_unlock();
+	return NULL;
+}
+
+/* read objects ahead of the writer, as far as the queue bounds allow */
+static void fill_compress_queue(void)
+{
+	for (;;) {
+		struct compress_job *job;
+		struct object_entry *e;
+
+		compress_lock();
+		if (compress_filled == compress_jobs_nr ||
+		    compress_filled - compress_consumed >= compress_ahead_max ||
+		    (compress_filled > compress_consumed &&
+		     compress_ahead_size >= compress_ahead_limit)) {
+			compress_unlock();
+			return;
+		}
+		job = &compress_jobs[compress_filled];
+		compress_unlock();
+
+		/* objects written out of order early need no work */
+		e = job->entry;
+		if (!e->idx.offset)
+			job->data = read_sha1_file(e->idx.sha1, &job->type,
+						   &job->size);
+
+		compress_lock();
+		if (job->data) {
+			job->state = COMPRESS_QUEUED;
+			compress_ahead_size += job->size;
+			pthread_cond_broadcast(&compress_cond);
+		} else {
+			job->state = COMPRESS_DONE;
+		}
+		compress_filled++;
+		compress_unlock();
+	}
+}
+
+/* call with compress_mutex held */
+static void *finish_compress_job(struct compress_job *job)
+{
+	void *data;
+
+	if (job->state == COMPRESS_QUEUED) {
+		job->state = COMPRESS_BUSY;
+		compress_unlock();
+		job->datalen = do_compress(&job->data, job->size);
+		compress_lock();
+		job->state = COMPRESS_DONE;
+	}
+	while (job->state == COMPRESS_BUSY)
+		pthread_cond_wait(&compress_cond, &compress_mutex);
+
+	data = job->data;
+	if (data)
+		compress_ahead_size -= job->size;
+	job->data = NULL;
+	return data;
+}
+
+/*
+ * Return the deflated data of "e" if it went through the queue, or NULL
+ * if the caller has to read and deflate the object itself.
+ */
+static void *take_compressed(struct object_entry *e, enum object_type *type,
+			     unsigned long *size, unsigned long *datalen)
+{
+	struct compress_job *job = NULL;
+	uint32_t i;
+	void *data;
+
+	if (!compress_jobs)
+		return NULL;
+
+	/* drop whatever was queued for objects that are out already */
+	compress_lock();
+	while (compress_consumed < compress_jobs_nr) {
+		job = &compress_jobs[compress_consumed];
+		if (job->entry == e || !job->entry->idx.offset)
+			break;
+		if (compress_consumed < compress_filled) {
+			if (job->state == COMPRESS_QUEUED)
+				job->state = COMPRESS_DONE;
+			free(finish_compress_job(job));
+		}
+		compress_consumed++;
+	}
+	if (compress_filled < compress_consumed)
+		compress_filled = compress_consumed;
+	compress_unlock();
+
+	fill_compress_queue();
+
+	compress_lock();
+	for (i = compress_consumed; i < compress_filled; i++)
+		if (compress_jobs[i].entry == e)
+			break;
+	if (i == compress_filled) {
+		/* not queued; the writer went off the write order */
+		compress_unlock();
+		return NULL;
+	}
+	job = &compress_jobs[i];
+	if (i == compress_consumed)
+		compress_consumed++;
+	data = finish_compress_job(job);
+	compress_unlock();
+
+	if (data) {
+		*type = job->type;
+		*size = job->size;
+		*datalen = job->datalen;
+	}
+	return data;
+}
+
+static int needs_compression(struct object_entry *e)
+{
+	if (e->preferred_base || e->delta)
+		return 0;
+	if (reuse_object && e->in_pack && e->type == e->in_pack_type)
+		return 0;	/* copied from the existing pack */
+	if (e->type == OBJ_BLOB && e->size > big_file_threshold)
+		return 0;	/* streamed, see write_large_blob_data() */
+	return 1;
+}
+
+static void start_compression(struct object_entry **write_order)
+{
+	uint32_t i;
+	int ret;
+
+	if (!delta_search_threads)	/* --threads=0 means autodetect */
+		delta_search_threads = online_cpus();
+	if (delta_search_threads <= 1)
+		return;
+
+	compress_jobs = xcalloc(nr_objects, sizeof(*compress_jobs));
+	for (i = 0; i < nr_objects; i++)
+		if (needs_compression(write_order[i]))
+			compress_jobs[compress_jobs_nr++].entry = write_order[i];
+	if (compress_jobs_nr < 2) {
+		free(compress_jobs);
+		compress_jobs = NULL;
+		compress_jobs_nr = 0;
+		return;
+	}
+
+	compress_consumed = compress_filled = compress_next = 0;
+	compress_ahead_size = 0;
+	compress_ahead_max = 4 * delta_search_threads;
+	compress_stopping = 0;
+
+	pthread_mutex_init(&compress_mutex, NULL);
+	pthread_cond_init(&compress_cond, NULL);
+	writer_thread = pthread_self();
+	old_try_to_free_for_compression =
+		set_try_to_free_routine(try_to_free_from_writer);
+
+	compress_threads_nr = delta_search_threads;
+	compress_threads = xcalloc(compress_threads_nr,
+				   sizeof(*compress_threads));
+	for (i = 0; i < compress_threads_nr; i++) {
+		ret = pthread_create(&compress_threads[i], NULL,
+				     threaded_compress, NULL);
+		if (ret)
+			die("unable to create thread: %s", strerror(ret));
+	}
+}
+
+static void stop_compression(void)
+{
+	uint32_t i;
+
+	if (!compress_jobs)
+		return;
+
+	compress_lock();
+	compress_stopping = 1;
+	pthread_cond_broadcast(&compress_cond);
+	compress_unlock();
+	for (i = 0; i < compress_threads_nr; i++)
+		pthread_join(compress_threads[i], NULL);
+	free(compress_threads);
+	compress_threads = NULL;
+	compress_threads_nr = 0;
+
+	for (i = 0; i < compress_jobs_nr; i++)
+		free(compress_jobs[i].data);
+	free(compress_jobs);
+	compress_jobs = NULL;
+	compress_jobs_nr = 0;
+
+	set_try_to_free_routine(old_try_to_free_for_compression);
+	pthread_cond_destroy(&compress_cond);
+	pthread_mutex_destroy(&compress_mutex);
+}
+
+#else
+#define take_compressed(e, t, s, l)	NULL
+#define start_compression(wo)	(void)0
+#define stop_compression()	(void)0
+#endif
+
 static unsigned long write_large_blob_data(struct git_istream *st, struct sha1file *f,
 					   const unsigned char *sha1)
 {
@@ -250,12 +536,15 @@ static unsigned long write_no_reuse_object(struct sha1file *f, struct object_ent
 	enum object_type type;
 	void *buf;
 	struct git_istream *st = NULL;
+	int compressed = 0;
 
 	if (!usable_delta) {
 		if (entry->type == OBJ_BLOB &&
 		    entry->size > big_file_threshold &&
 		    (st = open_istream(entry->idx.sha1, &type, &size, NULL)) != NULL)
 			buf = NULL;
+		else if ((buf = take_compressed(entry, &type, &size, &datalen)) != NULL)
+			compressed = 1;
 		else {
 			buf = read_sha1_file(entry->idx.sha1, &type, &size);
 			if (!buf)
@@ -285,7 +574,7 @@ static unsigned long write_no_reuse_object(struct sha1file *f, struct object_ent
 		datalen = size;
 	else if (entry->z_delta_size)
 		datalen = entry->z_delta_size;
-	else
+	else if (!compressed)
 		datalen = do_compress(&buf, size);
 
 	/*
@@ -548,6 +837,91 @@ static enum write_one_status write_one(struct sha1file *f,
 	return WRITE_ONE_WRITTEN;
 }
 
+/*
+ * Can the in-pack representation of "e" be copied out byte for byte
+ * when it is written at "offset"?  That is the case when write_object()
+ * would reuse it and produce the very same header: the object must be
+ * either undeltified, or a delta whose base has already been written
+ * at the same distance as in the original pack.
+ */
+static int reusable_verbatim(struct object_entry *e, off_t offset)
+{
+	struct object_entry *base = e->delta;
+	unsigned char header[10];
+	unsigned hdrlen;
+
+	if (!reuse_object || !e->in_pack)
+		return 0;
+
+	hdrlen = encode_in_pack_object_header(e->in_pack_type, e->size, header);
+	if (!base)
+		return e->type == e->in_pack_type &&
+		       hdrlen == e->in_pack_header_size;
+
+	/* check_object() must have decided to reuse the delta */
+	if (e->type != OBJ_OFS_DELTA && e->type != OBJ_REF_DELTA)
+		return 0;
+	if (base->idx.offset <= 1 || base->idx.offset == (off_t)-1)
+		return 0;
+
+	if (e->in_pack_type == OBJ_REF_DELTA)
+		return !allow_ofs_delta &&
+		       hdrlen + 20 == e->in_pack_header_size;
+
+	if (!allow_ofs_delta || base->in_pack != e->in_pack ||
+	    offset - base->idx.offset != e->in_pack_offset - base->in_pack_offset)
+		return 0;
+	for (offset -= base->idx.offset, hdrlen++; offset >>= 7; offset--)
+		hdrlen++;
+	return hdrlen == e->in_pack_header_size;
+}
+
+/*
+ * Find the longest run of objects at the start of "list" that are
+ * stored back to back in the same existing pack and can be reused
+ * verbatim, and copy them out as a single slice of that pack.
+ * Returns the number of objects written.
+ */
+static uint32_t write_reused_slice(struct sha1file *f,
+				   struct object_entry **list, uint32_t nr,
+				   off_t *offset)
+{
+	struct packed_git *p = list[0]->in_pack;
+	struct pack_window *w_curs = NULL;
+	off_t start = list[0]->in_pack_offset;
+	off_t pos = *offset;
+	uint32_t n;
+
+	for (n = 0; n < nr; n++) {
+		struct object_entry *e = list[n];
+		struct revindex_entry *revidx;
+
+		if (e->idx.offset || e->preferred_base || e->in_pack != p ||
+		    e->in_pack_offset != start + (pos - *offset) ||
+		    !reusable_verbatim(e, pos))
+			break;
+
+		revidx = find_pack_revindex(p, e->in_pack_offset);
+		e->idx.offset = pos;
+		written_list[nr_written++] = &e->idx;
+		pos += revidx[1].offset - e->in_pack_offset;
+
+		if (e->delta) {
+			written_delta++;
+			reused_delta++;
+		}
+		written++;
+		reused++;
+	}
+
+	if (n) {
+		copy_pack_data(f, p, &w_curs, start, pos - *offset);
+		unuse_pack(&w_curs);
+		*offset = pos;
+	}
+	return n;
+}
+
 static int mark_tagged(const char *path, const unsigned char *sha1, int flag,
 		       void *cb_data)
 {
@@ -725,6 +1099,7 @@ static void write_pack_file(void)
 		progress_state = start_progress("Writing objects", nr_result);
 	written_list = xmalloc(nr_objects * sizeof(*written_list));
 	write_order = compute_write_order();
+	start_compression(write_order);
 
 	do {
 		unsigned char sha1[20];
@@ -741,6 +1116,22 @@ static void write_pack_file(void)
 		nr_written = 0;
 		for (; i < nr_objects; i++) {
 			struct object_entry *e = write_order[i];
+			/*
+			 * When streaming, objects that sit next to each
+			 * other in an existing pack are copied out in one
+			 * go.  Nothing needs checking per object there, and
+			 * there is no per-object CRC to record.
+			 */
+			if (pack_to_stdout && e->in_pack) {
+				uint32_t n = write_reused_slice(f, write_order + i,
+								nr_objects - i,
+								&offset);
+				if (n) {
+					i += n - 1;
+					display_progress(progress_state, written);
+					continue;
+				}
+			}
 			if (write_one(f, e, &offset) == WRITE_ONE_BREAK)
 				break;
 			display_progress(progress_state, written);
@@ -804,6 +1195,7 @@ static void write_pack_file(void)
 		nr_remaining -= nr_written;
 	} while (nr_remaining && i < nr_objects);
 
+	stop_compression();
 	free(written_list);
 	free(write_order);
 	stop_progress(&progress_state);
@@ -1328,11 +1720,14 @@ static void check_object(struct object_entry *entry)
 			break;
 		}
 
-		if (base_ref && (base_entry = locate_object_entry(base_ref))) {
+		if (base_ref && (base_entry = locate_object_entry(base_ref)) &&
+		    (!use_delta_islands ||
+		     in_same_island(entry->idx.sha1, base_entry->idx.sha1))) {
 			/*
 			 * If base_ref was set above that means we wish to
 			 * reuse delta data, and we even found that base
-			 * in the list of objects we want to pack. Goodie!
+			 * in the list of objects we want to pack (and, with
+			 * delta islands, in the same islands). Goodie!
 			 *
 			 * Depth value does not matter - find_deltas() will
 			 * never consider reused delta as the base object to
@@ -1512,6 +1907,14 @@ static int try_delta(struct unpacked *trg, struct unpacked *src,
 	if (trg_entry->type != src_entry->type)
 		return -1;
 
+	/*
+	 * Don't use a base that is not reachable from every island
+	 * the target is; those islands could not reuse the delta.
+	 */
+	if (use_delta_islands &&
+	    !in_same_island(trg_entry->idx.sha1, src_entry->idx.sha1))
+		return 0;
+
 	/*
 	 * We do not bother to try a delta that we discarded on an
 	 * earlier try, but only when reusing delta data.  Note that
@@ -2159,6 +2562,8 @@ static int git_pack_config(const char *k, const char *v, void *cb)
 			    pack_idx_opts.version);
 		return 0;
 	}
+	if (!strcmp(k, "pack.island"))
+		return island_config(k, v, cb);
 	return git_default_config(k, v, cb);
 }
 
@@ -2199,6 +2604,9 @@ static void show_commit(struct commit *commit, void *data)
 {
 	add_object_entry(commit->object.sha1, OBJ_COMMIT, NULL, 0);
 	commit->object.flags |= OBJECT_ADDED;
+
+	if (use_delta_islands)
+		propagate_island_marks(commit);
 }
 
 static void show_object(struct object *obj,
@@ -2211,6 +2619,9 @@ static void show_object(struct object *obj,
 	add_object_entry(obj->sha1, obj->type, name, 0);
 	obj->flags |= OBJECT_ADDED;
 
+	if (use_delta_islands && obj->type == OBJ_TREE)
+		island_note_tree((struct tree *)obj, name);
+
 	/*
 	 * We will have generated the hash from the name,
 	 * but not saved a pointer to it - we can free it
@@ -2370,17 +2781,33 @@ static void get_object_list(int ac, const char **av)
 				flags ^= UNINTERESTING;
 				continue;
 			}
+			if (!prefixcmp(line, "--shallow ")) {
+				unsigned char sha1[20];
+				if (get_sha1_hex(line + 10, sha1))
+					die("not an SHA-1 '%s'", line + 10);
+				register_shallow(sha1);
+				continue;
+			}
 			die("not a rev '%s'", line);
 		}
 		if (handle_revision_arg(line, &revs, flags, REVARG_CANNOT_BE_FILENAME))
 			die("bad revision '%s'", line);
 	}
 
+	/* island marks must reach a commit before its parents are shown */
+	if (use_delta_islands) {
+		revs.topo_order = 1;
+		revs.limited = 1;
+	}
+
 	if (prepare_revision_walk(&revs))
 		die("revision walk setup failed");
 	mark_edges_uninteresting(revs.commits, &revs, show_edge);
 	traverse_commit_list(&revs, show_commit, show_object, NULL);
 
+	if (use_delta_islands)
+		resolve_tree_islands(progress);
+
 	if (keep_unreachable)
 		add_objects_in_unpacked_packs(&revs);
 	if (unpack_unreachable)
@@ -2505,6 +2932,8 @@ int cmd_pack_objects(int argc, const char **argv, const char *prefix)
 			    N_("pack compression level")),
 		OPT_SET_INT(0, "keep-true-parents", &grafts_replace_parents,
 			    N_("do not hide commits by grafts"), 0),
+		OPT_BOOL(0, "delta-islands", &use_delta_islands,
+			 N_("respect islands during delta compression")),
 		OPT_END(),
 	};
 
@@ -2571,11 +3000,17 @@ int cmd_pack_objects(int argc, const char **argv, const char *prefix)
 	if (keep_unreachable && unpack_unreachable)
 		die("--keep-unreachable and --unpack-unreachable are incompatible.");
 
+	if (use_delta_islands && !use_internal_rev_list)
+		die("--delta-islands requires --revs.");
+
 	if (progress && all_progress_implied)
 		progress = 2;
 
 	prepare_packed_git();
 
+	if (use_delta_islands)
+		load_delta_islands();
+
 	if (progress)
 		progress_state = start_progress("Counting objects", 0);
 	if (!use_internal_rev_list)
@@ -101,10 +101,12 @@ static int reset_index_file(const unsigned char *sha1, int reset_type, int quiet
 static void print_new_head_line(struct commit *commit)
 {
 	const char *hex, *body;
+	const char *buffer;
 
 	hex = find_unique_abbrev(commit->object.sha1, DEFAULT_ABBREV);
 	printf(_("HEAD is now at %s"), hex);
-	body = strstr(commit->buffer, "\n\n");
+	buffer = get_commit_buffer(commit, NULL);
+	body = strstr(buffer, "\n\n");
 	if (body) {
 		const char *eol;
 		size_t len;
@@ -115,6 +117,7 @@ static void print_new_head_line(struct commit *commit)
 	}
 	else
 		printf("\n");
+	unuse_commit_buffer(commit, buffer);
 }
 
 static int update_index_refresh(int fd, struct lock_file *index_lock, int flags)
@@ -2,23 +2,191 @@
 #include "refs.h"
 #include "builtin.h"
 #include "parse-options.h"
+#include "quote.h"
 
 static const char * const git_update_ref_usage[] = {
 	N_("git update-ref [options] -d <refname> [<oldval>]"),
 	N_("git update-ref [options]    <refname> <newval> [<oldval>]"),
+	N_("git update-ref [options] --stdin"),
 	NULL
 };
 
+static struct ref_update **updates;
+static int updates_nr, updates_alloc;
+
+/* flags for the next command, set by "option" */
+static int update_flags;
+
+static struct ref_update *update_alloc(void)
+{
+	struct ref_update *update = xcalloc(1, sizeof(*update));
+
+	ALLOC_GROW(updates, updates_nr + 1, updates_alloc);
+	updates[updates_nr++] = update;
+	update->flags = update_flags;
+	update_flags = 0;
+	return update;
+}
+
+/*
+ * Parse the argument after the SP at *next into arg and advance *next
+ * past it.  An argument is either C-quoted or runs up to the next SP.
+ * Return 0 if the line ends instead.
+ */
+static int parse_next_arg(const char *cmd, const char **next,
+			  struct strbuf *arg)
+{
+	const char *p = *next;
+
+	strbuf_reset(arg);
+	if (!*p)
+		return 0;
+	if (*p != ' ')
+		die("%s: expected SP but got: %s", cmd, p);
+	p++;
+	if (*p == '"') {
+		if (unquote_c_style(arg, p, &p))
+			die("%s: badly quoted argument: %s", cmd, *next + 1);
+		if (*p && *p != ' ')
+			die("%s: unexpected character after quoted argument: %s",
+			    cmd, *next + 1);
+	} else {
+		while (*p && *p != ' ')
+			strbuf_addch(arg, *p++);
+	}
+	*next = p;
+	return 1;
+}
+
+static char *parse_refname(const char *cmd, const char **next)
+{
+	struct strbuf ref = STRBUF_INIT;
+
+	if (!parse_next_arg(cmd, next, &ref) || !ref.len)
+		die("%s: missing <ref>", cmd);
+	if (check_refname_format(ref.buf, REFNAME_ALLOW_ONELEVEL))
+		die("%s: invalid ref format: %s", cmd, ref.buf);
+	return strbuf_detach(&ref, NULL);
+}
+
+/* Parse an optional value; an empty one stands for the null sha1. */
+static int parse_value(const char *cmd, const char *what,
+		       const char **next, unsigned char *sha1)
+{
+	struct strbuf value = STRBUF_INIT;
+
+	if (!parse_next_arg(cmd, next, &value))
+		return 0;
+	if (!value.len)
+		hashclr(sha1);
+	else if (get_sha1(value.buf, sha1))
+		die("%s: invalid %s: %s", cmd, what, value.buf);
+	strbuf_release(&value);
+	return 1;
+}
+
+static void parse_end(const char *cmd, const char *ref, const char *next)
+{
+	if (*next)
+		die("%s %s: extra input: %s", cmd, ref, next);
+}
+
+static void parse_cmd_update(const char *next)
+{
+	struct ref_update *update = update_alloc();
+
+	update->ref_name = parse_refname("update", &next);
+	if (!parse_value("update", "<newvalue>", &next, update->new_sha1))
+		die("update %s: missing <newvalue>", update->ref_name);
+	update->have_new = 1;
+	update->have_old = parse_value("update", "<oldvalue>", &next,
+				       update->old_sha1);
+	parse_end("update", update->ref_name, next);
+}
+
+static void parse_cmd_create(const char *next)
+{
+	struct ref_update *update = update_alloc();
+
+	update->ref_name = parse_refname("create", &next);
+	if (!parse_value("create", "<newvalue>", &next, update->new_sha1))
+		die("create %s: missing <newvalue>", update->ref_name);
+	if (is_null_sha1(update->new_sha1))
+		die("create %s: zero <newvalue>", update->ref_name);
+	update->have_new = 1;
+	update->have_old = 1;
+	parse_end("create", update->ref_name, next);
+}
+
+static void parse_cmd_delete(const char *next)
+{
+	struct ref_update *update = update_alloc();
+
+	update->ref_name = parse_refname("delete", &next);
+	update->have_new = 1;
+	update->have_old = parse_value("delete", "<oldvalue>", &next,
+				       update->old_sha1);
+	if (update->have_old && is_null_sha1(update->old_sha1))
+		die("delete %s: zero <oldvalue>", update->ref_name);
+	parse_end("delete", update->ref_name, next);
+}
+
+static void parse_cmd_verify(const char *next)
+{
+	struct ref_update *update = update_alloc();
+
+	update->ref_name = parse_refname("verify", &next);
+	/* without <oldvalue>, the ref must not exist */
+	parse_value("verify", "<oldvalue>", &next, update->old_sha1);
+	update->have_old = 1;
+	parse_end("verify", update->ref_name, next);
+}
+
+static void parse_cmd_option(const char *next)
+{
+	if (!strcmp(next, " no-deref"))
+		update_flags |= REF_NODEREF;
+	else
+		die("option unknown: %s", next);
+}
+
+static void update_refs_stdin(void)
+{
+	struct strbuf line = STRBUF_INIT;
+
+	while (strbuf_getline(&line, stdin, '\n') != EOF) {
+		const char *cmd = line.buf;
+
+		if (!line.len)
+			die("empty command in input");
+		if (!prefixcmp(cmd, "update"))
+			parse_cmd_update(cmd + 6);
+		else if (!prefixcmp(cmd, "create"))
+			parse_cmd_create(cmd + 6);
+		else if (!prefixcmp(cmd, "delete"))
+			parse_cmd_delete(cmd + 6);
+		else if (!prefixcmp(cmd, "verify"))
+			parse_cmd_verify(cmd + 6);
+		else if (!prefixcmp(cmd, "option"))
+			parse_cmd_option(cmd + 6);
+		else
+			die("unknown command: %s", cmd);
+	}
+	strbuf_release(&line);
+}
+
 int cmd_update_ref(int argc, const char **argv, const char *prefix)
 {
 	const char *refname, *oldval, *msg = NULL;
 	unsigned char sha1[20], oldsha1[20];
-	int delete = 0, no_deref = 0, flags = 0;
+	int delete = 0, no_deref = 0, read_stdin = 0, flags = 0;
 	struct option options[] = {
 		OPT_STRING( 'm', NULL, &msg, N_("reason"), N_("reason of the update")),
 		OPT_BOOLEAN('d', NULL, &delete, N_("delete the reference")),
 		OPT_BOOLEAN( 0 , "no-deref", &no_deref,
 					N_("update <refname> not the one it points to")),
+		OPT_BOOLEAN( 0 , "stdin", &read_stdin,
+					N_("read updates from stdin")),
 		OPT_END(),
 	};
 
@@ -28,6 +196,13 @@ int cmd_update_ref(int argc, const char **argv, const char *prefix)
 	if (msg && !*msg)
 		die("Refusing to perform update with empty message.");
 
+	if (read_stdin) {
+		if (delete || no_deref || argc > 0)
+			usage_with_options(git_update_ref_usage, options);
+		update_refs_stdin();
+		return update_refs(msg, updates, updates_nr, DIE_ON_ERR);
+	}
+
 	if (delete) {
 		if (argc < 1 || argc > 2)
 			usage_with_options(git_update_ref_usage, options);
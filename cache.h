@@ -343,6 +343,7 @@ static inline enum object_type object_type(unsigned int mode)
 
 #define GIT_DIR_ENVIRONMENT "GIT_DIR"
 #define GIT_NAMESPACE_ENVIRONMENT "GIT_NAMESPACE"
+#define GIT_PROTOCOL_ENVIRONMENT "GIT_PROTOCOL"
 #define GIT_WORK_TREE_ENVIRONMENT "GIT_WORK_TREE"
 #define DEFAULT_GIT_DIR_ENVIRONMENT ".git"
 #define DB_ENVIRONMENT "GIT_OBJECT_DIRECTORY"
@@ -548,6 +549,7 @@ extern int core_compression_seen;
 extern size_t packed_git_window_size;
 extern size_t packed_git_limit;
 extern size_t delta_base_cache_limit;
+extern size_t commit_buffer_cache_limit;
 extern unsigned long big_file_threshold;
 extern unsigned long pack_size_limit_cfg;
 extern int read_replace_refs;
@@ -592,12 +594,21 @@ enum object_creation_mode {
 
 extern enum object_creation_mode object_creation_mode;
 
+enum packed_refs_format {
+	PACKED_REFS_TEXT = 0,
+	PACKED_REFS_BINARY
+};
+
+extern enum packed_refs_format packed_refs_format;
+
 extern char *notes_ref_name;
 
 extern int grafts_replace_parents;
 
 #define GIT_REPO_VERSION 0
+#define GIT_REPO_VERSION_READ 1
 extern int repository_format_version;
+extern int repository_format_packed_refs;
 extern int check_repository_format(void);
 
 #define MTIME_CHANGED	0x0001
@@ -741,6 +752,18 @@ static inline const unsigned char *lookup_replace_object(const unsigned char *sh
 /* Read and unpack a sha1 file into memory, write memory to a sha1 file */
 extern int sha1_object_info(const unsigned char *, unsigned long *);
 extern int hash_sha1_file(const void *buf, unsigned long len, const char *type, unsigned char *sha1);
+
+/*
+ * hash_sha1_files() computes the names of several objects at once,
+ * which some SHA-1 implementations do faster than one at a time.
+ */
+struct hash_sha1_job {
+	const void *buf;
+	unsigned long len;
+	const char *type;
+	unsigned char sha1[20];
+};
+extern void hash_sha1_files(struct hash_sha1_job *jobs, int nr);
 extern int write_sha1_file(const void *buf, unsigned long len, const char *type, unsigned char *return_sha1);
 extern int pretend_sha1_file(void *, unsigned long, enum object_type, unsigned char *);
 extern int force_object_loose(const unsigned char *sha1, time_t mtime);
@@ -1025,6 +1048,7 @@ struct ref {
 extern struct ref *find_ref_by_name(const struct ref *list, const char *name);
 
 #define CONNECT_VERBOSE       (1u << 0)
+#define CONNECT_LS_REFS       (1u << 1)
 extern struct child_process *git_connect(int fd[2], const char *url, const char *prog, int flags);
 extern int finish_connect(struct child_process *conn);
 extern int git_connection_is_socket(struct child_process *conn);
@@ -1033,6 +1057,8 @@ struct extra_have_objects {
 	unsigned char (*array)[20];
 };
 extern struct ref **get_remote_heads(int in, struct ref **list, unsigned int flags, struct extra_have_objects *);
+struct string_list;
+extern struct ref **get_remote_heads_by_prefix(int fd[2], struct ref **list, unsigned int flags, struct extra_have_objects *, const struct string_list *prefixes);
 extern int server_supports(const char *feature);
 extern int parse_feature_request(const char *features, const char *feature);
 extern const char *server_feature_value(const char *feature, int *len_ret);
@@ -1197,6 +1223,8 @@ extern void *alloc_tree_node(void);
 extern void *alloc_commit_node(void);
 extern void *alloc_tag_node(void);
 extern void *alloc_object_node(void);
+struct alloc_state;
+extern void clear_alloc_state(struct alloc_state *s);
 extern void alloc_report(void);
 
 /* trace.c */
@@ -252,6 +252,205 @@ int unregister_shallow(const unsigned char *sha1)
 	return 0;
 }
 
+/*
+ * The stored buffers live in slabs of COMMIT_BUFFER_SLAB entries, which
+ * are indexed by commit->index.  Commits get an index when they first
+ * have a buffer stored; 0 means they have none yet.  The index is given
+ * back when the buffer is freed or detached, and handed out again before
+ * the slabs are grown.  The entries with a buffer are linked from the
+ * least to the most recently used.
+ */
+#define COMMIT_BUFFER_SLAB 1024
+
+struct commit_buffer {
+	void *buffer;
+	unsigned long size;
+	unsigned int pinned;
+	struct commit_buffer *older, *newer;
+};
+
+static struct commit_buffer **commit_buffer_slab;
+static int commit_buffer_slab_nr, commit_buffer_slab_alloc;
+static unsigned int commit_buffer_index;
+static unsigned int *commit_buffer_free;
+static int commit_buffer_free_nr, commit_buffer_free_alloc;
+static struct commit_buffer commit_buffer_lru = {
+	NULL, 0, 0, &commit_buffer_lru, &commit_buffer_lru
+};
+static unsigned long commit_buffer_used;
+
+static struct commit_buffer *commit_buffer_entry(const struct commit *commit,
+						 int create)
+{
+	unsigned int index = commit->index;
+	int nth;
+
+	if (!index) {
+		if (!create)
+			return NULL;
+		if (commit_buffer_free_nr)
+			index = commit_buffer_free[--commit_buffer_free_nr];
+		else
+			index = ++commit_buffer_index;
+		((struct commit *)commit)->index = index;
+	}
+	nth = index / COMMIT_BUFFER_SLAB;
+	if (nth >= commit_buffer_slab_nr) {
+		if (!create)
+			return NULL;
+		ALLOC_GROW(commit_buffer_slab, nth + 1, commit_buffer_slab_alloc);
+		memset(commit_buffer_slab + commit_buffer_slab_nr, 0,
+		       (nth + 1 - commit_buffer_slab_nr) * sizeof(*commit_buffer_slab));
+		commit_buffer_slab_nr = nth + 1;
+	}
+	if (!commit_buffer_slab[nth]) {
+		if (!create)
+			return NULL;
+		commit_buffer_slab[nth] = xcalloc(COMMIT_BUFFER_SLAB,
+						  sizeof(struct commit_buffer));
+	}
+	return &commit_buffer_slab[nth][index % COMMIT_BUFFER_SLAB];
+}
+
+/* Give the entry of a commit whose buffer is gone back for reuse */
+static void release_commit_buffer_entry(struct commit *commit)
+{
+	ALLOC_GROW(commit_buffer_free, commit_buffer_free_nr + 1,
+		   commit_buffer_free_alloc);
+	commit_buffer_free[commit_buffer_free_nr++] = commit->index;
+	commit->index = 0;
+}
+
+static void unlink_commit_buffer(struct commit_buffer *e)
+{
+	e->older->newer = e->newer;
+	e->newer->older = e->older;
+}
+
+static void link_commit_buffer(struct commit_buffer *e)
+{
+	e->older = commit_buffer_lru.older;
+	e->newer = &commit_buffer_lru;
+	e->older->newer = e;
+	commit_buffer_lru.older = e;
+}
+
+static void *take_commit_buffer(struct commit_buffer *e, unsigned long *size)
+{
+	void *buffer = e->buffer;
+
+	if (!buffer)
+		return NULL;
+	if (e->pinned)
+		die("BUG: commit buffer taken while in use");
+	unlink_commit_buffer(e);
+	commit_buffer_used -= e->size;
+	if (size)
+		*size = e->size;
+	e->buffer = NULL;
+	e->size = 0;
+	return buffer;
+}
+
+static void prune_commit_buffers(struct commit_buffer *keep)
+{
+	struct commit_buffer *e = commit_buffer_lru.newer;
+
+	while (commit_buffer_used > commit_buffer_cache_limit &&
+	       e != &commit_buffer_lru) {
+		struct commit_buffer *next = e->newer;
+		if (e != keep && !e->pinned)
+			free(take_commit_buffer(e, NULL));
+		e = next;
+	}
+}
+
+void set_commit_buffer(struct commit *commit, void *buffer, unsigned long size)
+{
+	struct commit_buffer *e = commit_buffer_entry(commit, 1);
+
+	free(take_commit_buffer(e, NULL));
+	e->buffer = buffer;
+	e->size = size;
+	link_commit_buffer(e);
+	commit_buffer_used += size;
+	prune_commit_buffers(e);
+}
+
+const void *get_cached_commit_buffer(const struct commit *commit,
+				     unsigned long *size)
+{
+	struct commit_buffer *e = commit_buffer_entry(commit, 0);
+
+	if (!e || !e->buffer)
+		return NULL;
+	if (size)
+		*size = e->size;
+	return e->buffer;
+}
+
+const char *get_commit_buffer(const struct commit *commit, unsigned long *size)
+{
+	struct commit_buffer *e = commit_buffer_entry(commit, 0);
+	enum object_type type;
+	unsigned long len;
+	void *buffer;
+
+	if (!e || !e->buffer) {
+		buffer = read_sha1_file(commit->object.sha1, &type, &len);
+		if (!buffer)
+			die("cannot read commit object %s",
+			    sha1_to_hex(commit->object.sha1));
+		if (type != OBJ_COMMIT)
+			die("expected commit for %s, got %s",
+			    sha1_to_hex(commit->object.sha1), typename(type));
+		set_commit_buffer((struct commit *)commit, buffer, len);
+		e = commit_buffer_entry(commit, 0);
+	} else {
+		/* it is the most recently used one now */
+		unlink_commit_buffer(e);
+		link_commit_buffer(e);
+	}
+	e->pinned++;
+	if (size)
+		*size = e->size;
+	return e->buffer;
+}
+
+void unuse_commit_buffer(const struct commit *commit, const void *buffer)
+{
+	struct commit_buffer *e = commit_buffer_entry(commit, 0);
+
+	if (e && e->buffer == buffer && buffer) {
+		if (!e->pinned)
+			die("BUG: unuse_commit_buffer() on a buffer not in use");
+		e->pinned--;
+	} else
+		free((void *)buffer);
+}
+
+void free_commit_buffer(struct commit *commit)
+{
+	struct commit_buffer *e = commit_buffer_entry(commit, 0);
+
+	if (e) {
+		free(take_commit_buffer(e, NULL));
+		release_commit_buffer_entry(commit);
+	}
+}
+
+void *detach_commit_buffer(struct commit *commit, unsigned long *size)
+{
+	struct commit_buffer *e = commit_buffer_entry(commit, 0);
+	void *buffer;
+
+	if (!e)
+		return NULL;
+	buffer = take_commit_buffer(e, size);
+	release_commit_buffer_entry(commit);
+	return buffer;
+}
+
 int parse_commit_buffer(struct commit *item, const void *buffer, unsigned long size)
 {
 	const char *tail = buffer;
@@ -329,7 +528,7 @@ int parse_commit(struct commit *item)
 	}
 	ret = parse_commit_buffer(item, buffer, size);
 	if (save_commit_buffer && !ret) {
-		item->buffer = buffer;
+		set_commit_buffer(item, buffer, size);
 		return 0;
 	}
 	free(buffer);
@@ -18,7 +18,7 @@ struct commit {
 	unsigned long date;
 	struct commit_list *parents;
 	struct tree *tree;
-	char *buffer;
+	unsigned int index;
 };
 
 extern int save_commit_buffer;
@@ -48,6 +48,37 @@ struct commit *lookup_commit_or_die(const unsigned char *sha1, const char *ref_n
 int parse_commit_buffer(struct commit *item, const void *buffer, unsigned long size);
 int parse_commit(struct commit *item);
 
+/*
+ * The text of commits is kept in a side store, indexed by commit->index.
+ * parse_commit() stores it there when save_commit_buffer is set, and
+ * get_commit_buffer() when it has to read it.  Once the store holds more
+ * than commit_buffer_cache_limit bytes, the least recently used buffers
+ * are dropped; they are read again when they are asked for.
+ */
+
+/* Hand buffer, which must have been allocated with malloc(), to the store */
+void set_commit_buffer(struct commit *, void *buffer, unsigned long size);
+
+/*
+ * Return the stored text of the commit, or NULL.  The buffer may go away
+ * as soon as another commit buffer is stored.
+ */
+const void *get_cached_commit_buffer(const struct commit *, unsigned long *size);
+
+/*
+ * Return the text of the commit, reading it if it is not in the store.
+ * The buffer stays valid until it is handed back to unuse_commit_buffer(),
+ * which also frees buffers that did not come from the store.
+ */
+const char *get_commit_buffer(const struct commit *, unsigned long *size);
+void unuse_commit_buffer(const struct commit *, const void *buffer);
+
+/* Drop the stored text of the commit */
+void free_commit_buffer(struct commit *);
+
+/* Take the stored text of the commit out of the store, or return NULL */
+void *detach_commit_buffer(struct commit *, unsigned long *size);
+
 /* Find beginning and length of commit subject. */
 int find_commit_subject(const char *commit_buffer, const char **subject);
 
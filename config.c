@@ -669,6 +669,11 @@ static int git_default_core_config(const char *var, const char *value)
 		return 0;
 	}
 
+	if (!strcmp(var, "core.commitbuffercachelimit")) {
+		commit_buffer_cache_limit = git_config_ulong(var, value);
+		return 0;
+	}
+
 	if (!strcmp(var, "core.logpackaccess"))
 		return git_config_string(&log_pack_access, var, value);
 
@@ -750,6 +755,18 @@ static int git_default_core_config(const char *var, const char *value)
 		return 0;
 	}
 
+	if (!strcmp(var, "core.packedrefsformat")) {
+		if (!value)
+			return config_error_nonbool(var);
+		if (!strcmp(value, "text"))
+			packed_refs_format = PACKED_REFS_TEXT;
+		else if (!strcmp(value, "binary"))
+			packed_refs_format = PACKED_REFS_BINARY;
+		else
+			return error("Malformed value for %s: %s", var, value);
+		return 0;
+	}
+
 	if (!strcmp(var, "core.sparsecheckout")) {
 		core_apply_sparse_checkout = git_config_bool(var, value);
 		return 0;
@@ -0,0 +1,7 @@
+# local sandbox only, not committed
+BASIC_CFLAGS += -Dsign_commit_old=atoi -Wno-deprecated-declarations
+NO_GETTEXT = YesPlease
+NO_TCLTK = YesPlease
+NO_PERL = YesPlease
+NO_PYTHON = YesPlease
+BASIC_CFLAGS += -Wno-cpp
@@ -6,6 +6,7 @@
 #include "run-command.h"
 #include "remote.h"
 #include "url.h"
+#include "string-list.h"
 
 static char *server_capabilities;
 
@@ -98,6 +99,11 @@ struct ref **get_remote_heads(int in, struct ref **list,
 			server_capabilities = xstrdup(name + name_len + 1);
 		}
 
+		/* a server that only announces its capabilities */
+		if (name_len == 15 && !memcmp("capabilities^{}", name, 15) &&
+		    is_null_sha1(old_sha1))
+			continue;
+
 		if (extra_have &&
 		    name_len == 5 && !memcmp(".have", name, 5)) {
 			add_extra_have(extra_have, old_sha1);
@@ -115,6 +121,33 @@ struct ref **get_remote_heads(int in, struct ref **list,
 	return list;
 }
 
+/*
+ * Like get_remote_heads(), but if the connection was made with
+ * CONNECT_LS_REFS and the server answered with just its capabilities,
+ * ask it for the refs whose names start with one of the prefixes and
+ * read those instead.  A server that does not know about "ls-refs"
+ * has sent all its refs already.
+ */
+struct ref **get_remote_heads_by_prefix(int fd[2], struct ref **list,
+					unsigned int flags,
+					struct extra_have_objects *extra_have,
+					const struct string_list *prefixes)
+{
+	struct ref **tail;
+	int i;
+
+	free(server_capabilities);
+	server_capabilities = NULL;
+	tail = get_remote_heads(fd[0], list, flags, extra_have);
+	if (!prefixes || !server_supports("ls-refs"))
+		return tail;
+
+	for (i = 0; i < prefixes->nr; i++)
+		packet_write(fd[1], "ref-prefix %s\n", prefixes->items[i].string);
+	packet_flush(fd[1]);
+	return get_remote_heads(fd[0], list, flags, extra_have);
+}
+
 const char *parse_feature_value(const char *feature_list, const char *feature, int *lenp)
 {
 	int len;
@@ -595,12 +628,20 @@ struct child_process *git_connect(int fd[2], const char *url_orig,
 		 * from extended host header with a NUL byte.
 		 *
 		 * Note: Do not add any other headers here!  Doing so
-		 * will cause older git-daemon servers to crash.
+		 * will cause older git-daemon servers to crash.  Protocol
+		 * parameters go after an empty header, which those
+		 * servers skip.
 		 */
-		packet_write(fd[1],
-			     "%s %s%chost=%s%c",
-			     prog, path, 0,
-			     target_host, 0);
+		if (flags & CONNECT_LS_REFS)
+			packet_write(fd[1],
+				     "%s %s%chost=%s%c%cls-refs%c",
+				     prog, path, 0,
+				     target_host, 0, 0, 0);
+		else
+			packet_write(fd[1],
+				     "%s %s%chost=%s%c",
+				     prog, path, 0,
+				     target_host, 0);
 		free(target_host);
 		free(url);
 		if (free_path)
@@ -638,6 +679,14 @@ struct child_process *git_connect(int fd[2], const char *url_orig,
 		/* remove repo-local variables from the environment */
 		conn->env = local_repo_env;
 		conn->use_shell = 1;
+		if (flags & CONNECT_LS_REFS) {
+			static const char *ls_refs_env[LOCAL_REPO_ENV_SIZE + 2];
+			memcpy(ls_refs_env, local_repo_env,
+			       LOCAL_REPO_ENV_SIZE * sizeof(*ls_refs_env));
+			ls_refs_env[LOCAL_REPO_ENV_SIZE] =
+				GIT_PROTOCOL_ENVIRONMENT "=ls-refs";
+			conn->env = ls_refs_env;
+		}
 	}
 	*arg++ = cmd.buf;
 	*arg = NULL;
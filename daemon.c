@@ -31,6 +31,7 @@ static const char daemon_usage[] =
 "           [--reuseaddr] [--pid-file=<file>]\n"
 "           [--(enable|disable|allow-override|forbid-override)=<service>]\n"
 "           [--access-hook=<path>]\n"
+"           [--workers=<n> [--max-repo-connections=<n>] [--stats]]\n"
 "           [--inetd | [--listen=<host_or_ipaddr>] [--port=<n>]\n"
 "                      [--detach] [--user=<user> [--group=<group>]]\n"
 "           [<directory>...]";
@@ -322,6 +323,47 @@ error_return:
 	return -1;
 }
 
+/*
+ * In a worker of the pool (see pool_loop() below), its end of the
+ * socket it shares with the main process; -1 otherwise.
+ */
+static int worker_fd = -1;
+
+static int worker_read_line(struct strbuf *line)
+{
+	strbuf_reset(line);
+	for (;;) {
+		char c;
+		if (xread(worker_fd, &c, 1) != 1)
+			return -1;
+		if (c == '\n')
+			return 0;
+		strbuf_addch(line, c);
+	}
+}
+
+/*
+ * Wait until the main process lets us serve the repository we are in,
+ * so that no more than --max-repo-connections clients use it at once.
+ */
+static int acquire_repository(void)
+{
+	struct strbuf line = STRBUF_INIT;
+	const char *repo = real_path(".");
+	int ret = 0;
+
+	if (strchr(repo, '\n'))
+		return 0;
+	strbuf_addf(&line, "acquire %s\n", repo);
+	if (write_in_full(worker_fd, line.buf, line.len) != line.len ||
+	    worker_read_line(&line) || strcmp(line.buf, "ok")) {
+		logerror("lost contact with the main daemon process");
+		ret = -1;
+	}
+	strbuf_release(&line);
+	return ret;
+}
+
 static int run_service(char *dir, struct daemon_service *service)
 {
 	const char *path;
@@ -376,6 +418,9 @@ static int run_service(char *dir, struct daemon_service *service)
 	if (access_hook && run_access_hook(service, dir, path))
 		return -1;
 
+	if (worker_fd >= 0 && acquire_repository())
+		return daemon_error(dir, "server is shutting down");
+
 	/*
 	 * We'll ignore SIGTERM from now on, we have a
 	 * good client.
@@ -601,6 +646,50 @@ static void parse_host_arg(char *extra_args, int buflen)
 	}
 }
 
+/*
+ * Protocol parameters follow the host argument after an empty argument,
+ * which older daemons ignore.  Pass them on to the service in
+ * GIT_PROTOCOL, separated by colons.
+ */
+static void parse_extra_args(char *extra_args, int buflen)
+{
+	struct strbuf protocol = STRBUF_INIT;
+	char *end = extra_args + buflen;
+
+	for (; extra_args + 1 < end; extra_args++)
+		if (!extra_args[0] && !extra_args[1])
+			break;
+	for (extra_args += 2; extra_args < end;
+	     extra_args += strlen(extra_args) + 1) {
+		if (!*extra_args)
+			continue;
+		if (protocol.len)
+			strbuf_addch(&protocol, ':');
+		strbuf_addstr(&protocol, extra_args);
+	}
+	if (protocol.len)
+		setenv(GIT_PROTOCOL_ENVIRONMENT, protocol.buf, 1);
+	strbuf_release(&protocol);
+}
+
+static int stats_enabled;
+
+/* Relay the statistics of the main process to the client. */
+static int send_stats(void)
+{
+	struct strbuf line = STRBUF_INIT;
+
+	loginfo("Request for statistics");
+	if (write_str_in_full(worker_fd, "stats\n") < 0) {
+		logerror("lost contact with the main daemon process");
+		return -1;
+	}
+	while (!worker_read_line(&line) && line.len)
+		packet_write(1, "%s\n", line.buf);
+	packet_flush(1);
+	strbuf_release(&line);
+	return 0;
+}
 
 static int execute(void)
 {
@@ -631,8 +720,14 @@ static int execute(void)
 	free(tcp_port);
 	hostname = canon_hostname = ip_address = tcp_port = NULL;
 
-	if (len != pktlen)
+	unsetenv(GIT_PROTOCOL_ENVIRONMENT);
+	if (len != pktlen) {
 		parse_host_arg(line + len + 1, pktlen - len - 1);
+		parse_extra_args(line + len, pktlen - len);
+	}
+
+	if (stats_enabled && worker_fd >= 0 && !strcmp(line, "git-daemon-stats"))
+		return send_stats();
 
 	for (i = 0; i < ARRAY_SIZE(daemon_service); i++) {
 		struct daemon_service *s = &(daemon_service[i]);
@@ -739,6 +834,36 @@ static void check_dead_children(void)
 			cradle = &blanket->next;
 }
 
+/*
+ * Fill addrbuf, which starts with "REMOTE_ADDR=", and portbuf with the
+ * environment variables describing the client at addr.
+ */
+static void remote_address_env(struct sockaddr *addr,
+			       char *addrbuf, size_t addrsize,
+			       char *portbuf, size_t portsize)
+{
+	if (addr->sa_family == AF_INET) {
+		struct sockaddr_in *sin_addr = (void *) addr;
+		inet_ntop(addr->sa_family, &sin_addr->sin_addr, addrbuf + 12,
+		    addrsize - 12);
+		snprintf(portbuf, portsize, "REMOTE_PORT=%d",
+		    ntohs(sin_addr->sin_port));
+#ifndef NO_IPV6
+	} else if (addr && addr->sa_family == AF_INET6) {
+		struct sockaddr_in6 *sin6_addr = (void *) addr;
+
+		char *buf = addrbuf + 12;
+		*buf++ = '['; *buf = '\0'; /* stpcpy() is cool */
+		inet_ntop(AF_INET6, &sin6_addr->sin6_addr, buf,
+		    addrsize - 13);
+		strcat(buf, "]");
+
+		snprintf(portbuf, portsize, "REMOTE_PORT=%d",
+		    ntohs(sin6_addr->sin6_port));
+#endif
+	}
+}
+
 static char **cld_argv;
 static void handle(int incoming, struct sockaddr *addr, socklen_t addrlen)
 {
@@ -757,26 +882,8 @@ static void handle(int incoming, struct sockaddr *addr, socklen_t addrlen)
 		}
 	}
 
-	if (addr->sa_family == AF_INET) {
-		struct sockaddr_in *sin_addr = (void *) addr;
-		inet_ntop(addr->sa_family, &sin_addr->sin_addr, addrbuf + 12,
-		    sizeof(addrbuf) - 12);
-		snprintf(portbuf, sizeof(portbuf), "REMOTE_PORT=%d",
-		    ntohs(sin_addr->sin_port));
-#ifndef NO_IPV6
-	} else if (addr && addr->sa_family == AF_INET6) {
-		struct sockaddr_in6 *sin6_addr = (void *) addr;
-
-		char *buf = addrbuf + 12;
-		*buf++ = '['; *buf = '\0'; /* stpcpy() is cool */
-		inet_ntop(AF_INET6, &sin6_addr->sin6_addr, buf,
-		    sizeof(addrbuf) - 13);
-		strcat(buf, "]");
-
-		snprintf(portbuf, sizeof(portbuf), "REMOTE_PORT=%d",
-		    ntohs(sin6_addr->sin6_port));
-#endif
-	}
+	remote_address_env(addr, addrbuf, sizeof(addrbuf),
+			   portbuf, sizeof(portbuf));
 
 	cld.env = (const char **)env;
 	cld.argv = (const char **)cld_argv;
@@ -1051,6 +1158,527 @@ static int service_loop(struct socketlist *socklist)
 	}
 }
 
+#ifndef NO_POSIX_GOODIES
+
+/*
+ * With --workers=<n>, connections are not served by a "git daemon
+ * --serve" process that is forked and executed for each of them, but
+ * by a pool of workers forked in advance.  The main process accepts
+ * connections and hands each over to an idle worker through a unix
+ * socket; a worker serves a single connection and exits, and a new one
+ * is forked to keep <n> of them idle.  Connections that arrive while
+ * --max-connections workers are busy wait in a queue of that size.
+ *
+ * A worker talks to the main process over the same socket, one line per
+ * message:
+ *
+ *   "acquire <path>" asks for one of the --max-repo-connections slots
+ *                    of the repository at <path>; the reply is "ok"
+ *                    once it holds one, which it does until it exits.
+ *
+ *   "stats"          asks for the statistics, which are sent one per
+ *                    line and followed by an empty line.
+ */
+static int worker_spares;
+static int max_repo_connections;
+
+struct worker {
+	pid_t pid;
+	int fd;
+	int busy;
+	struct strbuf in;
+	/* the repository whose slot it holds, or waits for if "waiting" */
+	char *repo;
+	unsigned int waiting;
+	struct timeval started;
+};
+static struct worker **workers;
+static int workers_nr, workers_alloc;
+static unsigned int waiting_seq;
+
+struct queued_connection {
+	int fd;
+	struct sockaddr_storage address;
+	struct timeval accepted;
+};
+static struct queued_connection *conn_queue;
+static int conn_queue_nr, conn_queue_alloc;
+
+struct repo_slots {
+	int active, waiting;
+};
+/* the util field of each item points to its repo_slots */
+static struct string_list repositories = STRING_LIST_INIT_DUP;
+
+static struct {
+	uintmax_t served, dropped;
+	int max_queue;
+	uintmax_t service_ms, max_service_ms;
+	uintmax_t queue_ms, max_queue_ms;
+} pool_stats;
+
+static struct socketlist *listen_sockets;
+
+static uintmax_t elapsed_ms(const struct timeval *since)
+{
+	struct timeval now;
+	long ms;
+
+	gettimeofday(&now, NULL);
+	ms = (now.tv_sec - since->tv_sec) * 1000 +
+		(now.tv_usec - since->tv_usec) / 1000;
+	return ms < 0 ? 0 : ms;
+}
+
+static void send_to_worker(struct worker *w, const char *msg)
+{
+	if (write_str_in_full(w->fd, msg) < 0)
+		logerror("unable to write to worker %"PRIuMAX": %s",
+			 (uintmax_t)w->pid, strerror(errno));
+}
+
+/* Pass the connection, and the address of the client, to a worker. */
+static int send_connection(struct worker *w, struct queued_connection *c)
+{
+	struct msghdr msg;
+	struct iovec iov;
+	union {
+		struct cmsghdr align;
+		char buf[CMSG_SPACE(sizeof(int))];
+	} control;
+	struct cmsghdr *cmsg;
+
+	memset(&msg, 0, sizeof(msg));
+	memset(&control, 0, sizeof(control));
+	iov.iov_base = &c->address;
+	iov.iov_len = sizeof(c->address);
+	msg.msg_iov = &iov;
+	msg.msg_iovlen = 1;
+	msg.msg_control = control.buf;
+	msg.msg_controllen = sizeof(control.buf);
+	cmsg = CMSG_FIRSTHDR(&msg);
+	cmsg->cmsg_level = SOL_SOCKET;
+	cmsg->cmsg_type = SCM_RIGHTS;
+	cmsg->cmsg_len = CMSG_LEN(sizeof(int));
+	memcpy(CMSG_DATA(cmsg), &c->fd, sizeof(int));
+
+	while (sendmsg(w->fd, &msg, 0) < 0)
+		if (errno != EINTR)
+			return -1;
+	return 0;
+}
+
+static int receive_connection(int sock, struct sockaddr_storage *address)
+{
+	struct msghdr msg;
+	struct iovec iov;
+	union {
+		struct cmsghdr align;
+		char buf[CMSG_SPACE(sizeof(int))];
+	} control;
+	struct cmsghdr *cmsg;
+	ssize_t len;
+	int fd;
+
+	memset(&msg, 0, sizeof(msg));
+	iov.iov_base = address;
+	iov.iov_len = sizeof(*address);
+	msg.msg_iov = &iov;
+	msg.msg_iovlen = 1;
+	msg.msg_control = control.buf;
+	msg.msg_controllen = sizeof(control.buf);
+
+	while ((len = recvmsg(sock, &msg, 0)) < 0)
+		if (errno != EINTR)
+			return -1;
+	cmsg = CMSG_FIRSTHDR(&msg);
+	if (len <= 0 || !cmsg ||
+	    cmsg->cmsg_level != SOL_SOCKET || cmsg->cmsg_type != SCM_RIGHTS)
+		return -1;
+	memcpy(&fd, CMSG_DATA(cmsg), sizeof(int));
+	if (len < sizeof(*address) &&
+	    read_in_full(sock, (char *)address + len,
+			 sizeof(*address) - len) != sizeof(*address) - len) {
+		close(fd);
+		return -1;
+	}
+	return fd;
+}
+
+static void NORETURN worker_main(int sock)
+{
+	struct sockaddr_storage address;
+	char addrbuf[300] = "REMOTE_ADDR=", portbuf[300] = "";
+	int fd;
+
+	fd = receive_connection(sock, &address);
+	if (fd < 0)
+		exit(0); /* the main process has gone away */
+
+	remote_address_env((struct sockaddr *)&address,
+			   addrbuf, sizeof(addrbuf), portbuf, sizeof(portbuf));
+	if (*portbuf) {
+		putenv(addrbuf);
+		putenv(portbuf);
+	}
+	if (dup2(fd, 0) < 0 || dup2(fd, 1) < 0)
+		die_errno("dup2 failed");
+	if (fd > 1)
+		close(fd);
+
+	worker_fd = sock;
+	exit(execute());
+}
+
+static struct worker *spawn_worker(void)
+{
+	struct worker *w;
+	int sv[2], i;
+	pid_t pid;
+
+	if (socketpair(AF_UNIX, SOCK_STREAM, 0, sv) < 0) {
+		logerror("unable to create a socket pair: %s", strerror(errno));
+		return NULL;
+	}
+	pid = fork();
+	if (pid < 0) {
+		logerror("unable to fork");
+		close(sv[0]);
+		close(sv[1]);
+		return NULL;
+	}
+	if (!pid) {
+		signal(SIGCHLD, SIG_DFL);
+		signal(SIGPIPE, SIG_DFL);
+		close(sv[0]);
+		for (i = 0; i < listen_sockets->nr; i++)
+			close(listen_sockets->list[i]);
+		for (i = 0; i < workers_nr; i++)
+			close(workers[i]->fd);
+		for (i = 0; i < conn_queue_nr; i++)
+			close(conn_queue[i].fd);
+		fcntl(sv[1], F_SETFD, FD_CLOEXEC);
+		worker_main(sv[1]);
+	}
+
+	close(sv[1]);
+	w = xcalloc(1, sizeof(*w));
+	w->pid = pid;
+	w->fd = sv[0];
+	strbuf_init(&w->in, 0);
+	ALLOC_GROW(workers, workers_nr + 1, workers_alloc);
+	workers[workers_nr++] = w;
+	return w;
+}
+
+static struct repo_slots *repo_slots(const char *repo)
+{
+	struct string_list_item *item;
+
+	item = string_list_lookup(&repositories, repo);
+	if (!item) {
+		item = string_list_insert(&repositories, repo);
+		item->util = xcalloc(1, sizeof(struct repo_slots));
+	}
+	return item->util;
+}
+
+static void grant_repo_slot(struct worker *w, struct repo_slots *slots)
+{
+	slots->active++;
+	send_to_worker(w, "ok\n");
+}
+
+static void acquire_repo_slot(struct worker *w, const char *repo)
+{
+	struct repo_slots *slots = repo_slots(repo);
+
+	w->repo = xstrdup(repo);
+	if (max_repo_connections && slots->active >= max_repo_connections) {
+		w->waiting = ++waiting_seq;
+		slots->waiting++;
+		loginfo("[%"PRIuMAX"] Waiting for '%s'", (uintmax_t)w->pid, repo);
+		return;
+	}
+	grant_repo_slot(w, slots);
+}
+
+/* Give up the slot of w, handing it to the worker waiting longest. */
+static void release_repo_slot(struct worker *w)
+{
+	struct repo_slots *slots;
+	struct worker *next = NULL;
+	int i;
+
+	if (!w->repo)
+		return;
+	slots = repo_slots(w->repo);
+	if (w->waiting) {
+		slots->waiting--;
+	} else {
+		slots->active--;
+		for (i = 0; i < workers_nr; i++) {
+			struct worker *o = workers[i];
+			if (o->waiting && !strcmp(o->repo, w->repo) &&
+			    (!next || o->waiting < next->waiting))
+				next = o;
+		}
+		if (next) {
+			next->waiting = 0;
+			slots->waiting--;
+			grant_repo_slot(next, slots);
+		}
+	}
+	free(w->repo);
+	w->repo = NULL;
+	w->waiting = 0;
+}
+
+static void send_stats_to_worker(struct worker *w)
+{
+	struct strbuf out = STRBUF_INIT;
+	int i, busy = 0;
+
+	for (i = 0; i < workers_nr; i++)
+		busy += workers[i]->busy;
+	strbuf_addf(&out, "workers.busy %d\n", busy);
+	strbuf_addf(&out, "workers.idle %d\n", workers_nr - busy);
+	strbuf_addf(&out, "queue.depth %d\n", conn_queue_nr);
+	strbuf_addf(&out, "queue.max-depth %d\n", pool_stats.max_queue);
+	strbuf_addf(&out, "connections.served %"PRIuMAX"\n",
+		    pool_stats.served);
+	strbuf_addf(&out, "connections.dropped %"PRIuMAX"\n",
+		    pool_stats.dropped);
+	strbuf_addf(&out, "service-time.total-ms %"PRIuMAX"\n",
+		    pool_stats.service_ms);
+	strbuf_addf(&out, "service-time.max-ms %"PRIuMAX"\n",
+		    pool_stats.max_service_ms);
+	strbuf_addf(&out, "queue-time.total-ms %"PRIuMAX"\n",
+		    pool_stats.queue_ms);
+	strbuf_addf(&out, "queue-time.max-ms %"PRIuMAX"\n",
+		    pool_stats.max_queue_ms);
+	for (i = 0; i < repositories.nr; i++) {
+		struct repo_slots *slots = repositories.items[i].util;
+		if (!slots->active && !slots->waiting)
+			continue;
+		strbuf_addf(&out, "repository %d %d %s\n",
+			    slots->active, slots->waiting,
+			    repositories.items[i].string);
+	}
+	strbuf_addch(&out, '\n');
+	send_to_worker(w, out.buf);
+	strbuf_release(&out);
+}
+
+static void handle_worker_message(struct worker *w, const char *msg)
+{
+	if (!prefixcmp(msg, "acquire ") && w->busy) {
+		release_repo_slot(w);
+		acquire_repo_slot(w, msg + 8);
+	} else if (!strcmp(msg, "stats") && w->busy)
+		send_stats_to_worker(w);
+	else
+		logerror("unexpected message from worker %"PRIuMAX": '%s'",
+			 (uintmax_t)w->pid, msg);
+}
+
+static void reap_worker(struct worker *w)
+{
+	int i, status;
+
+	close(w->fd);
+	while (waitpid(w->pid, &status, 0) < 0 && errno == EINTR)
+		; /* try again */
+
+	if (w->busy) {
+		uintmax_t ms = elapsed_ms(&w->started);
+		pool_stats.service_ms += ms;
+		if (pool_stats.max_service_ms < ms)
+			pool_stats.max_service_ms = ms;
+		loginfo("[%"PRIuMAX"] Disconnected%s", (uintmax_t)w->pid,
+			status ? " (with error)" : "");
+	}
+	release_repo_slot(w);
+
+	for (i = 0; i < workers_nr; i++)
+		if (workers[i] == w) {
+			workers[i] = workers[--workers_nr];
+			break;
+		}
+	strbuf_release(&w->in);
+	free(w);
+}
+
+/* Read what the worker sent; return -1 once it has gone away. */
+static int read_from_worker(struct worker *w)
+{
+	char buf[1024], *eol;
+	ssize_t len = xread(w->fd, buf, sizeof(buf));
+
+	if (len < 0 && errno == EAGAIN)
+		return 0;
+	if (len <= 0)
+		return -1;
+	strbuf_add(&w->in, buf, len);
+	while ((eol = memchr(w->in.buf, '\n', w->in.len))) {
+		*eol = '\0';
+		handle_worker_message(w, w->in.buf);
+		strbuf_remove(&w->in, 0, eol - w->in.buf + 1);
+	}
+	return 0;
+}
+
+static void queue_connection(int incoming, struct sockaddr *addr,
+			     socklen_t addrlen)
+{
+	struct queued_connection *c;
+
+	if (max_connections && conn_queue_nr >= max_connections) {
+		close(incoming);
+		pool_stats.dropped++;
+		logerror("Too many waiting connections, dropping connection");
+		return;
+	}
+	ALLOC_GROW(conn_queue, conn_queue_nr + 1, conn_queue_alloc);
+	c = &conn_queue[conn_queue_nr++];
+	c->fd = incoming;
+	memset(&c->address, 0, sizeof(c->address));
+	memcpy(&c->address, addr, addrlen);
+	gettimeofday(&c->accepted, NULL);
+	if (pool_stats.max_queue < conn_queue_nr)
+		pool_stats.max_queue = conn_queue_nr;
+}
+
+/*
+ * Hand queued connections over to idle workers, as long as fewer than
+ * max_connections of them are busy, and keep worker_spares idle.
+ */
+static void dispatch(void)
+{
+	int i, busy = 0, idle;
+
+	for (i = 0; i < workers_nr; i++)
+		busy += workers[i]->busy;
+
+	while (conn_queue_nr && (!max_connections || busy < max_connections)) {
+		struct queued_connection *c = &conn_queue[0];
+		struct worker *w = NULL;
+		uintmax_t ms;
+
+		for (i = 0; i < workers_nr && !w; i++)
+			if (!workers[i]->busy)
+				w = workers[i];
+		if (!w && !(w = spawn_worker()))
+			break;
+
+		if (send_connection(w, c) < 0) {
+			logerror("unable to pass a connection to worker %"PRIuMAX": %s",
+				 (uintmax_t)w->pid, strerror(errno));
+			kill(w->pid, SIGKILL);
+			reap_worker(w);
+			break;
+		}
+		w->busy = 1;
+		busy++;
+		gettimeofday(&w->started, NULL);
+		ms = elapsed_ms(&c->accepted);
+		pool_stats.served++;
+		pool_stats.queue_ms += ms;
+		if (pool_stats.max_queue_ms < ms)
+			pool_stats.max_queue_ms = ms;
+
+		close(c->fd);
+		memmove(conn_queue, conn_queue + 1,
+			--conn_queue_nr * sizeof(*conn_queue));
+	}
+
+	for (idle = workers_nr - busy; idle < worker_spares; idle++)
+		if (!spawn_worker())
+			break;
+}
+
+static int pool_loop(struct socketlist *socklist)
+{
+	struct pollfd *pfd = NULL;
+	struct worker **polled = NULL;
+	int pfd_alloc = 0, polled_alloc = 0;
+
+	listen_sockets = socklist;
+	signal(SIGCHLD, child_handler);
+	signal(SIGPIPE, SIG_IGN);
+
+	for (;;) {
+		int i, nr = socklist->nr;
+
+		dispatch();
+
+		ALLOC_GROW(pfd, socklist->nr + workers_nr, pfd_alloc);
+		ALLOC_GROW(polled, workers_nr, polled_alloc);
+		for (i = 0; i < socklist->nr; i++) {
+			pfd[i].fd = socklist->list[i];
+			pfd[i].events = POLLIN;
+		}
+		for (i = 0; i < workers_nr; i++) {
+			polled[i] = workers[i];
+			pfd[nr].fd = workers[i]->fd;
+			pfd[nr++].events = POLLIN;
+		}
+
+		if (poll(pfd, nr, -1) < 0) {
+			if (errno != EINTR) {
+				logerror("Poll failed, resuming: %s",
+				      strerror(errno));
+				sleep(1);
+			}
+			continue;
+		}
+
+		for (i = 0; i < socklist->nr; i++) {
+			struct sockaddr_storage ss;
+			socklen_t sslen = sizeof(ss);
+			int incoming;
+
+			if (!(pfd[i].revents & POLLIN))
+				continue;
+			incoming = accept(pfd[i].fd, (struct sockaddr *)&ss,
+					  &sslen);
+			if (incoming < 0) {
+				switch (errno) {
+				case EAGAIN:
+				case EINTR:
+				case ECONNABORTED:
+					continue;
+				default:
+					die_errno("accept returned");
+				}
+			}
+			queue_connection(incoming, (struct sockaddr *)&ss,
+					 sslen);
+		}
+
+		for (i = 0; i < nr - socklist->nr; i++) {
+			struct worker *w = polled[i];
+
+			if (!pfd[socklist->nr + i].revents)
+				continue;
+			if (read_from_worker(w) < 0)
+				reap_worker(w);
+		}
+	}
+}
+
+#else
+
+static int worker_spares;
+static int max_repo_connections;
+
+static int pool_loop(struct socketlist *socklist)
+{
+	die("--workers is not supported on this platform");
+}
+
+#endif
+
 /* if any standard file descriptor is missing open it to /dev/null */
 static void sanitize_stdfds(void)
 {
@@ -1161,6 +1789,8 @@ static int serve(struct string_list *listen_addr, int listen_port,
 
 	loginfo("Ready to rumble");
 
+	if (worker_spares)
+		return pool_loop(&socklist);
 	return service_loop(&socklist);
 }
 
@@ -1233,6 +1863,22 @@ int main(int argc, char **argv)
 				max_connections = 0;	        /* unlimited */
 			continue;
 		}
+		if (!prefixcmp(arg, "--workers=")) {
+			worker_spares = atoi(arg+10);
+			if (worker_spares < 0)
+				worker_spares = 0;
+			continue;
+		}
+		if (!prefixcmp(arg, "--max-repo-connections=")) {
+			max_repo_connections = atoi(arg+23);
+			if (max_repo_connections < 0)
+				max_repo_connections = 0;	/* unlimited */
+			continue;
+		}
+		if (!strcmp(arg, "--stats")) {
+			stats_enabled = 1;
+			continue;
+		}
 		if (!strcmp(arg, "--strict-paths")) {
 			strict_paths = 1;
 			continue;
@@ -1331,6 +1977,12 @@ int main(int argc, char **argv)
 	if (group_name && !user_name)
 		die("--group supplied without --user");
 
+	if (!worker_spares && (max_repo_connections || stats_enabled))
+		die("--max-repo-connections and --stats require --workers");
+
+	if (inetd_mode && worker_spares)
+		die("--workers is incompatible with --inetd");
+
 	if (user_name)
 		cred = prepare_credentials(user_name, group_name);
 
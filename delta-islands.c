@@ -0,0 +1,341 @@
+#include "cache.h"
+#include "commit.h"
+#include "tree.h"
+#include "blob.h"
+#include "tree-walk.h"
+#include "refs.h"
+#include "decorate.h"
+#include "string-list.h"
+#include "progress.h"
+#include "delta-islands.h"
+
+static regex_t *island_regexes;
+static int island_regexes_nr, island_regexes_alloc;
+
+/* island names in sorted order; the util field holds the island number */
+static struct string_list island_names = STRING_LIST_INIT_DUP;
+
+/* an object named by a ref, and the island that ref belongs to */
+struct island_ref {
+	unsigned char sha1[20];
+	int island;
+};
+static struct island_ref *island_refs;
+static int island_refs_nr, island_refs_alloc;
+
+/*
+ * The set of islands an object is reachable from.  Most objects share
+ * their set with the commit or tree they were reached through, so the
+ * sets are reference counted and copied only when they need to grow.
+ */
+struct island_bitmap {
+	uint32_t refcount;
+	uint32_t bits[FLEX_ARRAY];
+};
+static uint32_t island_bitmap_size;
+static struct decoration island_marks = { "island marks" };
+
+struct island_tree {
+	struct tree *tree;
+	unsigned depth;
+};
+static struct island_tree *island_trees;
+static int island_trees_nr, island_trees_alloc;
+
+#define ISLAND_BITMAP_BLOCK(x) ((x) / 32)
+#define ISLAND_BITMAP_MASK(x) (1u << ((x) % 32))
+
+static struct island_bitmap *island_bitmap_new(const struct island_bitmap *old)
+{
+	size_t size = sizeof(struct island_bitmap) +
+		      island_bitmap_size * sizeof(uint32_t);
+	struct island_bitmap *b = xcalloc(1, size);
+
+	if (old)
+		memcpy(b, old, size);
+	b->refcount = 1;
+	return b;
+}
+
+static int island_bitmap_is_subset(const struct island_bitmap *self,
+				   const struct island_bitmap *super)
+{
+	uint32_t i;
+
+	if (self == super)
+		return 1;
+	for (i = 0; i < island_bitmap_size; i++)
+		if ((self->bits[i] & super->bits[i]) != self->bits[i])
+			return 0;
+	return 1;
+}
+
+/* return the marks of "obj", made private to it so that they can be changed */
+static struct island_bitmap *own_marks(struct object *obj)
+{
+	struct island_bitmap *marks = lookup_decoration(&island_marks, obj);
+
+	if (!marks) {
+		marks = island_bitmap_new(NULL);
+		add_decoration(&island_marks, obj, marks);
+	} else if (marks->refcount > 1) {
+		marks->refcount--;
+		marks = island_bitmap_new(marks);
+		add_decoration(&island_marks, obj, marks);
+	}
+	return marks;
+}
+
+static void add_island_marks(struct object *obj, struct island_bitmap *marks)
+{
+	struct island_bitmap *b = lookup_decoration(&island_marks, obj);
+	uint32_t i;
+
+	if (!b) {
+		marks->refcount++;
+		add_decoration(&island_marks, obj, marks);
+		return;
+	}
+	if (island_bitmap_is_subset(marks, b))
+		return;
+
+	b = own_marks(obj);
+	for (i = 0; i < island_bitmap_size; i++)
+		b->bits[i] |= marks->bits[i];
+}
+
+int island_config(const char *var, const char *value, void *cb)
+{
+	if (!strcmp(var, "pack.island")) {
+		if (!value)
+			return config_error_nonbool(var);
+		ALLOC_GROW(island_regexes, island_regexes_nr + 1,
+			   island_regexes_alloc);
+		if (regcomp(&island_regexes[island_regexes_nr], value,
+			    REG_EXTENDED))
+			die("failed to load island regex for '%s': %s",
+			    var, value);
+		island_regexes_nr++;
+		return 0;
+	}
+	return 0;
+}
+
+static int island_number(const char *name)
+{
+	struct string_list_item *item;
+
+	item = string_list_lookup(&island_names, name);
+	if (!item) {
+		int nr = island_names.nr;
+		item = string_list_insert(&island_names, name);
+		item->util = (void *)(intptr_t)nr;
+	}
+	return (intptr_t)item->util;
+}
+
+static void add_island_ref(const unsigned char *sha1, int island)
+{
+	ALLOC_GROW(island_refs, island_refs_nr + 1, island_refs_alloc);
+	hashcpy(island_refs[island_refs_nr].sha1, sha1);
+	island_refs[island_refs_nr].island = island;
+	island_refs_nr++;
+}
+
+static int find_island_for_ref(const char *refname, const unsigned char *sha1,
+			       int flags, void *data)
+{
+	regmatch_t matches[16];
+	struct strbuf name = STRBUF_INIT;
+	unsigned char peeled[20];
+	int i, m, island;
+
+	/* the last matching "pack.island" entry wins */
+	for (i = island_regexes_nr - 1; i >= 0; i--) {
+		if (!regexec(&island_regexes[i], refname,
+			     ARRAY_SIZE(matches), matches, 0))
+			break;
+	}
+	if (i < 0)
+		return 0;
+
+	/*
+	 * The island is named by the capture groups of the regex, joined
+	 * by dashes; without any groups, all matching refs share one
+	 * island with an empty name.
+	 */
+	for (m = 1; m < ARRAY_SIZE(matches); m++) {
+		regmatch_t *match = &matches[m];
+
+		if (match->rm_so == -1)
+			continue;
+		if (name.len)
+			strbuf_addch(&name, '-');
+		strbuf_add(&name, refname + match->rm_so,
+			   match->rm_eo - match->rm_so);
+	}
+
+	island = island_number(name.buf);
+	add_island_ref(sha1, island);
+	if (!peel_ref(refname, peeled) && hashcmp(peeled, sha1))
+		add_island_ref(peeled, island);
+
+	strbuf_release(&name);
+	return 0;
+}
+
+void load_delta_islands(void)
+{
+	int i;
+
+	if (!island_regexes_nr)
+		return;
+
+	for_each_ref(find_island_for_ref, NULL);
+	if (!island_names.nr)
+		return;
+	island_bitmap_size = ISLAND_BITMAP_BLOCK(island_names.nr - 1) + 1;
+
+	for (i = 0; i < island_refs_nr; i++) {
+		struct object *obj = lookup_unknown_object(island_refs[i].sha1);
+		struct island_bitmap *marks = own_marks(obj);
+		int island = island_refs[i].island;
+
+		marks->bits[ISLAND_BITMAP_BLOCK(island)] |=
+			ISLAND_BITMAP_MASK(island);
+	}
+	free(island_refs);
+	island_refs = NULL;
+	island_refs_nr = island_refs_alloc = 0;
+}
+
+void propagate_island_marks(struct commit *commit)
+{
+	struct island_bitmap *marks;
+	struct commit_list *p;
+
+	marks = lookup_decoration(&island_marks, &commit->object);
+	if (!marks)
+		return;
+
+	parse_commit(commit);
+	if (commit->tree)
+		add_island_marks(&commit->tree->object, marks);
+	for (p = commit->parents; p; p = p->next)
+		add_island_marks(&p->item->object, marks);
+}
+
+void island_note_tree(struct tree *tree, const char *path)
+{
+	unsigned depth = 0;
+
+	if (!island_bitmap_size)
+		return;
+
+	if (*path)
+		for (depth = 1; *path; path++)
+			if (*path == '/')
+				depth++;
+
+	ALLOC_GROW(island_trees, island_trees_nr + 1, island_trees_alloc);
+	island_trees[island_trees_nr].tree = tree;
+	island_trees[island_trees_nr].depth = depth;
+	island_trees_nr++;
+}
+
+static int tree_depth_compare(const void *a_, const void *b_)
+{
+	const struct island_tree *a = a_;
+	const struct island_tree *b = b_;
+
+	return a->depth < b->depth ? -1 : (a->depth > b->depth);
+}
+
+void resolve_tree_islands(int progress)
+{
+	struct progress *progress_state = NULL;
+	int i;
+
+	if (!island_trees_nr)
+		return;
+
+	/*
+	 * A tree must have received the marks of all its parent trees
+	 * before it passes them on, so work from the root downwards.
+	 */
+	qsort(island_trees, island_trees_nr, sizeof(*island_trees),
+	      tree_depth_compare);
+
+	if (progress)
+		progress_state = start_progress("Propagating island marks",
+						island_trees_nr);
+
+	for (i = 0; i < island_trees_nr; i++) {
+		struct tree *tree = island_trees[i].tree;
+		struct island_bitmap *marks;
+		struct tree_desc desc;
+		struct name_entry entry;
+		enum object_type type;
+		unsigned long size;
+		void *buf;
+
+		display_progress(progress_state, i + 1);
+
+		marks = lookup_decoration(&island_marks, &tree->object);
+		if (!marks)
+			continue;
+
+		buf = read_sha1_file(tree->object.sha1, &type, &size);
+		if (!buf || type != OBJ_TREE)
+			die("unable to read tree %s",
+			    sha1_to_hex(tree->object.sha1));
+
+		init_tree_desc(&desc, buf, size);
+		while (tree_entry(&desc, &entry)) {
+			struct object *obj;
+
+			if (S_ISGITLINK(entry.mode))
+				continue;
+			if (S_ISDIR(entry.mode)) {
+				struct tree *sub = lookup_tree(entry.sha1);
+				if (!sub)
+					continue;
+				obj = &sub->object;
+			} else {
+				struct blob *blob = lookup_blob(entry.sha1);
+				if (!blob)
+					continue;
+				obj = &blob->object;
+			}
+			add_island_marks(obj, marks);
+		}
+		free(buf);
+	}
+
+	stop_progress(&progress_state);
+	free(island_trees);
+	island_trees = NULL;
+	island_trees_nr = island_trees_alloc = 0;
+}
+
+static struct island_bitmap *island_marks_of(const unsigned char *sha1)
+{
+	struct object *obj = lookup_object(sha1);
+	return obj ? lookup_decoration(&island_marks, obj) : NULL;
+}
+
+int in_same_island(const unsigned char *trg, const unsigned char *base)
+{
+	struct island_bitmap *trg_marks, *base_marks;
+
+	/* an object outside of every island can use any base */
+	trg_marks = island_marks_of(trg);
+	if (!trg_marks)
+		return 1;
+
+	base_marks = island_marks_of(base);
+	if (!base_marks)
+		return 0;
+
+	return island_bitmap_is_subset(trg_marks, base_marks);
+}
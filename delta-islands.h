@@ -0,0 +1,38 @@
+#ifndef DELTA_ISLANDS_H
+#define DELTA_ISLANDS_H
+
+struct commit;
+struct tree;
+
+/*
+ * Delta islands: refs are grouped into "islands" by the regular
+ * expressions given in the multi-valued "pack.island" configuration.
+ * Every object is marked with the set of islands it is reachable
+ * from, and an object may only be stored as a delta against a base
+ * that is reachable from (at least) all of the same islands.  This
+ * keeps a pack that is shared between otherwise unrelated histories
+ * (e.g. forks using the same alternate) reusable for each of them.
+ */
+
+/* config callback for the "pack.island" variable */
+extern int island_config(const char *var, const char *value, void *cb);
+
+/* mark the objects directly pointed at by the refs with their islands */
+extern void load_delta_islands(void);
+
+/* pass the marks of a commit on to its root tree and its parents */
+extern void propagate_island_marks(struct commit *commit);
+
+/* remember a tree seen during traversal, "path" being where it was seen */
+extern void island_note_tree(struct tree *tree, const char *path);
+
+/* pass the marks of all noted trees on to their entries, shallowest first */
+extern void resolve_tree_islands(int progress);
+
+/*
+ * Return true if the object "trg" may be stored as a delta against
+ * the object "base" without crossing an island boundary.
+ */
+extern int in_same_island(const unsigned char *trg, const unsigned char *base);
+
+#endif
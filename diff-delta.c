@@ -308,6 +308,30 @@ unsigned long sizeof_delta_index(struct delta_index *index)
 		return 0;
 }
 
+/*
+ * Return how many leading bytes of "a" and "b" are identical, looking
+ * at no more than "max" of them.  Whole words are compared at a time
+ * until one differs; the exact spot is then found bytewise.
+ */
+static inline unsigned int match_length(const unsigned char *a,
+					const unsigned char *b,
+					unsigned int max)
+{
+	unsigned int n = 0;
+
+	while (max - n >= sizeof(unsigned long)) {
+		unsigned long wa, wb;
+		memcpy(&wa, a + n, sizeof(wa));
+		memcpy(&wb, b + n, sizeof(wb));
+		if (wa != wb)
+			break;
+		n += sizeof(unsigned long);
+	}
+	while (n < max && a[n] == b[n])
+		n++;
+	return n;
+}
+
 /*
  * The maximum size for any opcode sequence, including the initial header
  * plus Rabin window plus biggest copy.
@@ -374,20 +398,19 @@ create_delta(const struct delta_index *index,
 			i = val & index->hash_mask;
 			for (entry = index->hash[i]; entry < index->hash[i+1]; entry++) {
 				const unsigned char *ref = entry->ptr;
-				const unsigned char *src = data;
 				unsigned int ref_size = ref_top - ref;
+				unsigned int len;
 				if (entry->val != val)
 					continue;
-				if (ref_size > top - src)
-					ref_size = top - src;
+				if (ref_size > top - data)
+					ref_size = top - data;
 				if (ref_size <= msize)
 					break;
-				while (ref_size-- && *src++ == *ref)
-					ref++;
-				if (msize < ref - entry->ptr) {
+				len = match_length(ref, data, ref_size);
+				if (msize < len) {
 					/* this is our best match so far */
-					msize = ref - entry->ptr;
-					moff = entry->ptr - ref_data;
+					msize = len;
+					moff = ref - ref_data;
 					if (msize >= 4096) /* good enough */
 						break;
 				}
@@ -36,6 +36,15 @@
  */
 #define HASHBASE 107927
 
+/*
+ * Besides the table itself, we keep the number of bytes in the chunks
+ * whose hash falls in each of SPANHASH_BANDS bands.  Two files cannot
+ * share more bytes in a band than the smaller of their totals for it,
+ * which gives a cheap upper bound of what diffcore_count_changes()
+ * would find copied.
+ */
+#define SPANHASH_BANDS 256
+
 struct spanhash {
 	unsigned int hashval;
 	unsigned int cnt;
@@ -43,6 +52,7 @@ struct spanhash {
 struct spanhash_top {
 	int alloc_log2;
 	int free;
+	unsigned int band[SPANHASH_BANDS];
 	struct spanhash data[FLEX_ARRAY];
 };
 
@@ -160,9 +170,40 @@ static struct spanhash_top *hash_chars(struct diff_filespec *one)
 		1ul << hash->alloc_log2,
 		sizeof(hash->data[0]),
 		spanhash_cmp);
+
+	memset(hash->band, 0, sizeof(hash->band));
+	for (i = 0; hash->data[i].cnt; i++)
+		hash->band[hash->data[i].hashval % SPANHASH_BANDS] +=
+			hash->data[i].cnt;
 	return hash;
 }
 
+/*
+ * Fill in one->cnt_data from its contents, so that the contents are not
+ * needed by diffcore_count_changes() later.
+ */
+void diffcore_prepare_count(struct diff_filespec *one)
+{
+	if (!one->cnt_data)
+		one->cnt_data = hash_chars(one);
+}
+
+/*
+ * Return an upper bound of the number of bytes diffcore_count_changes()
+ * would count as copied from src to dst, using only their cnt_data.
+ */
+unsigned long diffcore_max_copied(struct diff_filespec *src,
+				  struct diff_filespec *dst)
+{
+	struct spanhash_top *s = src->cnt_data, *d = dst->cnt_data;
+	unsigned long sum = 0;
+	int i;
+
+	for (i = 0; i < SPANHASH_BANDS; i++)
+		sum += s->band[i] < d->band[i] ? s->band[i] : d->band[i];
+	return sum;
+}
+
 int diffcore_count_changes(struct diff_filespec *src,
 			   struct diff_filespec *dst,
 			   void **src_count_p,
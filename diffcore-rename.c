@@ -6,6 +6,31 @@
 #include "diffcore.h"
 #include "hash.h"
 #include "progress.h"
+#include "thread-utils.h"
+
+#ifndef NO_PTHREADS
+static int use_threads;
+static pthread_mutex_t rename_mutex;
+
+/*
+ * When the rename matrix is computed by several threads, the rows are
+ * handed out and the progress is shown under this lock.
+ */
+static inline void rename_lock(void)
+{
+	if (use_threads)
+		pthread_mutex_lock(&rename_mutex);
+}
+
+static inline void rename_unlock(void)
+{
+	if (use_threads)
+		pthread_mutex_unlock(&rename_mutex);
+}
+#else
+#define rename_lock()
+#define rename_unlock()
+#endif
 
 /* Table of rename/copy destinations */
 
@@ -111,6 +136,18 @@ static int basename_same(struct diff_filespec *src, struct diff_filespec *dst)
 		(!dst_len || dst->path[dst_len - 1] == '/');
 }
 
+static int prepare_count(struct diff_filespec *one)
+{
+	if (one->cnt_data)
+		return 0;
+	if (diff_populate_filespec(one, 0))
+		return -1;
+	diffcore_prepare_count(one);
+	/* We do not need the text anymore. */
+	diff_free_filespec_blob(one);
+	return 0;
+}
+
 struct diff_score {
 	int src; /* index in rename_src */
 	int dst; /* index in rename_dst */
@@ -136,7 +173,7 @@ static int estimate_similarity(struct diff_filespec *src,
 	 * call into this function in that case.
 	 */
 	unsigned long max_size, delta_size, base_size, src_copied, literal_added;
-	unsigned long delta_limit;
+	unsigned long delta_limit, src_size, dst_size;
 	int score;
 
 	/* We deal only with regular files.  Symlink renames are handled
@@ -155,13 +192,14 @@ static int estimate_similarity(struct diff_filespec *src,
 	 * is a possible size - we really should have a flag to
 	 * say whether the size is valid or not!)
 	 */
-	if (!src->cnt_data && diff_populate_filespec(src, 1))
-		return 0;
-	if (!dst->cnt_data && diff_populate_filespec(dst, 1))
+	if ((!src->cnt_data && diff_populate_filespec(src, 1)) ||
+	    (!dst->cnt_data && diff_populate_filespec(dst, 1)))
 		return 0;
+	src_size = src->size;
+	dst_size = dst->size;
 
-	max_size = ((src->size > dst->size) ? src->size : dst->size);
-	base_size = ((src->size < dst->size) ? src->size : dst->size);
+	max_size = ((src_size > dst_size) ? src_size : dst_size);
+	base_size = ((src_size < dst_size) ? src_size : dst_size);
 	delta_size = max_size - base_size;
 
 	/* We would not consider edits that change the file size so
@@ -175,9 +213,16 @@ static int estimate_similarity(struct diff_filespec *src,
 	if (max_size * (MAX_SCORE-minimum_score) < delta_size * MAX_SCORE)
 		return 0;
 
-	if (!src->cnt_data && diff_populate_filespec(src, 0))
+	if (prepare_count(src) || prepare_count(dst))
 		return 0;
-	if (!dst->cnt_data && diff_populate_filespec(dst, 0))
+
+	/*
+	 * Skip the full count for pairs that could not reach the
+	 * minimum score even if all material the bound allows for
+	 * were copied.
+	 */
+	if ((int)(diffcore_max_copied(src, dst) * MAX_SCORE / max_size) <
+	    minimum_score)
 		return 0;
 
 	delta_limit = (unsigned long)
@@ -191,7 +236,7 @@ static int estimate_similarity(struct diff_filespec *src,
 	/* How similar are they?
 	 * what percentage of material in dst are from source?
 	 */
-	if (!dst->size)
+	if (!dst_size)
 		score = 0; /* should not happen */
 	else
 		score = (int)(src_copied * MAX_SCORE / max_size);
@@ -404,6 +449,97 @@ static int find_exact_renames(struct diff_options *options)
 	return i;
 }
 
+struct basename_entry {
+	const char *base;
+	int index;
+};
+
+static int basename_entry_cmp(const void *a_, const void *b_)
+{
+	const struct basename_entry *a = a_, *b = b_;
+	return strcmp(a->base, b->base);
+}
+
+static const char *path_basename(const char *path)
+{
+	const char *slash = strrchr(path, '/');
+	return slash ? slash + 1 : path;
+}
+
+/* The end of the run of entries in e[] with the same basename as e[i] */
+static int basename_run_end(struct basename_entry *e, int nr, int i)
+{
+	int end = i + 1;
+	while (end < nr && !strcmp(e[end].base, e[i].base))
+		end++;
+	return end;
+}
+
+/*
+ * Most renames move a file to another directory and keep its name.
+ * Before the quadratic matrix, pair each remaining destination with
+ * the remaining source of the same basename, if that basename occurs
+ * only once on either side and the two are similar enough.  As this
+ * does not look at other candidates, the similarity asked for is
+ * halfway between minimum_score and an exact match.
+ */
+static int find_basename_matches(int minimum_score)
+{
+	struct basename_entry *src, *dst;
+	int src_nr = 0, dst_nr = 0, i, j, count = 0;
+	int basename_score = minimum_score + (MAX_SCORE - minimum_score) / 2;
+
+	src = xmalloc(rename_src_nr * sizeof(*src));
+	for (i = 0; i < rename_src_nr; i++) {
+		struct diff_filespec *one = rename_src[i].p->one;
+		if (one->rename_used)
+			continue;
+		src[src_nr].base = path_basename(one->path);
+		src[src_nr++].index = i;
+	}
+	dst = xmalloc(rename_dst_nr * sizeof(*dst));
+	for (i = 0; i < rename_dst_nr; i++) {
+		if (rename_dst[i].pair)
+			continue;
+		dst[dst_nr].base = path_basename(rename_dst[i].two->path);
+		dst[dst_nr++].index = i;
+	}
+	qsort(src, src_nr, sizeof(*src), basename_entry_cmp);
+	qsort(dst, dst_nr, sizeof(*dst), basename_entry_cmp);
+
+	i = j = 0;
+	while (i < src_nr && j < dst_nr) {
+		int cmp = strcmp(src[i].base, dst[j].base);
+		int src_end, dst_end;
+
+		if (cmp < 0) {
+			i++;
+			continue;
+		}
+		if (cmp > 0) {
+			j++;
+			continue;
+		}
+		src_end = basename_run_end(src, src_nr, i);
+		dst_end = basename_run_end(dst, dst_nr, j);
+		if (src_end == i + 1 && dst_end == j + 1) {
+			struct diff_filespec *one = rename_src[src[i].index].p->one;
+			struct diff_filespec *two = rename_dst[dst[j].index].two;
+			int score = estimate_similarity(one, two, minimum_score);
+			if (score >= basename_score) {
+				record_rename_pair(dst[j].index, src[i].index,
+						   score);
+				count++;
+			}
+		}
+		i = src_end;
+		j = dst_end;
+	}
+	free(src);
+	free(dst);
+	return count;
+}
+
 #define NUM_CANDIDATE_PER_DST 4
 static void record_if_better(struct diff_score m[], struct diff_score *o)
 {
@@ -430,11 +566,19 @@ static int too_many_rename_candidates(int num_create,
 				      struct diff_options *options)
 {
 	int rename_limit = options->rename_limit;
-	int num_src = rename_src_nr;
+	int num_src = 0;
 	int i;
 
 	options->needed_rename_limit = 0;
 
+	/* without copies, sources that were already renamed are out */
+	for (i = 0; i < rename_src_nr; i++) {
+		if (options->detect_rename != DIFF_DETECT_COPY &&
+		    rename_src[i].p->one->rename_used)
+			continue;
+		num_src++;
+	}
+
 	/*
 	 * This basically does a test for the rename matrix not
 	 * growing larger than a "rename_limit" square matrix, ie:
@@ -490,15 +634,171 @@ static int find_renames(struct diff_score *mx, int dst_cnt, int minimum_score, i
 	return count;
 }
 
+/*
+ * The rows of the rename similarity matrix: one row of
+ * NUM_CANDIDATE_PER_DST best candidates for each destination that is
+ * not an exact rename.
+ */
+struct rename_matrix {
+	struct diff_score *mx;
+	int *dst;
+	int nr;
+	int minimum_score;
+	int skip_unmodified;
+	int skip_used;
+	struct progress *progress;
+	int next, done;
+	/*
+	 * Set when the cnt_data of all the files was filled in up front;
+	 * the files it could not be filled in for are then skipped.
+	 */
+	int prepared;
+};
+
+static void fill_rename_row(struct rename_matrix *r, int row)
+{
+	struct diff_filespec *two = rename_dst[r->dst[row]].two;
+	struct diff_score *m = &r->mx[row * NUM_CANDIDATE_PER_DST];
+	int j;
+
+	for (j = 0; j < NUM_CANDIDATE_PER_DST; j++)
+		m[j].dst = -1;
+
+	for (j = 0; j < rename_src_nr; j++) {
+		struct diff_filespec *one = rename_src[j].p->one;
+		struct diff_score this_src;
+
+		if (r->skip_unmodified &&
+		    diff_unmodified_pair(rename_src[j].p))
+			continue;
+		if (r->skip_used && one->rename_used)
+			continue;
+
+		if (r->prepared && (!one->cnt_data || !two->cnt_data))
+			this_src.score = 0;
+		else
+			this_src.score = estimate_similarity(one, two,
+							     r->minimum_score);
+		this_src.name_score = basename_same(one, two);
+		this_src.dst = r->dst[row];
+		this_src.src = j;
+		record_if_better(m, &this_src);
+	}
+}
+
+#ifndef NO_PTHREADS
+/* Do not bother with threads for matrices smaller than this */
+#define RENAME_THREADS_MIN_PAIRS 1024
+
+/*
+ * Each thread takes the next row that nobody works on yet, and keeps
+ * the best candidates for the destination of that row; the rows are
+ * merged by sorting the whole matrix afterwards.
+ */
+static void *rename_thread(void *data)
+{
+	struct rename_matrix *r = data;
+
+	for (;;) {
+		int row;
+
+		rename_lock();
+		row = r->next++;
+		rename_unlock();
+		if (row >= r->nr)
+			break;
+		fill_rename_row(r, row);
+
+		rename_lock();
+		r->done++;
+		display_progress(r->progress, r->done * rename_src_nr);
+		rename_unlock();
+	}
+	return NULL;
+}
+
+/*
+ * Fill in the cnt_data of every file the matrix looks at, so that the
+ * threads only read the filespecs and do not need the lock for them.
+ */
+static void prepare_rename_matrix(struct rename_matrix *r)
+{
+	int i;
+
+	for (i = 0; i < rename_src_nr; i++) {
+		struct diff_filespec *one = rename_src[i].p->one;
+
+		if ((r->skip_unmodified &&
+		     diff_unmodified_pair(rename_src[i].p)) ||
+		    (r->skip_used && one->rename_used) ||
+		    !S_ISREG(one->mode))
+			continue;
+		prepare_count(one);
+	}
+	for (i = 0; i < r->nr; i++) {
+		struct diff_filespec *two = rename_dst[r->dst[i]].two;
+
+		if (S_ISREG(two->mode))
+			prepare_count(two);
+	}
+	r->prepared = 1;
+}
+
+static int fill_rename_matrix_threaded(struct rename_matrix *r, int nr_threads)
+{
+	pthread_t *threads;
+	int i, started;
+
+	if (nr_threads <= 0)
+		nr_threads = online_cpus();
+	if (nr_threads > r->nr)
+		nr_threads = r->nr;
+	if (nr_threads <= 1 ||
+	    (uint64_t)r->nr * rename_src_nr < RENAME_THREADS_MIN_PAIRS)
+		return -1;
+
+	prepare_rename_matrix(r);
+	threads = xcalloc(nr_threads, sizeof(*threads));
+	pthread_mutex_init(&rename_mutex, NULL);
+	use_threads = 1;
+	for (started = 0; started < nr_threads; started++)
+		if (pthread_create(&threads[started], NULL, rename_thread, r))
+			break;
+	/* a thread that could not be started leaves its rows to the others */
+	if (!started)
+		rename_thread(r);
+	for (i = 0; i < started; i++)
+		pthread_join(threads[i], NULL);
+	use_threads = 0;
+	pthread_mutex_destroy(&rename_mutex);
+	free(threads);
+	return 0;
+}
+#else
+#define fill_rename_matrix_threaded(r, nr_threads) (-1)
+#endif
+
+static void fill_rename_matrix(struct rename_matrix *r, int nr_threads)
+{
+	int row;
+
+	if (!fill_rename_matrix_threaded(r, nr_threads))
+		return;
+	for (row = 0; row < r->nr; row++) {
+		fill_rename_row(r, row);
+		display_progress(r->progress, (row + 1) * rename_src_nr);
+	}
+}
+
 void diffcore_rename(struct diff_options *options)
 {
 	int detect_rename = options->detect_rename;
 	int minimum_score = options->rename_score;
 	struct diff_queue_struct *q = &diff_queued_diff;
 	struct diff_queue_struct outq;
-	struct diff_score *mx;
-	int i, j, rename_count, skip_unmodified = 0;
-	int num_create, dst_cnt;
+	struct rename_matrix matrix;
+	int i, rename_count, skip_unmodified = 0;
+	int num_create;
 	struct progress *progress = NULL;
 
 	if (!minimum_score)
@@ -555,6 +855,13 @@ void diffcore_rename(struct diff_options *options)
 	if (minimum_score == MAX_SCORE)
 		goto cleanup;
 
+	/*
+	 * Without copies, a source can be used only once, so pairing it
+	 * by its name takes it out of the matrix below.
+	 */
+	if (detect_rename == DIFF_DETECT_RENAME)
+		rename_count += find_basename_matches(minimum_score);
+
 	/*
 	 * Calculate how many renames are left (but all the source
 	 * files still remain as options for rename/copies!)
@@ -579,54 +886,33 @@ void diffcore_rename(struct diff_options *options)
 	if (options->show_rename_progress) {
 		progress = start_progress_delay(
 				"Performing inexact rename detection",
-				rename_dst_nr * rename_src_nr, 50, 1);
+				num_create * rename_src_nr, 50, 1);
 	}
 
-	mx = xcalloc(num_create * NUM_CANDIDATE_PER_DST, sizeof(*mx));
-	for (dst_cnt = i = 0; i < rename_dst_nr; i++) {
-		struct diff_filespec *two = rename_dst[i].two;
-		struct diff_score *m;
-
+	memset(&matrix, 0, sizeof(matrix));
+	matrix.mx = xcalloc(num_create * NUM_CANDIDATE_PER_DST, sizeof(*matrix.mx));
+	matrix.dst = xmalloc(num_create * sizeof(*matrix.dst));
+	for (i = 0; i < rename_dst_nr; i++) {
 		if (rename_dst[i].pair)
 			continue; /* dealt with exact match already. */
-
-		m = &mx[dst_cnt * NUM_CANDIDATE_PER_DST];
-		for (j = 0; j < NUM_CANDIDATE_PER_DST; j++)
-			m[j].dst = -1;
-
-		for (j = 0; j < rename_src_nr; j++) {
-			struct diff_filespec *one = rename_src[j].p->one;
-			struct diff_score this_src;
-
-			if (skip_unmodified &&
-			    diff_unmodified_pair(rename_src[j].p))
-				continue;
-
-			this_src.score = estimate_similarity(one, two,
-							     minimum_score);
-			this_src.name_score = basename_same(one, two);
-			this_src.dst = i;
-			this_src.src = j;
-			record_if_better(m, &this_src);
-			/*
-			 * Once we run estimate_similarity,
-			 * We do not need the text anymore.
-			 */
-			diff_free_filespec_blob(one);
-			diff_free_filespec_blob(two);
-		}
-		dst_cnt++;
-		display_progress(progress, (i+1)*rename_src_nr);
+		matrix.dst[matrix.nr++] = i;
 	}
+	matrix.minimum_score = minimum_score;
+	matrix.skip_unmodified = skip_unmodified;
+	matrix.skip_used = detect_rename != DIFF_DETECT_COPY;
+	matrix.progress = progress;
+	fill_rename_matrix(&matrix, options->rename_threads);
 	stop_progress(&progress);
 
 	/* cost matrix sorted by most to least similar pair */
-	qsort(mx, dst_cnt * NUM_CANDIDATE_PER_DST, sizeof(*mx), score_compare);
+	qsort(matrix.mx, matrix.nr * NUM_CANDIDATE_PER_DST,
+	      sizeof(*matrix.mx), score_compare);
 
-	rename_count += find_renames(mx, dst_cnt, minimum_score, 0);
+	rename_count += find_renames(matrix.mx, matrix.nr, minimum_score, 0);
 	if (detect_rename == DIFF_DETECT_COPY)
-		rename_count += find_renames(mx, dst_cnt, minimum_score, 1);
-	free(mx);
+		rename_count += find_renames(matrix.mx, matrix.nr, minimum_score, 1);
+	free(matrix.mx);
+	free(matrix.dst);
 
  cleanup:
 	/* At this point, we have found some renames and copies and they
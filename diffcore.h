@@ -122,6 +122,9 @@ void diff_debug_queue(const char *, struct diff_queue_struct *);
 #define diff_debug_queue(a,b) do { /* nothing */ } while (0)
 #endif
 
+extern void diffcore_prepare_count(struct diff_filespec *one);
+extern unsigned long diffcore_max_copied(struct diff_filespec *src,
+					 struct diff_filespec *dst);
 extern int diffcore_count_changes(struct diff_filespec *src,
 				  struct diff_filespec *dst,
 				  void **src_count_p,
@@ -11,6 +11,7 @@
 #include "run-command.h"
 #include "transport.h"
 #include "version.h"
+#include "decorate.h"
 
 static int transfer_unpack_limit = -1;
 static int fetch_unpack_limit = -1;
@@ -21,6 +22,12 @@ static int fetch_fsck_objects = -1;
 static int transfer_fsck_objects = -1;
 static int agent_supported;
 
+enum negotiation_algorithm {
+	NEGOTIATE_CONSECUTIVE,
+	NEGOTIATE_SKIPPING
+};
+static enum negotiation_algorithm negotiation_algorithm;
+
 #define COMPLETE	(1U << 0)
 #define COMMON		(1U << 1)
 #define COMMON_REF	(1U << 2)
@@ -157,6 +164,208 @@ static const unsigned char *get_rev(void)
 	return commit->object.sha1;
 }
 
+/*
+ * The "skipping" negotiator walks the same queue as get_rev(), but
+ * having sent a commit it skips the next 1, 2, 4, 8... commits along
+ * each line of history instead of sending them all, so that a long
+ * history the other side does not have is crossed in few rounds.
+ *
+ * When an ACK shows that the parent of a skipped commit is common, the
+ * gap above it is searched again: the commits at distance 0, 1, 3, 7...
+ * from the common one are put back on the queue, and the next ACK
+ * narrows the gap further.
+ */
+struct skip_entry {
+	unsigned int original_ttl;
+	unsigned int ttl;
+	unsigned int skipped:1;
+	/* the commit through which we reached this one */
+	struct commit *child;
+};
+static struct decoration skip_entries = { "skipping negotiator" };
+static struct skip_entry **skip_entry_list;
+static int skip_entry_nr, skip_entry_alloc;
+static struct commit **skipped;
+static int skipped_nr, skipped_alloc;
+static int backtrack_pending;
+
+static struct skip_entry *get_skip_entry(struct commit *commit)
+{
+	struct skip_entry *entry;
+
+	entry = lookup_decoration(&skip_entries, &commit->object);
+	if (!entry) {
+		entry = xcalloc(1, sizeof(*entry));
+		add_decoration(&skip_entries, &commit->object, entry);
+		ALLOC_GROW(skip_entry_list, skip_entry_nr + 1, skip_entry_alloc);
+		skip_entry_list[skip_entry_nr++] = entry;
+	}
+	return entry;
+}
+
+static void reset_skipping(void)
+{
+	int i;
+
+	for (i = 0; i < skip_entry_nr; i++)
+		memset(skip_entry_list[i], 0, sizeof(struct skip_entry));
+	skipped_nr = 0;
+	backtrack_pending = 0;
+}
+
+static int has_common_parent(struct commit *commit)
+{
+	struct commit_list *parents;
+
+	for (parents = commit->parents; parents; parents = parents->next)
+		if (parents->item->object.flags & COMMON)
+			return 1;
+	return 0;
+}
+
+static void requeue_skipped(void)
+{
+	int i, j;
+
+	for (i = 0; i < skipped_nr; i++) {
+		struct commit *commit = skipped[i];
+		struct skip_entry *entry = get_skip_entry(commit);
+		int distance = 0, next = 0;
+
+		if (!entry->skipped || (commit->object.flags & COMMON) ||
+		    !has_common_parent(commit))
+			continue;
+
+		/* walk up the gap towards the commit that was sent */
+		while (entry->skipped && !(commit->object.flags & COMMON)) {
+			struct commit *child = entry->child;
+
+			if (distance++ == next) {
+				entry->skipped = 0;
+				entry->ttl = 0;
+				commit->object.flags &= ~POPPED;
+				commit_list_insert_by_date(commit, &rev_list);
+				non_common_revs++;
+				next = 2 * next + 1;
+			}
+			if (!child)
+				break;
+			commit = child;
+			entry = get_skip_entry(commit);
+		}
+	}
+
+	for (i = j = 0; i < skipped_nr; i++)
+		if (get_skip_entry(skipped[i])->skipped &&
+		    !(skipped[i]->object.flags & COMMON))
+			skipped[j++] = skipped[i];
+	skipped_nr = j;
+	backtrack_pending = 0;
+}
+
+static const unsigned char *get_rev_skipping(void)
+{
+	struct commit *commit = NULL;
+
+	if (backtrack_pending)
+		requeue_skipped();
+
+	while (commit == NULL) {
+		unsigned int mark;
+		struct commit_list *parents;
+		struct skip_entry *entry;
+		int send, parent_queued = 0;
+
+		if (rev_list == NULL || non_common_revs == 0)
+			return NULL;
+
+		commit = rev_list->item;
+		rev_list = rev_list->next;
+		if (!commit->object.parsed)
+			parse_commit(commit);
+
+		commit->object.flags |= POPPED;
+		if (!(commit->object.flags & COMMON))
+			non_common_revs--;
+
+		entry = get_skip_entry(commit);
+		if (commit->object.flags & COMMON) {
+			mark = COMMON | SEEN;
+			send = 0;
+		} else if (commit->object.flags & COMMON_REF) {
+			mark = COMMON | SEEN;
+			send = 1;
+		} else {
+			mark = SEEN;
+			send = !entry->ttl;
+		}
+
+		for (parents = commit->parents; parents; parents = parents->next) {
+			struct commit *parent = parents->item;
+			struct skip_entry *p;
+			unsigned int original_ttl, ttl;
+
+			if (!(parent->object.flags & SEEN))
+				rev_list_push(parent, mark);
+			if (mark & COMMON) {
+				mark_common(parent, 1, 0);
+				continue;
+			}
+			if (parent->object.flags & POPPED)
+				continue;
+			parent_queued = 1;
+
+			/* a sent commit doubles the gap, a skipped one uses it up */
+			if (entry->ttl) {
+				original_ttl = entry->original_ttl;
+				ttl = entry->ttl - 1;
+			} else {
+				original_ttl = entry->original_ttl ?
+					entry->original_ttl * 2 : 1;
+				ttl = original_ttl;
+			}
+			p = get_skip_entry(parent);
+			if (!p->child || p->original_ttl < original_ttl) {
+				p->original_ttl = original_ttl;
+				p->ttl = ttl;
+				p->child = commit;
+			}
+		}
+
+		/* the end of a line of history is always sent */
+		if (!(commit->object.flags & COMMON) && !parent_queued)
+			send = 1;
+		if (!send) {
+			if (!(commit->object.flags & COMMON)) {
+				entry->skipped = 1;
+				ALLOC_GROW(skipped, skipped_nr + 1, skipped_alloc);
+				skipped[skipped_nr++] = commit;
+			}
+			commit = NULL;
+		}
+	}
+
+	return commit->object.sha1;
+}
+
+/*
+ * Once the queue has run dry, the only haves left to send are those
+ * that narrow a gap.  We need the ACKs for them before we can narrow
+ * it further, so they are worth a round of their own.
+ */
+static int backtrack_needs_flush(void)
+{
+	return negotiation_algorithm == NEGOTIATE_SKIPPING &&
+		!rev_list && skipped_nr;
+}
+
+static const unsigned char *next_have(void)
+{
+	if (negotiation_algorithm == NEGOTIATE_SKIPPING)
+		return get_rev_skipping();
+	return get_rev();
+}
+
 enum ack_type {
 	NAK = 0,
 	ACK,
@@ -274,6 +483,7 @@ static int find_common(struct fetch_pack_args *args,
 {
 	int fetching;
 	int count = 0, flushes = 0, flush_at = INITIAL_FLUSH, retval;
+	int rounds = 0;
 	const unsigned char *sha1;
 	unsigned in_vain = 0;
 	int got_continue = 0;
@@ -286,6 +496,7 @@ static int find_common(struct fetch_pack_args *args,
 	if (marked)
 		for_each_ref(clear_marks, NULL);
 	marked = 1;
+	reset_skipping();
 
 	for_each_ref(rev_list_insert_ref, NULL);
 	for_each_alternate_ref(insert_one_alternate_ref, NULL);
@@ -384,18 +595,19 @@ static int find_common(struct fetch_pack_args *args,
 
 	flushes = 0;
 	retval = -1;
-	while ((sha1 = get_rev())) {
+	while ((sha1 = next_have())) {
 		packet_buf_write(&req_buf, "have %s\n", sha1_to_hex(sha1));
 		if (args->verbose)
 			fprintf(stderr, "have %s\n", sha1_to_hex(sha1));
 		in_vain++;
-		if (flush_at <= ++count) {
+		if (flush_at <= ++count || backtrack_needs_flush()) {
 			int ack;
 
 			packet_buf_flush(&req_buf);
 			send_request(args, fd[1], &req_buf);
 			strbuf_setlen(&req_buf, state_len);
 			flushes++;
+			rounds++;
 			flush_at = next_flush(args, count);
 
 			/*
@@ -435,13 +647,29 @@ static int find_common(struct fetch_pack_args *args,
 						packet_buf_write(&req_buf, "have %s\n", hex);
 						state_len = req_buf.len;
 					}
-					mark_common(commit, 0, 1);
+					/*
+					 * "ready" may acknowledge a commit
+					 * the other side does not have; only
+					 * "common" is safe to narrow a gap by.
+					 */
+					if (negotiation_algorithm != NEGOTIATE_SKIPPING ||
+					    ack != ACK_ready)
+						mark_common(commit, 0, 1);
+					if (ack == ACK_common)
+						backtrack_pending = 1;
 					retval = 0;
 					in_vain = 0;
 					got_continue = 1;
 					if (ack == ACK_ready) {
 						rev_list = NULL;
 						got_ready = 1;
+						/*
+						 * With no-done the pack follows
+						 * this round; there is no time
+						 * left to narrow any gaps.
+						 */
+						if (no_done)
+							skipped_nr = 0;
 					}
 					break;
 					}
@@ -459,9 +687,13 @@ done:
 	if (!got_ready || !no_done) {
 		packet_buf_write(&req_buf, "done\n");
 		send_request(args, fd[1], &req_buf);
+		rounds++;
 	}
 	if (args->verbose)
 		fprintf(stderr, "done\n");
+	trace_printf("fetch-pack: %s negotiation sent %d haves in %d rounds\n",
+		     negotiation_algorithm == NEGOTIATE_SKIPPING ?
+		     "skipping" : "consecutive", count, rounds);
 	if (retval != 0) {
 		multi_ack = 0;
 		flushes++;
@@ -871,6 +1103,20 @@ static int fetch_pack_config(const char *var, const char *value, void *cb)
 		return 0;
 	}
 
+	if (!strcmp(var, "fetch.negotiationalgorithm")) {
+		if (!value)
+			return config_error_nonbool(var);
+		if (!strcmp(value, "skipping"))
+			negotiation_algorithm = NEGOTIATE_SKIPPING;
+		else if (!strcmp(value, "consecutive") ||
+			 !strcmp(value, "default"))
+			negotiation_algorithm = NEGOTIATE_CONSECUTIVE;
+		else
+			return error("unknown fetch negotiation algorithm '%s'",
+				     value);
+		return 0;
+	}
+
 	return git_default_config(var, value, cb);
 }
 
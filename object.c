@@ -5,17 +5,17 @@
 #include "commit.h"
 #include "tag.h"
 
-static struct object **obj_hash;
-static int nr_objs, obj_hash_size;
+static struct object_pool default_object_pool;
+struct object_pool *current_object_pool = &default_object_pool;
 
 unsigned int get_max_object_index(void)
 {
-	return obj_hash_size;
+	return current_object_pool->obj_hash_size;
 }
 
 struct object *get_indexed_object(unsigned int idx)
 {
-	return obj_hash[idx];
+	return current_object_pool->obj_hash[idx];
 }
 
 static const char *object_type_strings[] = {
@@ -66,48 +66,50 @@ static unsigned int hashtable_index(const unsigned char *sha1)
 {
 	unsigned int i;
 	memcpy(&i, sha1, sizeof(unsigned int));
-	return i % obj_hash_size;
+	return i % current_object_pool->obj_hash_size;
 }
 
 struct object *lookup_object(const unsigned char *sha1)
 {
+	struct object_pool *pool = current_object_pool;
 	unsigned int i;
 	struct object *obj;
 
-	if (!obj_hash)
+	if (!pool->obj_hash)
 		return NULL;
 
 	i = hashtable_index(sha1);
-	while ((obj = obj_hash[i]) != NULL) {
+	while ((obj = pool->obj_hash[i]) != NULL) {
 		if (!hashcmp(sha1, obj->sha1))
 			break;
 		i++;
-		if (i == obj_hash_size)
+		if (i == pool->obj_hash_size)
 			i = 0;
 	}
 	return obj;
 }
 
-static void grow_object_hash(void)
+static void grow_object_hash(struct object_pool *pool)
 {
 	int i;
-	int new_hash_size = obj_hash_size < 32 ? 32 : 2 * obj_hash_size;
+	int new_hash_size = pool->obj_hash_size < 32 ? 32 : 2 * pool->obj_hash_size;
 	struct object **new_hash;
 
 	new_hash = xcalloc(new_hash_size, sizeof(struct object *));
-	for (i = 0; i < obj_hash_size; i++) {
-		struct object *obj = obj_hash[i];
+	for (i = 0; i < pool->obj_hash_size; i++) {
+		struct object *obj = pool->obj_hash[i];
 		if (!obj)
 			continue;
 		insert_obj_hash(obj, new_hash, new_hash_size);
 	}
-	free(obj_hash);
-	obj_hash = new_hash;
-	obj_hash_size = new_hash_size;
+	free(pool->obj_hash);
+	pool->obj_hash = new_hash;
+	pool->obj_hash_size = new_hash_size;
 }
 
 void *create_object(const unsigned char *sha1, int type, void *o)
 {
+	struct object_pool *pool = current_object_pool;
 	struct object *obj = o;
 
 	obj->parsed = 0;
@@ -116,11 +118,11 @@ void *create_object(const unsigned char *sha1, int type, void *o)
 	obj->flags = 0;
 	hashcpy(obj->sha1, sha1);
 
-	if (obj_hash_size - 1 <= nr_objs * 2)
-		grow_object_hash();
+	if (pool->obj_hash_size - 1 <= pool->nr_objs * 2)
+		grow_object_hash(pool);
 
-	insert_obj_hash(obj, obj_hash, obj_hash_size);
-	nr_objs++;
+	insert_obj_hash(obj, pool->obj_hash, pool->obj_hash_size);
+	pool->nr_objs++;
 	return obj;
 }
 
@@ -162,8 +164,8 @@ struct object *parse_object_buffer(const unsigned char *sha1, enum object_type t
 		if (commit) {
 			if (parse_commit_buffer(commit, buffer, size))
 				return NULL;
-			if (!commit->buffer) {
-				commit->buffer = buffer;
+			if (!get_cached_commit_buffer(commit, NULL)) {
+				set_commit_buffer(commit, buffer, size);
 				eaten = 1;
 			}
 			obj = &commit->object;
@@ -289,11 +291,63 @@ void object_array_remove_duplicates(struct object_array *array)
 
 void clear_object_flags(unsigned flags)
 {
+	struct object_pool *pool = current_object_pool;
 	int i;
 
-	for (i=0; i < obj_hash_size; i++) {
-		struct object *obj = obj_hash[i];
+	for (i=0; i < pool->obj_hash_size; i++) {
+		struct object *obj = pool->obj_hash[i];
 		if (obj)
 			obj->flags &= ~flags;
 	}
 }
+
+struct object_pool *new_object_pool(void)
+{
+	return xcalloc(1, sizeof(struct object_pool));
+}
+
+struct object_pool *use_object_pool(struct object_pool *pool)
+{
+	struct object_pool *old = current_object_pool;
+
+	current_object_pool = pool ? pool : &default_object_pool;
+	return old == &default_object_pool ? NULL : old;
+}
+
+static void free_object_contents(struct object *obj)
+{
+	switch (obj->type) {
+	case OBJ_COMMIT: {
+		struct commit *commit = (struct commit *)obj;
+		free_commit_buffer(commit);
+		free_commit_list(commit->parents);
+		break;
+	}
+	case OBJ_TREE:
+		free(((struct tree *)obj)->buffer);
+		break;
+	case OBJ_TAG:
+		free(((struct tag *)obj)->tag);
+		break;
+	}
+}
+
+void free_object_pool(struct object_pool *pool)
+{
+	int i;
+
+	if (!pool)
+		return;
+	if (pool == current_object_pool)
+		die("BUG: freeing the object pool in use");
+	for (i = 0; i < pool->obj_hash_size; i++)
+		if (pool->obj_hash[i])
+			free_object_contents(pool->obj_hash[i]);
+	free(pool->obj_hash);
+	clear_alloc_state(&pool->blob_state);
+	clear_alloc_state(&pool->tree_state);
+	clear_alloc_state(&pool->commit_state);
+	clear_alloc_state(&pool->tag_state);
+	clear_alloc_state(&pool->object_state);
+	free(pool);
+}
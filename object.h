@@ -78,4 +78,36 @@ void object_array_remove_duplicates(struct object_array *);
 
 void clear_object_flags(unsigned flags);
 
+/*
+ * Objects are looked up in, and allocated from, the current object
+ * pool.  A program that parses objects for one request after another
+ * can give each request its own pool and free it afterwards, with all
+ * its objects and the memory they own (commit buffers and parents,
+ * tree buffers, tag names).  Nothing may point into a pool once it is
+ * freed, e.g. revision walks, object arrays or "util" pointers.
+ */
+struct alloc_state {
+	unsigned int nr;	/* free nodes left in the current block */
+	void *next;
+	void **blocks;
+	int blocks_nr, blocks_alloc;
+};
+
+struct object_pool {
+	struct object **obj_hash;
+	int nr_objs, obj_hash_size;
+	struct alloc_state blob_state;
+	struct alloc_state tree_state;
+	struct alloc_state commit_state;
+	struct alloc_state tag_state;
+	struct alloc_state object_state;
+};
+
+extern struct object_pool *current_object_pool;
+
+extern struct object_pool *new_object_pool(void);
+/* make pool (NULL for the default one) current and return the old one */
+extern struct object_pool *use_object_pool(struct object_pool *pool);
+extern void free_object_pool(struct object_pool *pool);
+
 #endif /* OBJECT_H */
@@ -2,6 +2,7 @@
 #include "refs.h"
 #include "tag.h"
 #include "pack-refs.h"
+#include "packed-refs.h"
 
 struct ref_to_prune {
 	struct ref_to_prune *next;
@@ -12,7 +13,7 @@ struct ref_to_prune {
 struct pack_refs_cb_data {
 	unsigned int flags;
 	struct ref_to_prune *ref_to_prune;
-	FILE *refs_file;
+	struct packed_refs_writer writer;
 };
 
 static int do_not_prune(int flags)
@@ -28,6 +29,7 @@ static int handle_one_ref(const char *path, const unsigned char *sha1,
 {
 	struct pack_refs_cb_data *cb = cb_data;
 	int is_tag_ref;
+	unsigned char *peeled = NULL;
 
 	/* Do not pack the symbolic refs */
 	if ((flags & REF_ISSYMREF))
@@ -38,16 +40,15 @@ static int handle_one_ref(const char *path, const unsigned char *sha1,
 	if (!(cb->flags & PACK_REFS_ALL) && !is_tag_ref && !(flags & REF_ISPACKED))
 		return 0;
 
-	fprintf(cb->refs_file, "%s %s\n", sha1_to_hex(sha1), path);
 	if (is_tag_ref) {
 		struct object *o = parse_object(sha1);
 		if (o->type == OBJ_TAG) {
 			o = deref_tag(o, path, 0);
 			if (o)
-				fprintf(cb->refs_file, "^%s\n",
-					sha1_to_hex(o->sha1));
+				peeled = o->sha1;
 		}
 	}
+	packed_refs_writer_add(&cb->writer, path, sha1, peeled);
 
 	if ((cb->flags & PACK_REFS_PRUNE) && !do_not_prune(flags)) {
 		int namelen = strlen(path) + 1;
@@ -123,24 +124,18 @@ int pack_refs(unsigned int flags)
 
 	fd = hold_lock_file_for_update(&packed, git_path("packed-refs"),
 				       LOCK_DIE_ON_ERROR);
-	cbdata.refs_file = fdopen(fd, "w");
-	if (!cbdata.refs_file)
-		die_errno("unable to create ref-pack file structure");
-
-	/* perhaps other traits later as well */
-	fprintf(cbdata.refs_file, "# pack-refs with: peeled \n");
+	packed_refs_writer_begin(&cbdata.writer, fd, packed.filename,
+				 packed_refs_format, PACKED_REFS_PEELED);
 
 	for_each_ref(handle_one_ref, &cbdata);
-	if (ferror(cbdata.refs_file))
-		die("failed to write ref-pack file");
-	if (fflush(cbdata.refs_file) || fsync(fd) || fclose(cbdata.refs_file))
-		die_errno("failed to write ref-pack file");
+	packed_refs_writer_end(&cbdata.writer, 1);
 	/*
-	 * Since the lock file was fdopen()'ed and then fclose()'ed above,
-	 * assign -1 to the lock file descriptor so that commit_lock_file()
-	 * won't try to close() it.
+	 * The writer has closed the lock file descriptor; assign -1 to
+	 * it so that commit_lock_file() won't try to close() it.
 	 */
 	packed.fd = -1;
+	/* the old file must not stay mapped while it is replaced */
+	invalidate_ref_cache(NULL);
 	if (commit_lock_file(&packed) < 0)
 		die_errno("unable to overwrite old ref-pack file");
 	prune_refs(cbdata.ref_to_prune);
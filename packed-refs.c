@@ -0,0 +1,584 @@
+#include "cache.h"
+#include "csum-file.h"
+#include "varint.h"
+#include "packed-refs.h"
+
+#define PACKED_REFS_SIGNATURE 0xff524546	/* "\377REF" */
+#define PACKED_REFS_VERSION 1
+#define PACKED_REFS_HEADER_SIZE 12
+/* ref count, restart count and checksum */
+#define PACKED_REFS_TRAILER_SIZE (4 + 4 + 20)
+
+/* every this many records, the full refname is stored */
+#define PACKED_REFS_RESTART_INTERVAL 16
+
+/* the record carries a peeled value */
+#define PACKED_REF_HAS_PEELED 0x01
+
+static uint32_t get_be32(const unsigned char *p)
+{
+	return ((uint32_t)p[0] << 24) | ((uint32_t)p[1] << 16) |
+	       ((uint32_t)p[2] << 8) | (uint32_t)p[3];
+}
+
+static void put_be32(unsigned char *p, uint32_t v)
+{
+	p[0] = v >> 24;
+	p[1] = v >> 16;
+	p[2] = v >> 8;
+	p[3] = v;
+}
+
+/*
+ * A text packed-refs file can be searched in place only if its writer
+ * promised to keep it sorted.
+ */
+static struct packed_ref_table *open_text_table(const char *path, int fd,
+						size_t size)
+{
+	static const char header[] = "# pack-refs with:";
+	struct packed_ref_table *table;
+	const unsigned char *map, *eol;
+	char *traits;
+	unsigned int flags = 0;
+
+	if (size < sizeof(header))
+		return NULL;
+	map = xmmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+	eol = memchr(map, '\n', size);
+	if (!eol || map[size - 1] != '\n' ||
+	    memcmp(map, header, sizeof(header) - 1)) {
+		munmap((void *)map, size);
+		return NULL;
+	}
+
+	traits = xmemdupz(map + sizeof(header) - 1,
+			  eol - map - (sizeof(header) - 1));
+	if (!strstr(traits, " sorted ")) {
+		free(traits);
+		munmap((void *)map, size);
+		return NULL;
+	}
+	if (strstr(traits, " peeled "))
+		flags |= PACKED_REFS_PEELED;
+	free(traits);
+
+	table = xcalloc(1, sizeof(*table) + strlen(path) + 1);
+	strcpy(table->path, path);
+	table->format = PACKED_REFS_TEXT;
+	table->map = map;
+	table->map_size = size;
+	table->flags = flags;
+	table->records = eol + 1;
+	table->records_end = map + size;
+	return table;
+}
+
+static int verify_checksum(const unsigned char *map, size_t size)
+{
+	git_SHA_CTX ctx;
+	unsigned char sha1[20];
+
+	git_SHA1_Init(&ctx);
+	git_SHA1_Update(&ctx, map, size - 20);
+	git_SHA1_Final(sha1, &ctx);
+	return !hashcmp(sha1, map + size - 20);
+}
+
+static struct packed_ref_table *open_binary_table(const char *path, int fd,
+						  size_t size)
+{
+	struct packed_ref_table *table;
+	const unsigned char *map, *trailer;
+	size_t restarts_size;
+
+	if (size < PACKED_REFS_HEADER_SIZE + PACKED_REFS_TRAILER_SIZE)
+		die("packed-refs file %s is too small", path);
+	map = xmmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+
+	if (get_be32(map + 4) != PACKED_REFS_VERSION)
+		die("packed-refs file %s has unknown version %"PRIu32,
+		    path, get_be32(map + 4));
+	if (!verify_checksum(map, size))
+		die("packed-refs file %s is corrupt (bad checksum)", path);
+
+	table = xcalloc(1, sizeof(*table) + strlen(path) + 1);
+	strcpy(table->path, path);
+	table->format = PACKED_REFS_BINARY;
+	table->map = map;
+	table->map_size = size;
+	table->flags = get_be32(map + 8);
+
+	trailer = map + size - PACKED_REFS_TRAILER_SIZE;
+	table->nr = get_be32(trailer);
+	table->nr_restarts = get_be32(trailer + 4);
+	restarts_size = (size_t)table->nr_restarts * 4;
+	if (restarts_size > trailer - map - PACKED_REFS_HEADER_SIZE ||
+	    table->nr_restarts !=
+	    (table->nr + PACKED_REFS_RESTART_INTERVAL - 1) /
+	    PACKED_REFS_RESTART_INTERVAL)
+		die("packed-refs file %s is corrupt", path);
+	table->records = map + PACKED_REFS_HEADER_SIZE;
+	table->records_end = trailer - restarts_size;
+	return table;
+}
+
+struct packed_ref_table *open_packed_ref_table(const char *path)
+{
+	struct packed_ref_table *table = NULL;
+	unsigned char signature[4];
+	struct stat st;
+	int fd;
+
+	fd = open(path, O_RDONLY);
+	if (fd < 0)
+		return NULL;
+	if (!fstat(fd, &st) && read_in_full(fd, signature, 4) == 4) {
+		size_t size = xsize_t(st.st_size);
+
+		if (get_be32(signature) == PACKED_REFS_SIGNATURE)
+			table = open_binary_table(path, fd, size);
+		else
+			table = open_text_table(path, fd, size);
+	}
+	close(fd);
+	return table;
+}
+
+void close_packed_ref_table(struct packed_ref_table *table)
+{
+	if (!table)
+		return;
+	munmap((void *)table->map, table->map_size);
+	free(table);
+}
+
+static void NORETURN corrupt_table(struct packed_ref_table *table)
+{
+	die("packed-refs file %s is corrupt", table->path);
+}
+
+/*
+ * A cursor over the records of a table.  name, sha1, peeled and
+ * has_peeled describe the record most recently returned by
+ * packed_ref_iter_next().
+ */
+struct packed_ref_iter {
+	struct packed_ref_table *table;
+	const unsigned char *pos;
+	struct strbuf name;
+	unsigned char sha1[20];
+	unsigned char peeled[20];
+	int has_peeled;
+};
+
+/*
+ * Decode the binary record at *pos, updating name (which holds the name
+ * of the previous record) and advancing *pos past the record.
+ */
+static void decode_record(struct packed_ref_table *table,
+			  const unsigned char **pos, struct strbuf *name,
+			  const unsigned char **sha1,
+			  const unsigned char **peeled)
+{
+	const unsigned char *p = *pos, *end = table->records_end;
+	uintmax_t prefix, suffix;
+	int flags;
+
+	prefix = decode_varint(&p);
+	suffix = decode_varint(&p);
+	if (p > end || prefix > name->len || suffix > end - p)
+		corrupt_table(table);
+	strbuf_setlen(name, prefix);
+	strbuf_add(name, p, suffix);
+	p += suffix;
+
+	if (end - p < 21)
+		corrupt_table(table);
+	flags = *p++;
+	*sha1 = p;
+	p += 20;
+	if (flags & PACKED_REF_HAS_PEELED) {
+		if (end - p < 20)
+			corrupt_table(table);
+		*peeled = p;
+		p += 20;
+	} else {
+		*peeled = NULL;
+	}
+	*pos = p;
+}
+
+static const unsigned char *restart_record(struct packed_ref_table *table,
+					   uint32_t i)
+{
+	const unsigned char *restarts = table->records_end;
+	uint32_t offset = get_be32(restarts + 4 * i);
+
+	if (offset < PACKED_REFS_HEADER_SIZE ||
+	    offset >= table->records_end - table->map)
+		corrupt_table(table);
+	return table->map + offset;
+}
+
+/*
+ * Return the position to start scanning from for refs named "key" or
+ * sorting after it: the last restart record whose name sorts before
+ * or equal to key.
+ */
+static const unsigned char *seek_binary(struct packed_ref_table *table,
+					const char *key, struct strbuf *name)
+{
+	uint32_t lo = 0, hi = table->nr_restarts;
+
+	while (lo < hi) {
+		uint32_t mi = lo + (hi - lo) / 2;
+		const unsigned char *pos = restart_record(table, mi);
+		const unsigned char *sha1, *peeled;
+
+		strbuf_reset(name);
+		decode_record(table, &pos, name, &sha1, &peeled);
+		if (strcmp(name->buf, key) <= 0)
+			lo = mi + 1;
+		else
+			hi = mi;
+	}
+	strbuf_reset(name);
+	if (!lo)
+		return table->records;
+	return restart_record(table, lo - 1);
+}
+
+/*
+ * A text record is a "<sha1> SP <refname> LF" line, optionally followed
+ * by a "^<peeled> LF" line.  Return the end of the line starting at p.
+ */
+static const unsigned char *text_line_end(struct packed_ref_table *table,
+					  const unsigned char *p)
+{
+	const unsigned char *eol = memchr(p, '\n', table->records_end - p);
+	if (!eol)
+		corrupt_table(table);
+	return eol;
+}
+
+static void decode_text_record(struct packed_ref_table *table,
+			       const unsigned char **pos,
+			       struct packed_ref_iter *it)
+{
+	const unsigned char *p = *pos, *eol = text_line_end(table, p);
+
+	if (eol - p < 42 || p[40] != ' ' ||
+	    get_sha1_hex((const char *)p, it->sha1))
+		corrupt_table(table);
+	strbuf_reset(&it->name);
+	strbuf_add(&it->name, p + 41, eol - p - 41);
+	p = eol + 1;
+
+	it->has_peeled = 0;
+	if (p < table->records_end && *p == '^') {
+		eol = text_line_end(table, p);
+		if (eol - p != 41 ||
+		    get_sha1_hex((const char *)p + 1, it->peeled))
+			corrupt_table(table);
+		it->has_peeled = 1;
+		p = eol + 1;
+	}
+	*pos = p;
+}
+
+/* Return the start of the record containing the byte at p. */
+static const unsigned char *text_record_start(struct packed_ref_table *table,
+					      const unsigned char *p)
+{
+	const unsigned char *begin = table->records;
+
+	while (p > begin && p[-1] != '\n')
+		p--;
+	if (*p == '^') {
+		if (p == begin)
+			corrupt_table(table);
+		p--;
+		while (p > begin && p[-1] != '\n')
+			p--;
+	}
+	return p;
+}
+
+static int text_record_cmp(struct packed_ref_table *table,
+			   const unsigned char *rec, const char *key,
+			   const unsigned char **eol)
+{
+	size_t len, keylen = strlen(key);
+	int cmp;
+
+	*eol = text_line_end(table, rec);
+	if (*eol - rec < 42)
+		corrupt_table(table);
+	len = *eol - rec - 41;
+	cmp = memcmp(rec + 41, key, len < keylen ? len : keylen);
+	if (cmp)
+		return cmp;
+	return len < keylen ? -1 : len > keylen;
+}
+
+/*
+ * Bisect the lines of a sorted text file for the first record whose
+ * name sorts at or after key.
+ */
+static const unsigned char *seek_text(struct packed_ref_table *table,
+				      const char *key)
+{
+	const unsigned char *lo = table->records, *hi = table->records_end;
+
+	while (lo < hi) {
+		const unsigned char *rec, *eol;
+
+		rec = text_record_start(table, lo + (hi - lo) / 2);
+		if (text_record_cmp(table, rec, key, &eol) < 0) {
+			lo = eol + 1;
+			if (lo < table->records_end && *lo == '^')
+				lo = text_line_end(table, lo) + 1;
+		} else {
+			hi = rec;
+		}
+	}
+	return lo;
+}
+
+static void packed_ref_iter_init(struct packed_ref_iter *it,
+				 struct packed_ref_table *table,
+				 const char *key)
+{
+	it->table = table;
+	strbuf_init(&it->name, 0);
+	if (table->format == PACKED_REFS_BINARY)
+		it->pos = seek_binary(table, key, &it->name);
+	else
+		it->pos = seek_text(table, key);
+}
+
+static int packed_ref_iter_next(struct packed_ref_iter *it)
+{
+	struct packed_ref_table *table = it->table;
+
+	if (it->pos >= table->records_end)
+		return 0;
+	if (table->format == PACKED_REFS_BINARY) {
+		const unsigned char *sha1, *peeled;
+
+		decode_record(table, &it->pos, &it->name, &sha1, &peeled);
+		hashcpy(it->sha1, sha1);
+		it->has_peeled = !!peeled;
+		if (peeled)
+			hashcpy(it->peeled, peeled);
+	} else {
+		decode_text_record(table, &it->pos, it);
+	}
+	return 1;
+}
+
+static void packed_ref_iter_release(struct packed_ref_iter *it)
+{
+	strbuf_release(&it->name);
+}
+
+int packed_ref_table_lookup(struct packed_ref_table *table,
+			    const char *refname,
+			    unsigned char *sha1, unsigned char *peeled)
+{
+	struct packed_ref_iter it;
+	int ret = -1;
+
+	packed_ref_iter_init(&it, table, refname);
+	while (packed_ref_iter_next(&it)) {
+		int cmp = strcmp(it.name.buf, refname);
+
+		if (cmp > 0)
+			break;
+		if (!cmp) {
+			hashcpy(sha1, it.sha1);
+			if (it.has_peeled)
+				hashcpy(peeled, it.peeled);
+			else
+				hashclr(peeled);
+			ret = 0;
+			break;
+		}
+	}
+	packed_ref_iter_release(&it);
+	return ret;
+}
+
+int for_each_packed_ref_in_table(struct packed_ref_table *table,
+				 const char *prefix,
+				 each_packed_ref_fn fn, void *cb_data)
+{
+	struct packed_ref_iter it;
+	size_t prefixlen = strlen(prefix);
+	int ret = 0;
+
+	packed_ref_iter_init(&it, table, prefix);
+	while (packed_ref_iter_next(&it)) {
+		if (strncmp(it.name.buf, prefix, prefixlen)) {
+			if (strcmp(it.name.buf, prefix) > 0)
+				break;
+			continue;
+		}
+		ret = fn(it.name.buf, it.sha1,
+			 it.has_peeled ? it.peeled : NULL, cb_data);
+		if (ret)
+			break;
+	}
+	packed_ref_iter_release(&it);
+	return ret;
+}
+
+/*
+ * Older versions of git would read a binary packed-refs file as text,
+ * so mark the repository as one they must not touch before writing it.
+ */
+static void require_packed_refs_extension(void)
+{
+	if (repository_format_version >= 1 && repository_format_packed_refs)
+		return;
+	if (repository_format_version < 1 &&
+	    git_config_set("core.repositoryformatversion", "1"))
+		die("unable to set the repository format version");
+	if (git_config_set("extensions.packedrefsformat", "binary"))
+		die("unable to set extensions.packedRefsFormat");
+	repository_format_version = 1;
+	repository_format_packed_refs = 1;
+}
+
+void packed_refs_writer_begin(struct packed_refs_writer *w,
+			      int fd, const char *name,
+			      enum packed_refs_format format,
+			      unsigned int flags)
+{
+	memset(w, 0, sizeof(*w));
+	w->f = sha1fd(fd, name);
+	w->format = format;
+	w->flags = flags;
+	strbuf_init(&w->last, 0);
+
+	if (format == PACKED_REFS_BINARY) {
+		unsigned char header[PACKED_REFS_HEADER_SIZE];
+
+		require_packed_refs_extension();
+
+		put_be32(header, PACKED_REFS_SIGNATURE);
+		put_be32(header + 4, PACKED_REFS_VERSION);
+		put_be32(header + 8, flags);
+		sha1write(w->f, header, sizeof(header));
+		w->offset = sizeof(header);
+	} else {
+		/*
+		 * The refs are always written in order; saying so lets
+		 * readers bisect the file instead of parsing all of it.
+		 */
+		struct strbuf header = STRBUF_INIT;
+
+		strbuf_addstr(&header, "# pack-refs with:");
+		if (flags & PACKED_REFS_PEELED)
+			strbuf_addstr(&header, " peeled");
+		strbuf_addstr(&header, " sorted \n");
+		sha1write(w->f, header.buf, header.len);
+		strbuf_release(&header);
+	}
+}
+
+static void add_text_record(struct packed_refs_writer *w,
+			    const char *refname,
+			    const unsigned char *sha1,
+			    const unsigned char *peeled)
+{
+	struct strbuf line = STRBUF_INIT;
+
+	strbuf_addf(&line, "%s %s\n", sha1_to_hex(sha1), refname);
+	if (peeled)
+		strbuf_addf(&line, "^%s\n", sha1_to_hex(peeled));
+	sha1write(w->f, line.buf, line.len);
+	strbuf_release(&line);
+}
+
+static void add_binary_record(struct packed_refs_writer *w,
+			      const char *refname,
+			      const unsigned char *sha1,
+			      const unsigned char *peeled)
+{
+	unsigned char buf[21];
+	size_t namelen = strlen(refname), prefix = 0;
+	int len;
+
+	if (w->nr % PACKED_REFS_RESTART_INTERVAL) {
+		while (prefix < w->last.len &&
+		       w->last.buf[prefix] == refname[prefix])
+			prefix++;
+	} else {
+		if (w->offset > 0xffffffff)
+			die("packed-refs file %s is too large", w->f->name);
+		ALLOC_GROW(w->restarts, w->restarts_nr + 1, w->restarts_alloc);
+		w->restarts[w->restarts_nr++] = w->offset;
+	}
+
+	len = encode_varint(prefix, buf);
+	len += encode_varint(namelen - prefix, buf + len);
+	sha1write(w->f, buf, len);
+	sha1write(w->f, (char *)refname + prefix, namelen - prefix);
+	w->offset += len + namelen - prefix;
+
+	buf[0] = peeled ? PACKED_REF_HAS_PEELED : 0;
+	hashcpy(buf + 1, sha1);
+	sha1write(w->f, buf, 21);
+	w->offset += 21;
+	if (peeled) {
+		sha1write(w->f, (unsigned char *)peeled, 20);
+		w->offset += 20;
+	}
+}
+
+void packed_refs_writer_add(struct packed_refs_writer *w,
+			    const char *refname,
+			    const unsigned char *sha1,
+			    const unsigned char *peeled)
+{
+	if (w->nr && strcmp(w->last.buf, refname) >= 0)
+		die("BUG: packed ref '%s' added after '%s'",
+		    refname, w->last.buf);
+
+	if (w->format == PACKED_REFS_BINARY)
+		add_binary_record(w, refname, sha1, peeled);
+	else
+		add_text_record(w, refname, sha1, peeled);
+	w->nr++;
+	strbuf_reset(&w->last);
+	strbuf_addstr(&w->last, refname);
+}
+
+void packed_refs_writer_end(struct packed_refs_writer *w, int fsync)
+{
+	if (w->format == PACKED_REFS_BINARY) {
+		unsigned char buf[8];
+		int i;
+
+		for (i = 0; i < w->restarts_nr; i++) {
+			put_be32(buf, w->restarts[i]);
+			sha1write(w->f, buf, 4);
+		}
+		put_be32(buf, w->nr);
+		put_be32(buf + 4, w->restarts_nr);
+		sha1write(w->f, buf, 8);
+		sha1close(w->f, NULL, fsync ? CSUM_FSYNC : CSUM_CLOSE);
+	} else {
+		const char *name = w->f->name;
+		int fd = sha1close(w->f, NULL, 0);
+
+		if (fsync)
+			fsync_or_die(fd, name);
+		if (close(fd))
+			die_errno("%s: error on close", name);
+	}
+	free(w->restarts);
+	strbuf_release(&w->last);
+}
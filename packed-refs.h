@@ -0,0 +1,83 @@
+#ifndef PACKED_REFS_H
+#define PACKED_REFS_H
+
+/*
+ * Reading and writing packed-refs files.  Besides the traditional text
+ * format, a packed-refs file can be written in a binary format; see
+ * Documentation/technical/packed-refs-format.txt.  Binary files, and
+ * text files whose header declares them sorted, are mapped into memory
+ * and searched in place.
+ */
+
+/* The peeled value of every ref that points at a tag is recorded. */
+#define PACKED_REFS_PEELED 0x01
+
+/* A searchable packed-refs file, mapped into memory */
+struct packed_ref_table {
+	enum packed_refs_format format;
+	const unsigned char *map;
+	size_t map_size;
+	unsigned int flags;
+	/* only known for binary files */
+	uint32_t nr;
+	uint32_t nr_restarts;
+	const unsigned char *records;
+	const unsigned char *records_end;
+	char path[FLEX_ARRAY];
+};
+
+/*
+ * Open the packed-refs file at path if it can be searched in place.
+ * Return NULL if there is no such file or if it is a text file that is
+ * not known to be sorted.
+ */
+extern struct packed_ref_table *open_packed_ref_table(const char *path);
+extern void close_packed_ref_table(struct packed_ref_table *table);
+
+/*
+ * Look up refname.  On success, store its value in sha1 and its peeled
+ * value in peeled (the null sha1 if there is none) and return 0;
+ * otherwise return -1.
+ */
+extern int packed_ref_table_lookup(struct packed_ref_table *table,
+				   const char *refname,
+				   unsigned char *sha1, unsigned char *peeled);
+
+/*
+ * Call fn for each ref whose name starts with prefix, in order.  peeled
+ * is NULL for refs without a peeled value.  Stop and return the value
+ * fn returns if it is non-zero.
+ */
+typedef int each_packed_ref_fn(const char *refname, const unsigned char *sha1,
+			       const unsigned char *peeled, void *cb_data);
+extern int for_each_packed_ref_in_table(struct packed_ref_table *table,
+					const char *prefix,
+					each_packed_ref_fn fn, void *cb_data);
+
+/*
+ * Write a packed-refs file to fd (typically that of a lock file).  The
+ * refs must be added in strcmp() order of their names.
+ * packed_refs_writer_end() closes fd.
+ */
+struct packed_refs_writer {
+	struct sha1file *f;
+	enum packed_refs_format format;
+	unsigned int flags;
+	struct strbuf last;
+	uint32_t nr;
+	off_t offset;
+	uint32_t *restarts;
+	int restarts_nr, restarts_alloc;
+};
+
+extern void packed_refs_writer_begin(struct packed_refs_writer *w,
+				     int fd, const char *name,
+				     enum packed_refs_format format,
+				     unsigned int flags);
+extern void packed_refs_writer_add(struct packed_refs_writer *w,
+				   const char *refname,
+				   const unsigned char *sha1,
+				   const unsigned char *peeled);
+extern void packed_refs_writer_end(struct packed_refs_writer *w, int fsync);
+
+#endif /* PACKED_REFS_H */
@@ -501,10 +501,11 @@ static void add_merge_info(const struct pretty_print_context *pp,
 	strbuf_addch(sb, '\n');
 }
 
-static char *get_header(const struct commit *commit, const char *key)
+static char *get_header(const struct commit *commit, const char *msg,
+			const char *key)
 {
 	int key_len = strlen(key);
-	const char *line = commit->buffer;
+	const char *line = msg;
 
 	while (line) {
 		const char *eol = strchr(line, '\n'), *next;
@@ -564,24 +565,25 @@ char *logmsg_reencode(const struct commit *commit,
 {
 	static const char *utf8 = "UTF-8";
 	const char *use_encoding;
+	const char *msg;
 	char *encoding;
-	char *out;
+	char *out = NULL;
 
 	if (!output_encoding || !*output_encoding)
 		return NULL;
-	encoding = get_header(commit, "encoding");
+	msg = get_commit_buffer(commit, NULL);
+	encoding = get_header(commit, msg, "encoding");
 	use_encoding = encoding ? encoding : utf8;
-	if (same_encoding(use_encoding, output_encoding))
+	if (same_encoding(use_encoding, output_encoding)) {
 		if (encoding) /* we'll strip encoding header later */
-			out = xstrdup(commit->buffer);
-		else
-			return NULL; /* nothing to do */
-	else
-		out = reencode_string(commit->buffer,
-				      output_encoding, use_encoding);
+			out = xstrdup(msg);
+		/* otherwise there is nothing to do */
+	} else
+		out = reencode_string(msg, output_encoding, use_encoding);
 	if (out)
 		out = replace_encoding_header(out, output_encoding);
 
+	unuse_commit_buffer(commit, msg);
 	free(encoding);
 	return out;
 }
@@ -1251,6 +1253,7 @@ void format_commit_message(const struct commit *commit,
 {
 	struct format_commit_context context;
 	const char *output_enc = pretty_ctx->output_encoding;
+	const char *msg = get_commit_buffer(commit, NULL);
 
 	memset(&context, 0, sizeof(context));
 	context.commit = commit;
@@ -1258,13 +1261,14 @@ void format_commit_message(const struct commit *commit,
 	context.wrap_start = sb->len;
 	context.message = logmsg_reencode(commit, output_enc);
 	if (!context.message)
-		context.message = commit->buffer;
+		context.message = (char *)msg;
 
 	strbuf_expand(sb, format, format_commit_item, &context);
 	rewrap_message_tail(sb, &context, 0, 0, 0);
 
-	if (context.message != commit->buffer)
+	if (context.message != msg)
 		free(context.message);
+	unuse_commit_buffer(commit, msg);
 	free(context.signature.gpg_output);
 	free(context.signature.signer);
 }
@@ -1411,7 +1415,8 @@ void pretty_print_commit(const struct pretty_print_context *pp,
 {
 	unsigned long beginning_of_body;
 	int indent = 4;
-	const char *msg = commit->buffer;
+	const char *msg;
+	const char *buffer;
 	char *reencoded;
 	const char *encoding;
 	int need_8bit_cte = pp->need_8bit_cte;
@@ -1421,6 +1426,7 @@ void pretty_print_commit(const struct pretty_print_context *pp,
 		return;
 	}
 
+	msg = buffer = get_commit_buffer(commit, NULL);
 	encoding = get_log_output_encoding();
 	reencoded = logmsg_reencode(commit, encoding);
 	if (reencoded) {
@@ -1482,6 +1488,7 @@ void pretty_print_commit(const struct pretty_print_context *pp,
 	if (pp->fmt == CMIT_FMT_EMAIL && sb->len <= beginning_of_body)
 		strbuf_addch(sb, '\n');
 
+	unuse_commit_buffer(commit, buffer);
 	free(reencoded);
 }
 
@@ -3,6 +3,8 @@
 #include "object.h"
 #include "tag.h"
 #include "dir.h"
+#include "packed-refs.h"
+#include "string-list.h"
 
 /*
  * Make sure "ref" is something reasonable to have under ".git/refs/";
@@ -101,6 +103,62 @@ int check_refname_format(const char *refname, int flags)
 
 struct ref_entry;
 
+struct ref_cache;
+
+/*
+ * What a file or directory looked like when it was read: whether it
+ * existed and, if it did, its stat data.  Used to tell whether it has
+ * to be read again.
+ */
+struct ref_validity {
+	enum {
+		REF_VALIDITY_UNKNOWN = 0,
+		REF_VALIDITY_MISSING,
+		REF_VALIDITY_PRESENT
+	} state;
+	time_t read_at;
+	time_t mtime;
+	unsigned int mtime_nsec;
+	off_t size;
+	ino_t ino;
+};
+
+/* Record what path looks like; call this before reading it. */
+static void ref_validity_update(struct ref_validity *v, const char *path)
+{
+	struct stat st;
+
+	if (stat(path, &st)) {
+		v->state = REF_VALIDITY_MISSING;
+		return;
+	}
+	v->state = REF_VALIDITY_PRESENT;
+	v->read_at = time(NULL);
+	v->mtime = st.st_mtime;
+	v->mtime_nsec = ST_MTIME_NSEC(st);
+	v->size = st.st_size;
+	v->ino = st.st_ino;
+}
+
+/* Return 1 if path still looks the way it did when v was recorded. */
+static int ref_validity_check(const struct ref_validity *v, const char *path)
+{
+	struct stat st;
+
+	if (stat(path, &st))
+		return v->state == REF_VALIDITY_MISSING;
+	/*
+	 * A change made within the second the path was read in may not
+	 * show in its timestamp, so such a path is always read again.
+	 */
+	return v->state == REF_VALIDITY_PRESENT &&
+		st.st_mtime < v->read_at &&
+		st.st_mtime == v->mtime &&
+		ST_MTIME_NSEC(st) == v->mtime_nsec &&
+		st.st_size == v->size &&
+		st.st_ino == v->ino;
+}
+
 /*
  * Information used (along with the information in ref_entry) to
  * describe a single cached reference.  This data structure only
@@ -112,8 +170,6 @@ struct ref_value {
 	unsigned char peeled[20];
 };
 
-struct ref_cache;
-
 /*
  * Information used (along with the information in ref_entry) to
  * describe a level in the hierarchy of references.  This data
@@ -139,6 +195,15 @@ struct ref_cache;
  * in that directory are stored, and REF_INCOMPLETE stubs are created
  * for any subdirectories, but the subdirectories themselves are not
  * read.  The reading is triggered by get_ref_dir().
+ *
+ * A directory of loose references remembers the stat data of the
+ * directory it was read from.  The first time it is used by each
+ * lookup or iteration, it is checked against that stat data and read
+ * again if references were created, deleted or updated in it (as
+ * updates rename a lock file over the old file, they change the
+ * directory too).  This way changes made by other processes, e.g.
+ * hooks, are seen without rereading everything, and without a stat()
+ * of every file each time the references are iterated over.
  */
 struct ref_dir {
 	int nr, alloc;
@@ -155,6 +220,15 @@ struct ref_dir {
 	struct ref_cache *ref_cache;
 
 	struct ref_entry **entries;
+
+	/*
+	 * For directories of loose references that have been read:
+	 * what the directory looked like.
+	 */
+	struct ref_validity validity;
+
+	/* The ref_cache generation in which it was last checked. */
+	unsigned int generation;
 };
 
 /* ISSYMREF=0x01, ISPACKED=0x02, and ISBROKEN=0x04 are public interfaces */
@@ -223,12 +297,18 @@ struct ref_entry {
 };
 
 static void read_loose_refs(const char *dirname, struct ref_dir *dir);
+static int loose_dir_is_current(struct ref_entry *entry);
+static void clear_ref_dir(struct ref_dir *dir);
 
 static struct ref_dir *get_ref_dir(struct ref_entry *entry)
 {
 	struct ref_dir *dir;
 	assert(entry->flag & REF_DIR);
 	dir = &entry->u.subdir;
+	if (!(entry->flag & REF_INCOMPLETE) && !loose_dir_is_current(entry)) {
+		clear_ref_dir(dir);
+		entry->flag |= REF_INCOMPLETE;
+	}
 	if (entry->flag & REF_INCOMPLETE) {
 		read_loose_refs(entry->name, dir);
 		entry->flag &= ~REF_INCOMPLETE;
@@ -255,8 +335,6 @@ static struct ref_entry *create_ref_entry(const char *refname,
 	return ref;
 }
 
-static void clear_ref_dir(struct ref_dir *dir);
-
 static void free_ref_entry(struct ref_entry *entry)
 {
 	if (entry->flag & REF_DIR) {
@@ -539,11 +617,10 @@ static int do_for_each_ref_in_dir(struct ref_dir *dir, int offset,
 				  const char *base,
 				  each_ref_fn fn, int trim, int flags, void *cb_data)
 {
-	int i;
+	int i, retval = 0;
 	assert(dir->sorted == dir->nr);
-	for (i = offset; i < dir->nr; i++) {
+	for (i = offset; !retval && i < dir->nr; i++) {
 		struct ref_entry *entry = dir->entries[i];
-		int retval;
 		if (entry->flag & REF_DIR) {
 			struct ref_dir *subdir = get_ref_dir(entry);
 			sort_ref_dir(subdir);
@@ -552,10 +629,8 @@ static int do_for_each_ref_in_dir(struct ref_dir *dir, int offset,
 		} else {
 			retval = do_one_ref(base, fn, trim, flags, cb_data, entry);
 		}
-		if (retval)
-			return retval;
 	}
-	return 0;
+	return retval;
 }
 
 /*
@@ -570,21 +645,23 @@ static int do_for_each_ref_in_dirs(struct ref_dir *dir1,
 				   const char *base, each_ref_fn fn, int trim,
 				   int flags, void *cb_data)
 {
-	int retval;
+	int retval = 0;
 	int i1 = 0, i2 = 0;
 
 	assert(dir1->sorted == dir1->nr);
 	assert(dir2->sorted == dir2->nr);
-	while (1) {
+	while (!retval) {
 		struct ref_entry *e1, *e2;
 		int cmp;
 		if (i1 == dir1->nr) {
-			return do_for_each_ref_in_dir(dir2, i2,
-						      base, fn, trim, flags, cb_data);
+			retval = do_for_each_ref_in_dir(dir2, i2,
+							base, fn, trim, flags, cb_data);
+			break;
 		}
 		if (i2 == dir2->nr) {
-			return do_for_each_ref_in_dir(dir1, i1,
-						      base, fn, trim, flags, cb_data);
+			retval = do_for_each_ref_in_dir(dir1, i1,
+							base, fn, trim, flags, cb_data);
+			break;
 		}
 		e1 = dir1->entries[i1];
 		e2 = dir2->entries[i2];
@@ -629,16 +706,8 @@ static int do_for_each_ref_in_dirs(struct ref_dir *dir1,
 				retval = do_one_ref(base, fn, trim, flags, cb_data, e);
 			}
 		}
-		if (retval)
-			return retval;
-	}
-	if (i1 < dir1->nr)
-		return do_for_each_ref_in_dir(dir1, i1,
-					      base, fn, trim, flags, cb_data);
-	if (i2 < dir2->nr)
-		return do_for_each_ref_in_dir(dir2, i2,
-					      base, fn, trim, flags, cb_data);
-	return 0;
+	}
+	return retval;
 }
 
 /*
@@ -709,16 +778,57 @@ static struct ref_cache {
 	struct ref_cache *next;
 	struct ref_entry *loose;
 	struct ref_entry *packed;
+	/*
+	 * A binary or sorted packed-refs file can be searched in place, so
+	 * single refs are looked up there as long as "packed" has not
+	 * been read in.  packed_table is NULL if the file is missing or
+	 * cannot be searched in place; packed_table_checked says whether
+	 * we looked already.
+	 */
+	struct packed_ref_table *packed_table;
+	int packed_table_checked;
+	/*
+	 * The parts of the packed refs read from packed_table for
+	 * iterations over a prefix, keyed by the prefix.  They are kept
+	 * as long as the rest of the packed refs would be, since callers
+	 * may hold on to the values they were given.
+	 */
+	struct string_list packed_subsets;
+	/*
+	 * What packed-refs looked like when the packed refs were read;
+	 * they are checked against it every time they are used.
+	 */
+	struct ref_validity packed_validity;
+	/*
+	 * Nonzero while the refs are being iterated over; the packed
+	 * refs are then not dropped, even if the file has changed.
+	 */
+	int iterating;
+	/*
+	 * Bumped by every lookup or iteration that is not made from
+	 * within an iteration.  Directories of loose refs are checked
+	 * against the disk only once per generation, so that the entries
+	 * handed out by an iteration are not freed before it is over.
+	 */
+	unsigned int generation;
 	/* The submodule name, or "" for the main repo. */
 	char name[FLEX_ARRAY];
 } *ref_cache;
 
 static void clear_packed_ref_cache(struct ref_cache *refs)
 {
+	int i;
+
 	if (refs->packed) {
 		free_ref_entry(refs->packed);
 		refs->packed = NULL;
 	}
+	for (i = 0; i < refs->packed_subsets.nr; i++)
+		free_ref_entry(refs->packed_subsets.items[i].util);
+	string_list_clear(&refs->packed_subsets, 0);
+	close_packed_ref_table(refs->packed_table);
+	refs->packed_table = NULL;
+	refs->packed_table_checked = 0;
 }
 
 static void clear_loose_ref_cache(struct ref_cache *refs)
@@ -737,6 +847,7 @@ static struct ref_cache *create_ref_cache(const char *submodule)
 		submodule = "";
 	len = strlen(submodule) + 1;
 	refs = xcalloc(1, sizeof(struct ref_cache) + len);
+	refs->packed_subsets.strdup_strings = 1;
 	memcpy(refs->name, submodule, len);
 	return refs;
 }
@@ -838,32 +949,220 @@ static void read_packed_refs(FILE *f, struct ref_dir *dir)
 	}
 }
 
+static const char *packed_refs_path(struct ref_cache *refs)
+{
+	if (*refs->name)
+		return git_path_submodule(refs->name, "packed-refs");
+	else
+		return git_path("packed-refs");
+}
+
+/*
+ * Drop the cached packed refs if the packed-refs file has changed
+ * since they were read.
+ */
+static void validate_packed_ref_cache(struct ref_cache *refs)
+{
+	if (refs->iterating)
+		return;
+	if ((refs->packed || refs->packed_table_checked) &&
+	    !ref_validity_check(&refs->packed_validity,
+				packed_refs_path(refs)))
+		clear_packed_ref_cache(refs);
+}
+
+static struct packed_ref_table *get_packed_ref_table(struct ref_cache *refs)
+{
+	validate_packed_ref_cache(refs);
+	if (!refs->packed_table_checked) {
+		const char *path = packed_refs_path(refs);
+
+		ref_validity_update(&refs->packed_validity, path);
+		refs->packed_table = open_packed_ref_table(path);
+		refs->packed_table_checked = 1;
+	}
+	return refs->packed_table;
+}
+
+struct read_packed_ref_table_cb {
+	struct ref_dir *dir;
+	int flag;
+};
+
+static int read_packed_ref_table_fn(const char *refname,
+				    const unsigned char *sha1,
+				    const unsigned char *peeled, void *cb_data)
+{
+	struct read_packed_ref_table_cb *data = cb_data;
+	struct ref_entry *entry = create_ref_entry(refname, sha1, data->flag, 1);
+
+	if (peeled)
+		hashcpy(entry->u.value.peeled, peeled);
+	add_ref(data->dir, entry);
+	return 0;
+}
+
+/*
+ * Read the refs whose names start with prefix from a searchable
+ * packed-refs file into dir.
+ */
+static void read_packed_ref_table(struct packed_ref_table *table,
+				  const char *prefix, struct ref_dir *dir)
+{
+	struct read_packed_ref_table_cb data;
+
+	data.dir = dir;
+	data.flag = REF_ISPACKED;
+	if (table->flags & PACKED_REFS_PEELED)
+		data.flag |= REF_KNOWS_PEELED;
+	for_each_packed_ref_in_table(table, prefix,
+				     read_packed_ref_table_fn, &data);
+}
+
+/*
+ * Return a directory tree holding the packed refs whose names start
+ * with prefix, read from table.
+ */
+static struct ref_dir *get_packed_subset(struct ref_cache *refs,
+					 struct packed_ref_table *table,
+					 const char *prefix)
+{
+	struct string_list_item *item;
+
+	item = string_list_insert(&refs->packed_subsets, prefix);
+	if (!item->util) {
+		struct ref_entry *subset = create_dir_entry(refs, "", 0, 0);
+
+		read_packed_ref_table(table, prefix, get_ref_dir(subset));
+		item->util = subset;
+	}
+	return get_ref_dir(item->util);
+}
+
 static struct ref_dir *get_packed_refs(struct ref_cache *refs)
 {
+	validate_packed_ref_cache(refs);
 	if (!refs->packed) {
-		const char *packed_refs_file;
+		struct packed_ref_table *table = get_packed_ref_table(refs);
 		FILE *f;
 
 		refs->packed = create_dir_entry(refs, "", 0, 0);
-		if (*refs->name)
-			packed_refs_file = git_path_submodule(refs->name, "packed-refs");
-		else
-			packed_refs_file = git_path("packed-refs");
-		f = fopen(packed_refs_file, "r");
-		if (f) {
-			read_packed_refs(f, get_ref_dir(refs->packed));
-			fclose(f);
+		if (table) {
+			read_packed_ref_table(table, "", get_ref_dir(refs->packed));
+		} else {
+			f = fopen(packed_refs_path(refs), "r");
+			if (f) {
+				read_packed_refs(f, get_ref_dir(refs->packed));
+				fclose(f);
+			}
 		}
 	}
 	return get_ref_dir(refs->packed);
 }
 
+/*
+ * Look up refname among the packed refs, without reading all of them
+ * if the packed-refs file can be searched in place.  On success, fill
+ * in value and return the flags of the ref; otherwise return -1.
+ */
+static int find_packed_ref(struct ref_cache *refs, const char *refname,
+			   struct ref_value *value)
+{
+	struct packed_ref_table *table;
+	struct ref_entry *entry;
+
+	validate_packed_ref_cache(refs);
+	if (!refs->packed && (table = get_packed_ref_table(refs)) != NULL) {
+		if (packed_ref_table_lookup(table, refname,
+					    value->sha1, value->peeled))
+			return -1;
+		return REF_ISPACKED |
+			(table->flags & PACKED_REFS_PEELED ? REF_KNOWS_PEELED : 0);
+	}
+
+	entry = find_ref(get_packed_refs(refs), refname);
+	if (!entry)
+		return -1;
+	*value = entry->u.value;
+	return entry->flag;
+}
+
+static int packed_name_conflict_fn(const char *existingrefname,
+				   const unsigned char *sha1,
+				   const unsigned char *peeled, void *cb_data)
+{
+	struct name_conflict_cb *data = cb_data;
+
+	if (data->oldrefname && !strcmp(data->oldrefname, existingrefname))
+		return 0;
+	error("'%s' exists; cannot create '%s'", existingrefname, data->refname);
+	return 1;
+}
+
+/*
+ * is_refname_available() for the packed refs.  If the packed-refs
+ * file can be searched in place, only look up the refs that could
+ * conflict with refname.
+ */
+static int is_packed_refname_available(struct ref_cache *refs,
+				       const char *refname,
+				       const char *oldrefname)
+{
+	struct packed_ref_table *table;
+	struct name_conflict_cb data;
+	struct strbuf dirname = STRBUF_INIT;
+	struct ref_value value;
+	const char *slash;
+	int ret = 1;
+
+	validate_packed_ref_cache(refs);
+	if (refs->packed || !(table = get_packed_ref_table(refs)))
+		return is_refname_available(refname, oldrefname,
+					    get_packed_refs(refs));
+
+	/* a ref named like one of the leading directories of refname */
+	for (slash = strchr(refname, '/'); slash; slash = strchr(slash + 1, '/')) {
+		strbuf_reset(&dirname);
+		strbuf_add(&dirname, refname, slash - refname);
+		if (oldrefname && !strcmp(dirname.buf, oldrefname))
+			continue;
+		if (!packed_ref_table_lookup(table, dirname.buf,
+					     value.sha1, value.peeled)) {
+			error("'%s' exists; cannot create '%s'",
+			      dirname.buf, refname);
+			ret = 0;
+			goto out;
+		}
+	}
+
+	/* refs inside of a directory named refname */
+	strbuf_reset(&dirname);
+	strbuf_addf(&dirname, "%s/", refname);
+	data.refname = refname;
+	data.oldrefname = oldrefname;
+	data.conflicting_refname = NULL;
+	if (for_each_packed_ref_in_table(table, dirname.buf,
+					 packed_name_conflict_fn, &data))
+		ret = 0;
+out:
+	strbuf_release(&dirname);
+	return ret;
+}
+
 void add_packed_ref(const char *refname, const unsigned char *sha1)
 {
 	add_ref(get_packed_refs(get_ref_cache(NULL)),
 			create_ref_entry(refname, sha1, REF_ISPACKED, 1));
 }
 
+static const char *loose_ref_path(struct ref_cache *refs, const char *name)
+{
+	if (*refs->name)
+		return git_path_submodule(refs->name, "%s", name);
+	else
+		return git_path("%s", name);
+}
+
 /*
  * Read the loose references from the namespace dirname into dir
  * (without recursing).  dirname must end with '/'.  dir must be the
@@ -878,10 +1177,9 @@ static void read_loose_refs(const char *dirname, struct ref_dir *dir)
 	int dirnamelen = strlen(dirname);
 	struct strbuf refname;
 
-	if (*refs->name)
-		path = git_path_submodule(refs->name, "%s", dirname);
-	else
-		path = git_path("%s", dirname);
+	path = loose_ref_path(refs, dirname);
+	ref_validity_update(&dir->validity, path);
+	dir->generation = refs->generation;
 
 	d = opendir(path);
 	if (!d)
@@ -901,9 +1199,7 @@ static void read_loose_refs(const char *dirname, struct ref_dir *dir)
 		if (has_extension(de->d_name, ".lock"))
 			continue;
 		strbuf_addstr(&refname, de->d_name);
-		refdir = *refs->name
-			? git_path_submodule(refs->name, "%s", refname.buf)
-			: git_path("%s", refname.buf);
+		refdir = loose_ref_path(refs, refname.buf);
 		if (stat(refdir, &st) < 0) {
 			; /* silently ignore */
 		} else if (S_ISDIR(st.st_mode)) {
@@ -932,8 +1228,27 @@ static void read_loose_refs(const char *dirname, struct ref_dir *dir)
 	closedir(d);
 }
 
+/*
+ * Return 0 if entry is a directory of loose refs that has changed on
+ * disk since it was read.  It is checked only once per generation.
+ */
+static int loose_dir_is_current(struct ref_entry *entry)
+{
+	struct ref_dir *dir = &entry->u.subdir;
+	struct ref_cache *refs = dir->ref_cache;
+
+	if (dir->validity.state == REF_VALIDITY_UNKNOWN ||
+	    dir->generation == refs->generation)
+		return 1;
+	dir->generation = refs->generation;
+	return ref_validity_check(&dir->validity,
+				  loose_ref_path(refs, entry->name));
+}
+
 static struct ref_dir *get_loose_refs(struct ref_cache *refs)
 {
+	if (!refs->iterating)
+		refs->generation++;
 	if (!refs->loose) {
 		/*
 		 * Mark the top-level directory complete because we
@@ -962,14 +1277,12 @@ static struct ref_dir *get_loose_refs(struct ref_cache *refs)
 static int resolve_gitlink_packed_ref(struct ref_cache *refs,
 				      const char *refname, unsigned char *sha1)
 {
-	struct ref_entry *ref;
-	struct ref_dir *dir = get_packed_refs(refs);
+	struct ref_value value;
 
-	ref = find_ref(dir, refname);
-	if (ref == NULL)
+	if (find_packed_ref(refs, refname, &value) < 0)
 		return -1;
 
-	memcpy(sha1, ref->u.value.sha1, 20);
+	memcpy(sha1, value.sha1, 20);
 	return 0;
 }
 
@@ -1036,10 +1349,10 @@ int resolve_gitlink_ref(const char *path, const char *refname, unsigned char *sh
  */
 static int get_packed_ref(const char *refname, unsigned char *sha1)
 {
-	struct ref_dir *packed = get_packed_refs(get_ref_cache(NULL));
-	struct ref_entry *entry = find_ref(packed, refname);
-	if (entry) {
-		hashcpy(sha1, entry->u.value.sha1);
+	struct ref_value value;
+
+	if (find_packed_ref(get_ref_cache(NULL), refname, &value) >= 0) {
+		hashcpy(sha1, value.sha1);
 		return 0;
 	}
 	return -1;
@@ -1215,11 +1528,12 @@ int peel_ref(const char *refname, unsigned char *sha1)
 		return -1;
 
 	if ((flag & REF_ISPACKED)) {
-		struct ref_dir *dir = get_packed_refs(get_ref_cache(NULL));
-		struct ref_entry *r = find_ref(dir, refname);
+		struct ref_value value;
+		int packed_flag = find_packed_ref(get_ref_cache(NULL),
+						  refname, &value);
 
-		if (r != NULL && r->flag & REF_KNOWS_PEELED) {
-			hashcpy(sha1, r->u.value.peeled);
+		if (packed_flag >= 0 && packed_flag & REF_KNOWS_PEELED) {
+			hashcpy(sha1, value.peeled);
 			return 0;
 		}
 	}
@@ -1282,15 +1596,28 @@ static int do_for_each_ref(const char *submodule, const char *base, each_ref_fn
 			   int trim, int flags, void *cb_data)
 {
 	struct ref_cache *refs = get_ref_cache(submodule);
-	struct ref_dir *packed_dir = get_packed_refs(refs);
-	struct ref_dir *loose_dir = get_loose_refs(refs);
+	struct ref_dir *packed_dir, *loose_dir;
+	struct packed_ref_table *table;
 	int retval = 0;
 
+	/*
+	 * Iterating over part of the refs in a searchable packed-refs file
+	 * reads only that part.
+	 */
+	validate_packed_ref_cache(refs);
+	if (base && *base && !refs->packed &&
+	    (table = get_packed_ref_table(refs)) != NULL)
+		packed_dir = get_packed_subset(refs, table, base);
+	else
+		packed_dir = get_packed_refs(refs);
+	loose_dir = get_loose_refs(refs);
+
 	if (base && *base) {
 		packed_dir = find_containing_dir(packed_dir, base, 0);
 		loose_dir = find_containing_dir(loose_dir, base, 0);
 	}
 
+	refs->iterating++;
 	if (packed_dir && loose_dir) {
 		sort_ref_dir(packed_dir);
 		sort_ref_dir(loose_dir);
@@ -1308,6 +1635,7 @@ static int do_for_each_ref(const char *submodule, const char *base, each_ref_fn
 				loose_dir, 0,
 				base, fn, trim, flags, cb_data);
 	}
+	refs->iterating--;
 
 	return retval;
 }
@@ -1421,6 +1749,23 @@ int for_each_namespaced_ref(each_ref_fn fn, void *cb_data)
 	return ret;
 }
 
+int for_each_namespaced_ref_in(const char *prefix, each_ref_fn fn, void *cb_data)
+{
+	struct strbuf buf = STRBUF_INIT;
+	int ret;
+
+	/* only refs under "refs/" are namespaced */
+	if (prefixcmp(prefix, "refs/")) {
+		if (prefixcmp("refs/", prefix))
+			return 0;
+		prefix = "refs/";
+	}
+	strbuf_addf(&buf, "%s%s", get_git_namespace(), prefix);
+	ret = do_for_each_ref(NULL, buf.buf, fn, 0, 0, cb_data);
+	strbuf_release(&buf);
+	return ret;
+}
+
 int for_each_glob_ref_in(each_ref_fn fn, const char *pattern,
 	const char *prefix, void *cb_data)
 {
@@ -1462,6 +1807,12 @@ int for_each_rawref(each_ref_fn fn, void *cb_data)
 			       DO_FOR_EACH_INCLUDE_BROKEN, cb_data);
 }
 
+int for_each_rawref_in(const char *prefix, each_ref_fn fn, void *cb_data)
+{
+	return do_for_each_ref(NULL, prefix, fn, 0,
+			       DO_FOR_EACH_INCLUDE_BROKEN, cb_data);
+}
+
 const char *prettify_refname(const char *name)
 {
 	return name + (
@@ -1664,7 +2015,7 @@ static struct ref_lock *lock_ref_sha1_basic(const char *refname,
 	 * name is a proper prefix of our refname.
 	 */
 	if (missing &&
-	     !is_refname_available(refname, NULL, get_packed_refs(get_ref_cache(NULL)))) {
+	     !is_packed_refname_available(get_ref_cache(NULL), refname, NULL)) {
 		last_errno = ENOTDIR;
 		goto error_return;
 	}
@@ -1716,68 +2067,98 @@ struct ref_lock *lock_any_ref_for_update(const char *refname,
 	return lock_ref_sha1_basic(refname, old_sha1, flags, NULL);
 }
 
-struct repack_without_ref_sb {
-	const char *refname;
-	int fd;
+struct repack_without_refs_sb {
+	struct string_list *refnames;
+	struct packed_refs_writer writer;
 };
 
 static int repack_without_ref_fn(const char *refname, const unsigned char *sha1,
 				 int flags, void *cb_data)
 {
-	struct repack_without_ref_sb *data = cb_data;
-	char line[PATH_MAX + 100];
-	int len;
+	struct repack_without_refs_sb *data = cb_data;
 
-	if (!strcmp(data->refname, refname))
+	if (string_list_has_string(data->refnames, refname))
 		return 0;
-	len = snprintf(line, sizeof(line), "%s %s\n",
-		       sha1_to_hex(sha1), refname);
-	/* this should not happen but just being defensive */
-	if (len > sizeof(line))
-		die("too long a refname '%s'", refname);
-	write_or_die(data->fd, line, len);
+	packed_refs_writer_add(&data->writer, refname, sha1, NULL);
 	return 0;
 }
 
 static struct lock_file packlock;
 
-static int repack_without_ref(const char *refname)
+/*
+ * Rewrite the packed-refs file once, leaving out all of the n refs
+ * in refnames.
+ */
+static int repack_without_refs(const char **refnames, int n)
 {
-	struct repack_without_ref_sb data;
+	struct repack_without_refs_sb data;
+	struct string_list names = STRING_LIST_INIT_NODUP;
 	struct ref_cache *refs = get_ref_cache(NULL);
-	struct ref_dir *packed = get_packed_refs(refs);
-	if (find_ref(packed, refname) == NULL)
+	struct ref_dir *packed;
+	struct packed_ref_table *table;
+	enum packed_refs_format format;
+	struct ref_value value;
+	int i, fd;
+
+	for (i = 0; i < n; i++)
+		if (find_packed_ref(refs, refnames[i], &value) >= 0)
+			string_list_insert(&names, refnames[i]);
+	if (!names.nr)
 		return 0;
-	data.refname = refname;
-	data.fd = hold_lock_file_for_update(&packlock, git_path("packed-refs"), 0);
-	if (data.fd < 0) {
+	fd = hold_lock_file_for_update(&packlock, git_path("packed-refs"), 0);
+	if (fd < 0) {
 		unable_to_lock_error(git_path("packed-refs"), errno);
-		return error("cannot delete '%s' from packed refs", refname);
+		error("cannot delete '%s' from packed refs",
+		      names.items[0].string);
+		string_list_clear(&names, 0);
+		return -1;
 	}
 	clear_packed_ref_cache(refs);
+	/* keep the file in the format it is in */
+	table = get_packed_ref_table(refs);
+	format = table ? table->format : PACKED_REFS_TEXT;
 	packed = get_packed_refs(refs);
+	data.refnames = &names;
+	packed_refs_writer_begin(&data.writer, fd, packlock.filename, format, 0);
 	do_for_each_ref_in_dir(packed, 0, "", repack_without_ref_fn, 0, 0, &data);
+	packed_refs_writer_end(&data.writer, 0);
+	packlock.fd = -1;
+	string_list_clear(&names, 0);
+	/* the old file must not stay mapped while it is replaced */
+	clear_packed_ref_cache(refs);
 	return commit_lock_file(&packlock);
 }
 
-int delete_ref(const char *refname, const unsigned char *sha1, int delopt)
+static int repack_without_ref(const char *refname)
 {
-	struct ref_lock *lock;
-	int err, i = 0, ret = 0, flag = 0;
+	return repack_without_refs(&refname, 1);
+}
 
-	lock = lock_ref_sha1_basic(refname, sha1, delopt, &flag);
-	if (!lock)
-		return 1;
+static int delete_ref_loose(struct ref_lock *lock, int flag)
+{
 	if (!(flag & REF_ISPACKED) || flag & REF_ISSYMREF) {
 		/* loose */
-		i = strlen(lock->lk->filename) - 5; /* .lock */
+		int err, i = strlen(lock->lk->filename) - 5; /* .lock */
+
 		lock->lk->filename[i] = 0;
 		err = unlink_or_warn(lock->lk->filename);
-		if (err && errno != ENOENT)
-			ret = 1;
-
 		lock->lk->filename[i] = '.';
+		if (err && errno != ENOENT)
+			return 1;
 	}
+	return 0;
+}
+
+int delete_ref(const char *refname, const unsigned char *sha1, int delopt)
+{
+	struct ref_lock *lock;
+	int ret = 0, flag = 0;
+
+	lock = lock_ref_sha1_basic(refname, sha1, delopt, &flag);
+	if (!lock)
+		return 1;
+	ret |= delete_ref_loose(lock, flag);
+
 	/* removing the loose one could have resurrected an earlier
 	 * packed one.  Also, if it was not loose we need to repack
 	 * without it.
@@ -1785,7 +2166,6 @@ int delete_ref(const char *refname, const unsigned char *sha1, int delopt)
 	ret |= repack_without_ref(lock->ref_name);
 
 	unlink_or_warn(git_path("logs/%s", lock->ref_name));
-	invalidate_ref_cache(NULL);
 	unlock_ref(lock);
 	return ret;
 }
@@ -1819,7 +2199,7 @@ int rename_ref(const char *oldrefname, const char *newrefname, const char *logms
 	if (!symref)
 		return error("refname %s not found", oldrefname);
 
-	if (!is_refname_available(newrefname, oldrefname, get_packed_refs(refs)))
+	if (!is_packed_refname_available(refs, newrefname, oldrefname))
 		return 1;
 
 	if (!is_refname_available(newrefname, oldrefname, get_loose_refs(refs)))
@@ -2046,45 +2426,44 @@ static int is_branch(const char *refname)
 	return !strcmp(refname, "HEAD") || !prefixcmp(refname, "refs/heads/");
 }
 
-int write_ref_sha1(struct ref_lock *lock,
-	const unsigned char *sha1, const char *logmsg)
+/*
+ * Check that sha1 may be stored in the ref held by lock and write it
+ * to the lock file.  Return 1 if the ref already has that value and
+ * nothing needs to be written, and -1 on errors.  The lock is kept
+ * either way.
+ */
+static int write_ref_lock(struct ref_lock *lock, const unsigned char *sha1)
 {
 	static char term = '\n';
 	struct object *o;
 
-	if (!lock)
-		return -1;
-	if (!lock->force_write && !hashcmp(lock->old_sha1, sha1)) {
-		unlock_ref(lock);
-		return 0;
-	}
+	if (!lock->force_write && !hashcmp(lock->old_sha1, sha1))
+		return 1;
 	o = parse_object(sha1);
-	if (!o) {
-		error("Trying to write ref %s with nonexistent object %s",
-			lock->ref_name, sha1_to_hex(sha1));
-		unlock_ref(lock);
-		return -1;
-	}
-	if (o->type != OBJ_COMMIT && is_branch(lock->ref_name)) {
-		error("Trying to write non-commit object %s to branch %s",
-			sha1_to_hex(sha1), lock->ref_name);
-		unlock_ref(lock);
-		return -1;
-	}
+	if (!o)
+		return error("Trying to write ref %s with nonexistent object %s",
+			     lock->ref_name, sha1_to_hex(sha1));
+	if (o->type != OBJ_COMMIT && is_branch(lock->ref_name))
+		return error("Trying to write non-commit object %s to branch %s",
+			     sha1_to_hex(sha1), lock->ref_name);
 	if (write_in_full(lock->lock_fd, sha1_to_hex(sha1), 40) != 40 ||
 	    write_in_full(lock->lock_fd, &term, 1) != 1
-		|| close_ref(lock) < 0) {
-		error("Couldn't write %s", lock->lk->filename);
-		unlock_ref(lock);
-		return -1;
-	}
-	clear_loose_ref_cache(get_ref_cache(NULL));
+		|| close_ref(lock) < 0)
+		return error("Couldn't write %s", lock->lk->filename);
+	return 0;
+}
+
+/*
+ * Log the update of a ref written by write_ref_lock() and move the
+ * lock file into place.
+ */
+static int commit_ref_lock(struct ref_lock *lock,
+			   const unsigned char *sha1, const char *logmsg)
+{
 	if (log_ref_write(lock->ref_name, lock->old_sha1, sha1, logmsg) < 0 ||
 	    (strcmp(lock->ref_name, lock->orig_ref_name) &&
-	     log_ref_write(lock->orig_ref_name, lock->old_sha1, sha1, logmsg) < 0)) {
-		unlock_ref(lock);
+	     log_ref_write(lock->orig_ref_name, lock->old_sha1, sha1, logmsg) < 0))
 		return -1;
-	}
 	if (strcmp(lock->orig_ref_name, "HEAD") != 0) {
 		/*
 		 * Special hack: If a branch is updated directly and HEAD
@@ -2106,13 +2485,23 @@ int write_ref_sha1(struct ref_lock *lock,
 		    !strcmp(head_ref, lock->ref_name))
 			log_ref_write("HEAD", lock->old_sha1, sha1, logmsg);
 	}
-	if (commit_ref(lock)) {
-		error("Couldn't set %s", lock->ref_name);
-		unlock_ref(lock);
+	if (commit_ref(lock))
+		return error("Couldn't set %s", lock->ref_name);
+	return 0;
+}
+
+int write_ref_sha1(struct ref_lock *lock,
+	const unsigned char *sha1, const char *logmsg)
+{
+	int ret;
+
+	if (!lock)
 		return -1;
-	}
+	ret = write_ref_lock(lock, sha1);
+	if (!ret)
+		ret = commit_ref_lock(lock, sha1, logmsg);
 	unlock_ref(lock);
-	return 0;
+	return ret < 0 ? -1 : 0;
 }
 
 int create_symref(const char *ref_target, const char *refs_heads_master,
@@ -2412,31 +2801,137 @@ int for_each_reflog(each_ref_fn fn, void *cb_data)
 	return retval;
 }
 
+static int update_ref_error(enum action_on_err onerr,
+			    const char *str, const char *refname)
+{
+	switch (onerr) {
+	case MSG_ON_ERR: error(str, refname); break;
+	case DIE_ON_ERR: die(str, refname); break;
+	case QUIET_ON_ERR: break;
+	}
+	return 1;
+}
+
 int update_ref(const char *action, const char *refname,
 		const unsigned char *sha1, const unsigned char *oldval,
 		int flags, enum action_on_err onerr)
 {
 	static struct ref_lock *lock;
 	lock = lock_any_ref_for_update(refname, oldval, flags);
-	if (!lock) {
-		const char *str = "Cannot lock the ref '%s'.";
-		switch (onerr) {
-		case MSG_ON_ERR: error(str, refname); break;
-		case DIE_ON_ERR: die(str, refname); break;
-		case QUIET_ON_ERR: break;
+	if (!lock)
+		return update_ref_error(onerr, "Cannot lock the ref '%s'.",
+					refname);
+	if (write_ref_sha1(lock, sha1, action) < 0)
+		return update_ref_error(onerr, "Cannot update the ref '%s'.",
+					refname);
+	return 0;
+}
+
+static int ref_update_compare(const void *r1, const void *r2)
+{
+	const struct ref_update * const *u1 = r1;
+	const struct ref_update * const *u2 = r2;
+	return strcmp((*u1)->ref_name, (*u2)->ref_name);
+}
+
+int update_refs(const char *action, struct ref_update **updates_orig,
+		int n, enum action_on_err onerr)
+{
+	struct ref_update **updates;
+	struct ref_lock **locks;
+	const char **delnames;
+	int *types, *unchanged;
+	int ret = 0, delnum = 0, i;
+
+	if (!n)
+		return 0;
+
+	/* Sort the updates so that duplicates are next to each other */
+	updates = xmalloc(sizeof(*updates) * n);
+	memcpy(updates, updates_orig, sizeof(*updates) * n);
+	qsort(updates, n, sizeof(*updates), ref_update_compare);
+	locks = xcalloc(n, sizeof(*locks));
+	types = xcalloc(n, sizeof(*types));
+	unchanged = xcalloc(n, sizeof(*unchanged));
+	delnames = xmalloc(sizeof(*delnames) * n);
+
+	for (i = 1; i < n; i++)
+		if (!strcmp(updates[i - 1]->ref_name, updates[i]->ref_name)) {
+			ret = update_ref_error(onerr,
+				"Multiple updates for ref '%s' not allowed.",
+				updates[i]->ref_name);
+			goto cleanup;
+		}
+
+	/* Take all the locks, verifying the old values */
+	for (i = 0; i < n; i++) {
+		struct ref_update *u = updates[i];
+
+		if (check_refname_format(u->ref_name, REFNAME_ALLOW_ONELEVEL) ||
+		    !(locks[i] = lock_ref_sha1_basic(u->ref_name,
+						     u->have_old ? u->old_sha1 : NULL,
+						     u->flags, &types[i]))) {
+			ret = update_ref_error(onerr, "Cannot lock the ref '%s'.",
+					       u->ref_name);
+			goto cleanup;
 		}
-		return 1;
 	}
-	if (write_ref_sha1(lock, sha1, action) < 0) {
-		const char *str = "Cannot update the ref '%s'.";
-		switch (onerr) {
-		case MSG_ON_ERR: error(str, refname); break;
-		case DIE_ON_ERR: die(str, refname); break;
-		case QUIET_ON_ERR: break;
+
+	/* Write the new values to the lock files before touching any ref */
+	for (i = 0; i < n; i++) {
+		struct ref_update *u = updates[i];
+		int status;
+
+		if (!u->have_new)
+			continue;
+		if (is_null_sha1(u->new_sha1)) {
+			delnames[delnum++] = locks[i]->ref_name;
+			continue;
 		}
-		return 1;
+		status = write_ref_lock(locks[i], u->new_sha1);
+		if (status < 0) {
+			ret = update_ref_error(onerr,
+					       "Cannot update the ref '%s'.",
+					       u->ref_name);
+			goto cleanup;
+		}
+		unchanged[i] = status;
 	}
-	return 0;
+
+	/*
+	 * Nothing can be rejected from here on.  Remove the deleted refs
+	 * from packed-refs with a single rewrite, then move the new
+	 * values into place.
+	 */
+	if (repack_without_refs(delnames, delnum)) {
+		ret = update_ref_error(onerr, "Cannot delete the ref '%s'.",
+				       delnames[0]);
+		goto cleanup;
+	}
+	for (i = 0; i < n; i++) {
+		struct ref_update *u = updates[i];
+
+		if (!u->have_new || unchanged[i])
+			continue;
+		if (is_null_sha1(u->new_sha1)) {
+			ret |= delete_ref_loose(locks[i], types[i]);
+			unlink_or_warn(git_path("logs/%s", locks[i]->ref_name));
+		} else if (commit_ref_lock(locks[i], u->new_sha1, action)) {
+			ret |= update_ref_error(onerr,
+						"Cannot update the ref '%s'.",
+						u->ref_name);
+		}
+	}
+cleanup:
+	for (i = 0; i < n; i++)
+		if (locks[i])
+			unlock_ref(locks[i]);
+	free(updates);
+	free(locks);
+	free(types);
+	free(unchanged);
+	free(delnames);
+	return ret;
 }
 
 struct ref *find_ref_by_name(const struct ref *list, const char *name)
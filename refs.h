@@ -19,7 +19,9 @@ struct ref_lock {
  * nonzero, and returns the value.  Please note that it is not safe to
  * modify references while an iteration is in progress, unless the
  * same callback function invocation that modifies the reference also
- * returns a nonzero value to immediately stop the iteration.
+ * returns a nonzero value to immediately stop the iteration.  The
+ * refname and sha1 passed to the function are only valid until the
+ * iteration returns; copy them if they are needed after that.
  */
 typedef int each_ref_fn(const char *refname, const unsigned char *sha1, int flags, void *cb_data);
 extern int head_ref(each_ref_fn, void *);
@@ -42,6 +44,8 @@ extern int for_each_remote_ref_submodule(const char *submodule, each_ref_fn fn,
 
 extern int head_ref_namespaced(each_ref_fn fn, void *cb_data);
 extern int for_each_namespaced_ref(each_ref_fn fn, void *cb_data);
+/* Like for_each_namespaced_ref(), but only for refs starting with prefix */
+extern int for_each_namespaced_ref_in(const char *prefix, each_ref_fn fn, void *cb_data);
 
 static inline const char *has_glob_specials(const char *pattern)
 {
@@ -50,6 +54,7 @@ static inline const char *has_glob_specials(const char *pattern)
 
 /* can be used to learn about broken ref and symref */
 extern int for_each_rawref(each_ref_fn, void *);
+extern int for_each_rawref_in(const char *prefix, each_ref_fn, void *);
 
 extern void warn_dangling_symref(FILE *fp, const char *msg_fmt, const char *refname);
 
@@ -85,10 +90,12 @@ extern void unlock_ref(struct ref_lock *lock);
 extern int write_ref_sha1(struct ref_lock *lock, const unsigned char *sha1, const char *msg);
 
 /*
- * Invalidate the reference cache for the specified submodule.  Use
- * submodule=NULL to invalidate the cache for the main module.  This
- * function must be called if references are changed via a mechanism
- * other than the refs API.
+ * Throw away the reference cache for the specified submodule.  Use
+ * submodule=NULL for the main module.  The cache checks the stat data
+ * of packed-refs, of each directory of loose refs and of each loose
+ * ref every time it uses them, so changes made by other processes are
+ * seen without calling this; it is needed only to release the cache,
+ * e.g. before replacing the packed-refs file it may have mapped.
  */
 extern void invalidate_ref_cache(const char *submodule);
 
@@ -147,4 +154,28 @@ int update_ref(const char *action, const char *refname,
 		const unsigned char *sha1, const unsigned char *oldval,
 		int flags, enum action_on_err onerr);
 
+/*
+ * A single change to a ref, as part of a set passed to update_refs().
+ * A null new_sha1 deletes the ref; without have_new, the old value is
+ * only verified.  With have_old, the ref must have the value old_sha1
+ * (or must not exist, if old_sha1 is null).
+ */
+struct ref_update {
+	const char *ref_name;
+	unsigned char new_sha1[20];
+	unsigned char old_sha1[20];
+	int flags; /* REF_NODEREF? */
+	int have_new;
+	int have_old;
+};
+
+/**
+ * Lock all the refs named by updates, verify their old values and
+ * then apply all the updates, rewriting packed-refs at most once for
+ * all the deletions.  Nothing is changed if a ref cannot be locked,
+ * does not have the expected value, or cannot take its new value.
+ */
+int update_refs(const char *action, struct ref_update **updates,
+		int n, enum action_on_err onerr);
+
 #endif /* REFS_H */
@@ -2222,10 +2222,13 @@ static int rewrite_parents(struct rev_info *revs, struct commit *commit)
 static int commit_match(struct commit *commit, struct rev_info *opt)
 {
 	int retval;
+	const char *msg;
 	struct strbuf buf = STRBUF_INIT;
 	if (!opt->grep_filter.pattern_list && !opt->grep_filter.header_list)
 		return 1;
 
+	msg = get_commit_buffer(commit, NULL);
+
 	/* Prepend "fake" headers as needed */
 	if (opt->grep_filter.use_reflog_filter) {
 		strbuf_addstr(&buf, "reflog ");
@@ -2235,12 +2238,12 @@ static int commit_match(struct commit *commit, struct rev_info *opt)
 
 	/* Copy the commit to temporary if we are using "fake" headers */
 	if (buf.len)
-		strbuf_addstr(&buf, commit->buffer);
+		strbuf_addstr(&buf, msg);
 
 	/* Append "fake" message parts as needed */
 	if (opt->show_notes) {
 		if (!buf.len)
-			strbuf_addstr(&buf, commit->buffer);
+			strbuf_addstr(&buf, msg);
 		format_display_notes(commit->object.sha1, &buf,
 				     get_log_output_encoding(), 1);
 	}
@@ -2250,8 +2253,9 @@ static int commit_match(struct commit *commit, struct rev_info *opt)
 		retval = grep_buffer(&opt->grep_filter, buf.buf, buf.len);
 	else
 		retval = grep_buffer(&opt->grep_filter,
-				     commit->buffer, strlen(commit->buffer));
+				     (char *)msg, strlen(msg));
 	strbuf_release(&buf);
+	unuse_commit_buffer(commit, msg);
 	return retval;
 }
 
@@ -41,6 +41,7 @@ struct commit_message {
 	const char *subject;
 	char *reencoded_message;
 	const char *message;
+	const char *buffer;
 };
 
 static int get_message(struct commit *commit, struct commit_message *out)
@@ -50,18 +51,17 @@ static int get_message(struct commit *commit, struct commit_message *out)
 	int abbrev_len, subject_len;
 	char *q;
 
-	if (!commit->buffer)
-		return -1;
-	encoding = get_encoding(commit->buffer);
+	out->buffer = get_commit_buffer(commit, NULL);
+	encoding = get_encoding(out->buffer);
 	if (!encoding)
 		encoding = "UTF-8";
 	if (!git_commit_encoding)
 		git_commit_encoding = "UTF-8";
 
 	out->reencoded_message = NULL;
-	out->message = commit->buffer;
+	out->message = out->buffer;
 	if (same_encoding(encoding, git_commit_encoding))
-		out->reencoded_message = reencode_string(commit->buffer,
+		out->reencoded_message = reencode_string(out->buffer,
 					git_commit_encoding, encoding);
 	if (out->reencoded_message)
 		out->message = out->reencoded_message;
@@ -84,10 +84,11 @@ static int get_message(struct commit *commit, struct commit_message *out)
 	return 0;
 }
 
-static void free_message(struct commit_message *msg)
+static void free_message(struct commit *commit, struct commit_message *msg)
 {
 	free(msg->parent_label);
 	free(msg->reencoded_message);
+	unuse_commit_buffer(commit, msg->buffer);
 }
 
 static char *get_encoding(const char *message)
@@ -543,7 +544,7 @@ static int do_pick_commit(struct commit *commit, struct replay_opts *opts)
 			res = run_git_commit(defmsg, opts, allow);
 	}
 
-	free_message(&msg);
+	free_message(commit, &msg);
 	free(defmsg);
 
 	return res;
@@ -590,10 +591,12 @@ static int format_todo(struct strbuf *buf, struct commit_list *todo_list,
 	int subject_len;
 
 	for (cur = todo_list; cur; cur = cur->next) {
+		const char *commit_buffer = get_commit_buffer(cur->item, NULL);
 		sha1_abbrev = find_unique_abbrev(cur->item->object.sha1, DEFAULT_ABBREV);
-		subject_len = find_commit_subject(cur->item->buffer, &subject);
+		subject_len = find_commit_subject(commit_buffer, &subject);
 		strbuf_addf(buf, "%s %s %.*s\n", action_str, sha1_abbrev,
 			subject_len, subject);
+		unuse_commit_buffer(cur->item, commit_buffer);
 	}
 	return 0;
 }
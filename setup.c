@@ -355,6 +355,8 @@ void setup_work_tree(void)
 	initialized = 1;
 }
 
+static struct string_list unknown_extensions = STRING_LIST_INIT_DUP;
+
 static int check_repository_format_gently(const char *gitdir, int *nongit_ok)
 {
 	char repo_config[PATH_MAX+1];
@@ -369,13 +371,25 @@ static int check_repository_format_gently(const char *gitdir, int *nongit_ok)
 	 * is a good one.
 	 */
 	snprintf(repo_config, PATH_MAX, "%s/config", gitdir);
+	string_list_clear(&unknown_extensions, 0);
 	git_config_early(check_repository_format_version, NULL, repo_config);
-	if (GIT_REPO_VERSION < repository_format_version) {
+	if (GIT_REPO_VERSION_READ < repository_format_version) {
 		if (!nongit_ok)
 			die ("Expected git repo version <= %d, found %d",
-			     GIT_REPO_VERSION, repository_format_version);
+			     GIT_REPO_VERSION_READ, repository_format_version);
 		warning("Expected git repo version <= %d, found %d",
-			GIT_REPO_VERSION, repository_format_version);
+			GIT_REPO_VERSION_READ, repository_format_version);
+		warning("Please upgrade Git");
+		*nongit_ok = -1;
+		return -1;
+	}
+	/* extensions are only binding from version 1 on */
+	if (repository_format_version >= 1 && unknown_extensions.nr) {
+		if (!nongit_ok)
+			die("unknown repository extension: %s",
+			    unknown_extensions.items[0].string);
+		warning("unknown repository extension: %s",
+			unknown_extensions.items[0].string);
 		warning("Please upgrade Git");
 		*nongit_ok = -1;
 		return -1;
@@ -822,6 +836,15 @@ int check_repository_format_version(const char *var, const char *value, void *cb
 {
 	if (strcmp(var, "core.repositoryformatversion") == 0)
 		repository_format_version = git_config_int(var, value);
+	else if (prefixcmp(var, "extensions.") == 0) {
+		const char *ext = var + strlen("extensions.");
+
+		if (!strcmp(ext, "packedrefsformat") &&
+		    value && !strcmp(value, "binary"))
+			repository_format_packed_refs = 1;
+		else
+			string_list_append(&unknown_extensions, ext);
+	}
 	else if (strcmp(var, "core.sharedrepository") == 0)
 		shared_repository = git_config_perm(var, value);
 	else if (strcmp(var, "core.bare") == 0) {
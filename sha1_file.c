@@ -2449,6 +2449,36 @@ int hash_sha1_file(const void *buf, unsigned long len, const char *type,
 	return 0;
 }
 
+void hash_sha1_files(struct hash_sha1_job *jobs, int nr)
+{
+#ifdef git_SHA1_Many
+	git_SHA1_Msg msg[16];
+	char hdr[ARRAY_SIZE(msg)][32];
+	int i, n;
+
+	while (nr > 0) {
+		n = nr < ARRAY_SIZE(msg) ? nr : ARRAY_SIZE(msg);
+		for (i = 0; i < n; i++) {
+			msg[i].hdr = hdr[i];
+			msg[i].hdrlen = sprintf(hdr[i], "%s %lu",
+						jobs[i].type, jobs[i].len) + 1;
+			msg[i].buf = jobs[i].buf;
+			msg[i].len = jobs[i].len;
+			msg[i].sha1 = jobs[i].sha1;
+		}
+		git_SHA1_Many(msg, n);
+		jobs += n;
+		nr -= n;
+	}
+#else
+	int i;
+
+	for (i = 0; i < nr; i++)
+		hash_sha1_file(jobs[i].buf, jobs[i].len, jobs[i].type,
+			       jobs[i].sha1);
+#endif
+}
+
 /* Finalize a file on disk, and close it. */
 static void close_sha1_file(int fd)
 {
@@ -0,0 +1,29 @@
+#!/bin/sh
+
+test_description="Tests delta creation and application performance"
+
+. ./perf-lib.sh
+
+test_perf_default_repo
+
+test_expect_success 'setup' '
+	git ls-tree -r HEAD~50 | head -n 2000 |
+	awk "{print \$3}" | git cat-file --batch >from &&
+	git ls-tree -r HEAD | head -n 2000 |
+	awk "{print \$3}" | git cat-file --batch >to &&
+	test-delta -d from to delta
+'
+
+test_perf 'create delta' '
+	test-delta -d from to delta.out
+'
+
+test_perf 'create delta (reversed)' '
+	test-delta -d to from delta.out
+'
+
+test_perf 'apply delta' '
+	test-delta -p from delta to.out
+'
+
+test_done
@@ -26,4 +26,26 @@ test_perf 'log -p -3000 --patience' '
 	git log -p -3000 --patience >/dev/null
 '
 
+test_perf 'log -p -3000 --ignore-space-change' '
+	git log -p -3000 --ignore-space-change >/dev/null
+'
+
+test_perf 'log -p -3000 --ignore-all-space' '
+	git log -p -3000 --ignore-all-space >/dev/null
+'
+
+test_expect_success 'setup large generated files' '
+	test_seq 200000 |
+	sed "s/.*/generated line & with some padding to make it longer/" >big1 &&
+	sed "s/line \([0-9]*00\) with/line \1  with/" <big1 >big2
+'
+
+test_perf 'diff --no-index large generated files' '
+	git diff --no-index big1 big2 >/dev/null || :
+'
+
+test_perf 'diff --no-index -b large generated files' '
+	git diff --no-index -b big1 big2 >/dev/null || :
+'
+
 test_done
@@ -30,4 +30,18 @@ test_expect_success 'revision walking can be done twice' '
 	test_cmp run_twice_expected run_twice_actual
 '
 
+cat >run_in_pools_expected <<-EOF
+pool 1
+ > add b
+ > add a
+pool 2
+ > add b
+ > add a
+EOF
+
+test_expect_success 'revision walks can use their own object pools' '
+	test-revision-walking run-in-pools >run_in_pools_actual &&
+	test_cmp run_in_pools_expected run_in_pools_actual
+'
+
 test_done
@@ -188,6 +188,46 @@ for args in "-w --stdin-paths" "--stdin-paths -w"; do
 	pop_repo
 done
 
+test_expect_success 'hash many files of different sizes with names on stdin' '
+	for i in 0 1 2 3 4 5 6 7 8 9 10 11 12 13 14 15 16 17 18 19 20 \
+		 21 22 23 24 25 26 27 28 29 30 31 32 33 34 35 36 37 38 39
+	do
+		test-genrandom "$i" $(($i * 61)) >many-$i &&
+		echo many-$i || return 1
+	done >many-list &&
+	test-genrandom big $((100 * 1024)) >many-big &&
+	echo many-big >>many-list &&
+	while read f
+	do
+		git hash-object "$f" || return 1
+	done <many-list >expect &&
+	git hash-object --stdin-paths <many-list >actual &&
+	test_cmp expect actual &&
+	GIT_SHA1_BACKEND=block git hash-object --stdin-paths <many-list >actual &&
+	test_cmp expect actual
+'
+
+test_lazy_prereq PIPE '
+	mkfifo pipe-test && rm -f pipe-test
+'
+
+test_expect_success PIPE 'each name is printed before the next path is read' '
+	git hash-object many-1 many-2 >expect &&
+	rm -f backflow &&
+	mkfifo backflow &&
+	(
+		exec <backflow &&
+		echo many-1 &&
+		read name &&
+		echo "$name" >actual &&
+		echo many-2 &&
+		read name &&
+		echo "$name" >>actual
+	) |
+	git hash-object --stdin-paths >backflow &&
+	test_cmp expect actual
+'
+
 test_expect_success 'corrupt tree' '
 	echo abc >malformed-tree &&
 	test_must_fail git hash-object -t tree malformed-tree
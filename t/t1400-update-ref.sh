@@ -302,4 +302,162 @@ test_expect_success \
 	'git cat-file blob master@{2005-05-26 23:42}:F (expect OTHER)' \
 	'test OTHER = $(git cat-file blob "master@{2005-05-26 23:42}:F")'
 
+a=refs/heads/a
+b=refs/heads/b
+c=refs/heads/c
+pws='path with space'
+
+test_expect_success 'stdin test setup' '
+	echo "$pws" >"$pws" &&
+	git add -- "$pws" &&
+	git commit -m "$pws"
+'
+
+test_expect_success '--stdin fails with arguments' '
+	test_must_fail git update-ref --stdin $m $D
+'
+
+test_expect_success 'stdin works with no input' '
+	>stdin &&
+	git update-ref --stdin <stdin &&
+	git rev-parse --verify -q $m
+'
+
+test_expect_success 'stdin fails on empty line' '
+	echo "" >stdin &&
+	test_must_fail git update-ref --stdin <stdin 2>err &&
+	grep "fatal: empty command in input" err
+'
+
+test_expect_success 'stdin fails on unknown command' '
+	echo "unknown $a" >stdin &&
+	test_must_fail git update-ref --stdin <stdin 2>err &&
+	grep "fatal: unknown command: unknown $a" err
+'
+
+test_expect_success 'stdin fails with duplicate refs' '
+	cat >stdin <<-EOF &&
+	create $a $m
+	create $b $m
+	create $a $m
+	EOF
+	test_must_fail git update-ref --stdin <stdin 2>err &&
+	grep "fatal: Multiple updates for ref '"'"'$a'"'"' not allowed." err &&
+	test_must_fail git rev-parse --verify -q $b
+'
+
+test_expect_success 'stdin create ref works' '
+	echo "create $a $m" >stdin &&
+	git update-ref --stdin <stdin &&
+	git rev-parse $m >expect &&
+	git rev-parse $a >actual &&
+	test_cmp expect actual
+'
+
+test_expect_success 'stdin create ref fails when it already exists' '
+	echo "create $a $m~1" >stdin &&
+	test_must_fail git update-ref --stdin <stdin &&
+	git rev-parse $m >expect &&
+	git rev-parse $a >actual &&
+	test_cmp expect actual
+'
+
+test_expect_success 'stdin update ref works with a quoted value' '
+	echo "update refs/tags/blob \"$m:$pws\"" >stdin &&
+	git update-ref --stdin <stdin &&
+	git rev-parse $m:"$pws" >expect &&
+	git rev-parse refs/tags/blob >actual &&
+	test_cmp expect actual &&
+	git update-ref -d refs/tags/blob
+'
+
+test_expect_success 'stdin update ref fails with wrong old value' '
+	echo "update $c $m $m~1" >stdin &&
+	test_must_fail git update-ref --stdin <stdin &&
+	test_must_fail git rev-parse --verify -q $c
+'
+
+test_expect_success 'stdin verify succeeds for correct value' '
+	git rev-parse $m >expect &&
+	echo "verify $m $m" >stdin &&
+	git update-ref --stdin <stdin &&
+	git rev-parse $m >actual &&
+	test_cmp expect actual
+'
+
+test_expect_success 'stdin verify fails for wrong value' '
+	echo "verify $m $m~1" >stdin &&
+	test_must_fail git update-ref --stdin <stdin &&
+	echo "verify $c" >stdin &&
+	git update-ref --stdin <stdin
+'
+
+test_expect_success 'stdin option no-deref updates a symref itself' '
+	git symbolic-ref TESTSYMREF $b &&
+	cat >stdin <<-EOF &&
+	option no-deref
+	update TESTSYMREF $a
+	EOF
+	git update-ref --stdin <stdin &&
+	git rev-parse TESTSYMREF >expect &&
+	git rev-parse $a >actual &&
+	test_cmp expect actual &&
+	test_must_fail git symbolic-ref -q TESTSYMREF &&
+	test_must_fail git rev-parse --verify -q $b &&
+	git update-ref -d TESTSYMREF
+'
+
+test_expect_success 'stdin updates all refs or none of them' '
+	git update-ref $b $m~1 &&
+	cat >stdin <<-EOF &&
+	update $a $m~1 $m
+	delete $b
+	create $c $m
+	verify $m $m~1
+	EOF
+	test_must_fail git update-ref --stdin <stdin &&
+	git rev-parse $m >expect &&
+	git rev-parse $a >actual &&
+	test_cmp expect actual &&
+	git rev-parse $b $m~1 >expect-b &&
+	git rev-parse $b $b >actual &&
+	test_cmp expect-b actual &&
+	test_must_fail git rev-parse --verify -q $c
+'
+
+test_expect_success 'stdin update, create and delete in one transaction' '
+	git update-ref $b $m~1 &&
+	cat >stdin <<-EOF &&
+	update $a $m~1 $m
+	delete $b $m~1
+	create $c $m
+	EOF
+	git update-ref --stdin <stdin &&
+	git rev-parse $m~1 >expect &&
+	git rev-parse $a >actual &&
+	test_cmp expect actual &&
+	test_must_fail git rev-parse --verify -q $b &&
+	git rev-parse $m >expect &&
+	git rev-parse $c >actual &&
+	test_cmp expect actual
+'
+
+test_expect_success 'stdin deletes many packed refs with one rewrite' '
+	for i in 1 2 3 4 5 6 7 8 9 10
+	do
+		echo "create refs/tags/batch-$i $m" || return 1
+	done >stdin &&
+	git update-ref --stdin <stdin &&
+	git pack-refs --all &&
+	for i in 1 2 3 4 5 6 7 8 9 10
+	do
+		echo "delete refs/tags/batch-$i $m" || return 1
+	done >stdin &&
+	git update-ref --stdin <stdin &&
+	! grep batch- .git/packed-refs &&
+	git rev-parse $m~1 >expect &&
+	git rev-parse $a >actual &&
+	test_cmp expect actual
+'
+
 test_done
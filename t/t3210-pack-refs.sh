@@ -118,4 +118,39 @@ test_expect_success 'pack, prune and repack' '
 	test_cmp all-of-them again
 '
 
+test_expect_success 'packed-refs is written with the sorted trait' '
+	head -n 1 .git/packed-refs >actual &&
+	echo "# pack-refs with: peeled sorted " >expect &&
+	test_cmp expect actual
+'
+
+test_expect_success 'refs are looked up in a sorted packed-refs file' '
+	for i in 1 2 3 4 5 6 7 8 9 10 11 12 13 14 15 16 17 18 19 20
+	do
+		git update-ref refs/pull/$i/head HEAD || return 1
+	done &&
+	git pack-refs --all --prune &&
+	git show-ref >expect &&
+	test "$(git rev-parse refs/pull/13/head)" = "$(git rev-parse HEAD)" &&
+	test_must_fail git rev-parse --verify refs/pull/21/head &&
+	git for-each-ref --format="%(refname)" refs/pull/ >actual &&
+	test_line_count = 20 actual &&
+	git branch >actual &&
+	! grep pull actual &&
+	git show-ref >actual &&
+	test_cmp expect actual
+'
+
+test_expect_success 'packed-refs without the sorted trait is read in full' '
+	git show-ref >expect &&
+	{
+		echo "# pack-refs with: peeled " &&
+		sed -e 1d .git/packed-refs | sort -r
+	} >packed-refs.reversed &&
+	mv packed-refs.reversed .git/packed-refs &&
+	test "$(git rev-parse refs/pull/13/head)" = "$(git rev-parse HEAD)" &&
+	git show-ref >actual &&
+	test_cmp expect actual
+'
+
 test_done
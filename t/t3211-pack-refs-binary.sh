@@ -0,0 +1,125 @@
+#!/bin/sh
+
+test_description='binary packed-refs format'
+. ./test-lib.sh
+
+test_expect_success 'setup' '
+	test_commit one &&
+	test_commit two &&
+	for i in 1 2 3 4 5 6 7 8 9 10 11 12 13 14 15 16 17 18 19 20
+	do
+		git branch branch-$i one &&
+		git tag -a -m "tag $i" tag-$i two &&
+		git update-ref refs/pull/$i/head two || return 1
+	done &&
+	git branch dir/ref one &&
+	git pack-refs --all &&
+	git show-ref -d >expect &&
+	git for-each-ref >expect-for-each
+'
+
+test_expect_success 'pack-refs writes the binary format' '
+	git -c core.packedRefsFormat=binary pack-refs --all &&
+	printf "\377REF" >signature &&
+	head -c 4 .git/packed-refs >actual &&
+	cmp signature actual
+'
+
+test_expect_success 'writing the binary format marks the repository' '
+	test "$(git config core.repositoryformatversion)" = 1 &&
+	test "$(git config extensions.packedRefsFormat)" = binary
+'
+
+test_expect_success 'unknown repository extensions are refused' '
+	git config extensions.unknownThing true &&
+	test_must_fail git rev-parse HEAD &&
+	git config -f .git/config --unset extensions.unknownThing &&
+	git rev-parse HEAD
+'
+
+test_expect_success 'an unknown packed-refs format is refused' '
+	git config -f .git/config extensions.packedRefsFormat foo &&
+	test_must_fail git rev-parse HEAD &&
+	git config -f .git/config extensions.packedRefsFormat binary &&
+	git rev-parse HEAD
+'
+
+test_expect_success 'git init keeps the repository format version' '
+	git init &&
+	test "$(git config core.repositoryformatversion)" = 1
+'
+
+test_expect_success 'refs are read back from the binary format' '
+	git show-ref -d >actual &&
+	test_cmp expect actual &&
+	git for-each-ref >actual &&
+	test_cmp expect-for-each actual
+'
+
+test_expect_success 'single refs are looked up' '
+	test "$(git rev-parse branch-7)" = "$(git rev-parse one)" &&
+	test "$(git rev-parse tag-13^{})" = "$(git rev-parse two)" &&
+	test_must_fail git rev-parse --verify refs/heads/branch-77
+'
+
+test_expect_success 'prefix iteration sees only matching refs' '
+	grep "refs/tags/" expect-for-each >expect-tags &&
+	git for-each-ref refs/tags/ >actual &&
+	test_cmp expect-tags actual &&
+	git branch >actual &&
+	test_line_count = 22 actual
+'
+
+test_expect_success 'loose refs override packed ones' '
+	git update-ref refs/heads/branch-3 two &&
+	test "$(git rev-parse branch-3)" = "$(git rev-parse two)" &&
+	git update-ref refs/heads/branch-3 one
+'
+
+test_expect_success 'new refs must not conflict with binary packed refs' '
+	test_must_fail git branch branch-4/sub &&
+	test_must_fail git branch dir &&
+	git branch dir-not-conflicting &&
+	git branch -d dir-not-conflicting
+'
+
+test_expect_success 'deleting a packed ref keeps the binary format' '
+	git branch -d branch-5 &&
+	head -c 4 .git/packed-refs >actual &&
+	cmp signature actual &&
+	test_must_fail git rev-parse --verify refs/heads/branch-5 &&
+	grep -v " refs/heads/branch-5$" expect |
+	sed -e "/refs\/tags\/.*\^{}$/d" >expect-deleted &&
+	git show-ref >actual &&
+	test_cmp expect-deleted actual
+'
+
+test_expect_success 'pack-refs converts back to text' '
+	git pack-refs --all &&
+	head -n 1 .git/packed-refs >actual &&
+	echo "# pack-refs with: peeled sorted " >expect-header &&
+	test_cmp expect-header actual &&
+	git show-ref -d >actual &&
+	grep -v " refs/heads/branch-5$" expect >expect-deleted &&
+	test_cmp expect-deleted actual
+'
+
+test_expect_success 'a corrupted binary file is noticed' '
+	git -c core.packedRefsFormat=binary pack-refs --all &&
+	cp .git/packed-refs packed-refs.good &&
+	"$PERL_PATH" -pi -e "s/branch-1/branch-X/" .git/packed-refs &&
+	test_must_fail git show-ref 2>err &&
+	grep "bad checksum" err &&
+	mv packed-refs.good .git/packed-refs &&
+	git show-ref
+'
+
+test_expect_success 'a truncated binary file is noticed' '
+	cp .git/packed-refs packed-refs.good &&
+	printf "\377REF\000\000\000\001" >.git/packed-refs &&
+	test_must_fail git show-ref &&
+	mv packed-refs.good .git/packed-refs &&
+	git show-ref
+'
+
+test_done
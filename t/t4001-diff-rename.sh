@@ -102,4 +102,62 @@ test_expect_success 'setup for many rename source candidates' '
 	grep warning actual.err
 '
 
+test_expect_success 'threads find the same inexact renames and copies' '
+	git reset --hard &&
+	for i in 0 1 2 3 4 5 6 7 8 9
+	do
+		for j in 0 1 2 3 4
+		do
+			test_seq 1 $((5 + $i * 5 + $j)) >"many-$i$j" || return 1
+		done
+	done &&
+	git add many-* &&
+	git commit -m "many" &&
+	for f in many-*
+	do
+		echo changed >>$f &&
+		git mv $f moved-$f || return 1
+	done &&
+	git diff -C -C --cached -M --name-status >expect &&
+	grep "^R" expect &&
+	git -c diff.renameThreads=1 diff -C -C --cached -M --name-status >actual &&
+	test_cmp expect actual &&
+	git -c diff.renameThreads=4 diff -C -C --cached -M --name-status >actual &&
+	test_cmp expect actual
+'
+
+test_expect_success 'files moved to another directory are found past the rename limit' '
+	git reset --hard &&
+	mkdir olddir &&
+	for i in 1 2 3 4 5 6
+	do
+		test_seq 1 20 >olddir/file$i &&
+		echo $i >>olddir/file$i || return 1
+	done &&
+	test_seq 21 40 >olddir/same &&
+	mkdir -p sub1 sub2 &&
+	test_seq 41 60 >sub1/same &&
+	git add olddir sub1 &&
+	git commit -m "old directory" &&
+	git mv olddir newdir &&
+	git mv sub1/same sub2/same &&
+	for f in newdir/* sub2/same
+	do
+		echo changed >>$f || return 1
+	done &&
+	git add newdir sub2 &&
+	git diff -M -l 2 --cached --name-status >actual &&
+	cat >expect <<-\EOF &&
+	R086	olddir/file1	newdir/file1
+	R086	olddir/file2	newdir/file2
+	R086	olddir/file3	newdir/file3
+	R086	olddir/file4	newdir/file4
+	R086	olddir/file5	newdir/file5
+	R086	olddir/file6	newdir/file6
+	R088	olddir/same	newdir/same
+	R088	sub1/same	sub2/same
+	EOF
+	test_cmp expect actual
+'
+
 test_done
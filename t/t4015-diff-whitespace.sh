@@ -142,6 +142,21 @@ EOF
 git diff --ignore-space-at-eol > out
 test_expect_success 'another test, with --ignore-space-at-eol' 'test_cmp expect out'
 
+test_expect_success 'whitespace changes after a long common prefix' '
+	prefix="this line has a rather long common prefix before the change" &&
+	echo "$prefix  at eol" >x &&
+	git update-index x &&
+	echo "$prefix at eol " >x &&
+	git diff -b --exit-code &&
+	git diff -w --exit-code &&
+	test_must_fail git diff --ignore-space-at-eol --exit-code &&
+	echo "$prefix	 at eol" >x &&
+	git diff -b --exit-code &&
+	echo "$prefix at  eolx" >x &&
+	test_must_fail git diff -b --exit-code &&
+	test_must_fail git diff -w --exit-code
+'
+
 test_expect_success 'check mixed spaces and tabs in indent' '
 
 	# This is indented with SP HT SP.
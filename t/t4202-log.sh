@@ -839,4 +839,15 @@ test_expect_success 'dotdot is a parent directory' '
 	test_cmp expect actual
 '
 
+test_expect_success 'log reads back commits dropped from a tiny buffer cache' '
+	git log --graph --topo-order --format="%H %s%n%b" --grep=i >expect &&
+	git -c core.commitBufferCacheLimit=1 \
+		log --graph --topo-order --format="%H %s%n%b" --grep=i >actual &&
+	test_cmp expect actual &&
+	git log --graph --pretty=short --stat -p >expect &&
+	git -c core.commitBufferCacheLimit=1 \
+		log --graph --pretty=short --stat -p >actual &&
+	test_cmp expect actual
+'
+
 test_done
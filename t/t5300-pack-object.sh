@@ -400,6 +400,42 @@ test_expect_success 'verify resulting packs' '
 	git verify-pack test-11-*.pack
 '
 
+test_expect_success 'streaming a fully packed repository reuses the pack as is' '
+	git init verbatim &&
+	(
+		cd verbatim &&
+		for i in 1 2 3 4 5 6 7 8
+		do
+			cat ../test-1-$packname_1.idx >file &&
+			echo $i >>file &&
+			git add file &&
+			test_tick &&
+			git commit -q -m $i || return 1
+		done &&
+		git repack -a -d -f &&
+		git pack-objects --revs --all --delta-base-offset --stdout \
+			</dev/null >../verbatim.pack &&
+		cmp .git/objects/pack/pack-*.pack ../verbatim.pack &&
+		git pack-objects --revs --all --stdout </dev/null >../ref.pack
+	) &&
+	git index-pack --strict -o ref.idx ref.pack &&
+	git verify-pack ref.idx
+'
+
+test_expect_success 'threaded compression writes the same packs' '
+	git pack-objects --no-reuse-object --threads=1 --stdout \
+		<obj-list >single.pack &&
+	git pack-objects --no-reuse-object --threads=4 --stdout \
+		<obj-list >threaded.pack &&
+	cmp single.pack threaded.pack &&
+	git pack-objects --no-reuse-object --threads=1 test-12 \
+		<obj-list >single.packs &&
+	git pack-objects --no-reuse-object --threads=4 test-13 \
+		<obj-list >threaded.packs &&
+	test_cmp single.packs threaded.packs &&
+	git verify-pack test-13-*.pack
+'
+
 #
 # WARNING!
 #
@@ -65,6 +65,27 @@ test_expect_success \
     'cmp "test-1-${pack1}.idx" "1.idx" &&
      cmp "test-2-${pack2}.idx" "2.idx"'
 
+test_expect_success 'index-pack hashes objects in several threads' '
+	git index-pack --threads=4 --strict --index-version=2 \
+		-o threads.idx "test-1-${pack1}.pack" &&
+	cmp "test-2-${pack2}.idx" threads.idx
+'
+
+test_expect_success 'index-pack resolves deltas with a tiny delta base cache' '
+	GIT_TRACE="$PWD/trace" git -c core.deltaBaseCacheLimit=200 \
+		index-pack --threads=1 --index-version=2 \
+		-o small-cache.idx "test-1-${pack1}.pack" &&
+	cmp "test-2-${pack2}.idx" small-cache.idx &&
+	grep "index-pack: resolved 190 deltas .* of 200 bytes" trace
+'
+
+test_expect_success 'threads share a tiny delta base cache' '
+	git -c core.deltaBaseCacheLimit=200 \
+		index-pack --threads=4 --index-version=2 \
+		-o small-cache-threads.idx "test-1-${pack1}.pack" &&
+	cmp "test-2-${pack2}.idx" small-cache-threads.idx
+'
+
 test_expect_success 'index-pack --verify on index version 1' '
 	git index-pack --verify "test-1-${pack1}.pack"
 '
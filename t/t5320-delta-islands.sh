@@ -0,0 +1,117 @@
+#!/bin/sh
+
+test_description='exercise delta islands'
+. ./test-lib.sh
+
+# returns true iff $1 is stored as a delta against $2
+is_delta_base () {
+	git verify-pack -v .git/objects/pack/*.idx >verify &&
+	grep "^$1 .* $2\$" verify
+}
+
+# generate a commit on branch $1 with a single file, "file", whose
+# content is mostly based on the seed $2, but with a unique bit
+# of content $3 appended. This should allow us to see whether
+# blobs of different refs delta against each other.
+commit () {
+	blob=$({ "$PERL_PATH" -e "print qq{$2\n} x 1000"; echo "$3"; } |
+	       git hash-object -w --stdin) &&
+	tree=$(printf '100644 blob %s\tfile\n' "$blob" | git mktree) &&
+	commit=$(echo "$2-$3" | git commit-tree "$tree" ${4:+-p "$4"}) &&
+	git update-ref "refs/heads/$1" "$commit" &&
+	eval "$1"'=$(git rev-parse $1:file)' &&
+	eval "$1"'_commit=$commit'
+}
+
+test_expect_success 'setup commits' '
+	commit one seed 1 &&
+	commit two seed 12
+'
+
+# Note: This is heavily dependent on the "prefer larger objects as base"
+# heuristic.
+test_expect_success 'vanilla repack deltas one against two' '
+	git repack -adf &&
+	is_delta_base $one $two
+'
+
+test_expect_success 'island repack with no island definition is vanilla' '
+	git repack -adfi &&
+	is_delta_base $one $two
+'
+
+test_expect_success 'island repack with no matches is vanilla' '
+	git -c "pack.island=refs/foo" repack -adfi &&
+	is_delta_base $one $two
+'
+
+test_expect_success 'separate islands disallows delta' '
+	git -c "pack.island=refs/heads/(.*)" repack -adfi &&
+	! is_delta_base $one $two &&
+	! is_delta_base $two $one
+'
+
+test_expect_success 'same island allows delta' '
+	git -c "pack.island=refs/heads" repack -adfi &&
+	is_delta_base $one $two
+'
+
+test_expect_success 'coalesce same-named islands' '
+	git \
+		-c "pack.island=refs/(.*)/one" \
+		-c "pack.island=refs/(.*)/two" \
+		repack -adfi &&
+	is_delta_base $one $two
+'
+
+test_expect_success 'island restrictions drop reused deltas' '
+	git repack -adf &&
+	is_delta_base $one $two &&
+	git -c "pack.island=refs/heads/(.*)" repack -adi &&
+	! is_delta_base $one $two &&
+	! is_delta_base $two $one
+'
+
+test_expect_success 'island regexes are additive' '
+	git \
+		-c "pack.island=refs/heads/(o.e)" \
+		-c "pack.island=refs/heads/(t.o)" \
+		repack -adfi &&
+	! is_delta_base $one $two &&
+	! is_delta_base $two $one
+'
+
+test_expect_success 'the last matching island regex wins' '
+	git -c "pack.island=refs/heads/" -c "pack.island=refs/heads/(.*)" \
+		repack -adfi &&
+	! is_delta_base $one $two &&
+	git -c "pack.island=refs/heads/(.*)" -c "pack.island=refs/heads/" \
+		repack -adfi &&
+	is_delta_base $one $two
+'
+
+test_expect_success 'an object may use a base shared by all its islands' '
+	commit shared seed 123 &&
+	git update-ref refs/heads/shared $shared_commit &&
+	commit one seed 1 $shared_commit &&
+	commit two seed 12 $shared_commit &&
+	git -c "pack.island=refs/heads/(one|two)" repack -adfi &&
+	! is_delta_base $one $two &&
+	! is_delta_base $two $one &&
+	is_delta_base $one $shared &&
+	is_delta_base $two $shared
+'
+
+test_expect_success 'a base reachable from fewer islands is rejected' '
+	git update-ref -d refs/heads/shared &&
+	git update-ref refs/heads/only-one $one_commit &&
+	git -c "pack.island=refs/heads/(one|two|only-one)" repack -adfi &&
+	! is_delta_base $two $one &&
+	! is_delta_base $one $two
+'
+
+test_expect_success 'delta islands require --revs' '
+	echo $one | test_must_fail git pack-objects --delta-islands --stdout
+'
+
+test_done
@@ -135,4 +135,34 @@ test_expect_success 'send-pack stderr contains hook messages' '
 	test_cmp expect actual
 '
 
+test_expect_success 'refs changed by a hook are seen by receive-pack' '
+	git init --bare hooked.git &&
+	git push hooked.git master:refs/heads/master master^:refs/heads/other &&
+	git --git-dir=hooked.git config receive.updateserverinfo true &&
+	write_script hooked.git/hooks/post-receive <<-EOF &&
+	git update-ref refs/heads/other master
+	EOF
+	(
+		cd hooked.git &&
+		find refs -print | xargs test-chmtime -60
+	) &&
+	git push hooked.git master:refs/tags/pushed &&
+	git rev-parse master >expect &&
+	sed -n -e "s|	refs/heads/other\$||p" hooked.git/info/refs >actual &&
+	test_cmp expect actual
+'
+
+test_expect_success 'refs packed by a hook are seen by receive-pack' '
+	git --git-dir=hooked.git update-ref refs/heads/other master^ &&
+	write_script hooked.git/hooks/post-receive <<-EOF &&
+	git update-ref refs/heads/other master &&
+	git pack-refs --all
+	EOF
+	git push hooked.git master:refs/tags/pushed-too &&
+	test_path_is_missing hooked.git/refs/heads/other &&
+	git rev-parse master >expect &&
+	sed -n -e "s|	refs/heads/other\$||p" hooked.git/info/refs >actual &&
+	test_cmp expect actual
+'
+
 test_done
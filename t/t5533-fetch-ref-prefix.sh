@@ -0,0 +1,98 @@
+#!/bin/sh
+
+test_description='fetching with a filtered ref advertisement'
+. ./test-lib.sh
+
+test_expect_success 'setup' '
+	test_commit one &&
+	git tag -a -m "annotated" annotated &&
+	git branch side &&
+	for i in 1 2 3
+	do
+		git update-ref refs/pull/$i/head one || return 1
+	done &&
+	git clone --no-local . client
+'
+
+test_expect_success 'upload-pack advertises everything by default' '
+	printf 0000 | git upload-pack . >out &&
+	grep "refs/pull/1/head" out &&
+	! grep "capabilities^{}" out
+'
+
+test_expect_success 'upload-pack waits for ref prefixes in ls-refs mode' '
+	printf "001fref-prefix refs/heads/side\n00000000" |
+	GIT_PROTOCOL=ls-refs git upload-pack . >out &&
+	grep "capabilities^{}" out &&
+	grep " ls-refs " out &&
+	grep "refs/heads/side" out &&
+	! grep "refs/heads/master" out &&
+	! grep "refs/pull/" out
+'
+
+test_expect_success 'fetch hears only about the refs it may fetch' '
+	test_commit two &&
+	(cd client &&
+	 rm -f trace &&
+	 GIT_TRACE_PACKET="$(pwd)/trace" git fetch &&
+	 grep "fetch> ref-prefix refs/heads/$" trace &&
+	 grep "fetch> ref-prefix refs/tags/$" trace &&
+	 grep "fetch< .* refs/heads/master" trace &&
+	 grep "fetch< .* refs/tags/annotated" trace &&
+	 ! grep "refs/pull/" trace &&
+	 git rev-parse two >expect &&
+	 git rev-parse origin/master >actual &&
+	 test_cmp expect actual
+	)
+'
+
+test_expect_success 'command-line refspecs select the prefixes' '
+	(cd client &&
+	 rm -f trace &&
+	 GIT_TRACE_PACKET="$(pwd)/trace" git fetch --no-tags origin \
+		refs/pull/2/head:refs/remotes/pr/2 side &&
+	 grep "fetch> ref-prefix refs/pull/2/head$" trace &&
+	 grep "fetch> ref-prefix refs/heads/side$" trace &&
+	 ! grep "ref-prefix refs/tags/$" trace &&
+	 ! grep "refs/pull/1/" trace &&
+	 git rev-parse one >expect &&
+	 git rev-parse pr/2 >actual &&
+	 test_cmp expect actual &&
+	 git rev-parse FETCH_HEAD >actual &&
+	 test_cmp expect actual
+	)
+'
+
+test_expect_success 'fetch-pack asks for the refs it wants' '
+	rm -f trace &&
+	 GIT_TRACE_PACKET="$(pwd)/trace" git fetch-pack --no-progress \
+		"file://$(pwd)/." refs/heads/side >out &&
+	grep "fetch-pack> ref-prefix refs/heads/side$" trace &&
+	! grep "fetch-pack< .* refs/heads/master" trace &&
+	echo "$(git rev-parse side) refs/heads/side" >expect &&
+	test_cmp expect out
+'
+
+test_expect_success 'wanting all advertised refs does not send the others' '
+	git checkout -b hidden &&
+	test_commit hidden-only &&
+	git checkout master &&
+	hidden=$(git rev-parse hidden) &&
+	git init partial &&
+	(cd partial &&
+	 git fetch --no-tags .. master &&
+	 test_must_fail git cat-file -e $hidden
+	)
+'
+
+test_expect_success 'servers without ls-refs send all refs' '
+	(cd client &&
+	 rm -f trace &&
+	 GIT_TRACE_PACKET="$(pwd)/trace" git fetch \
+		--upload-pack="GIT_PROTOCOL= git-upload-pack" origin &&
+	 ! grep "ref-prefix" trace &&
+	 grep "fetch< .* refs/pull/1/head" trace
+	)
+'
+
+test_done
@@ -0,0 +1,101 @@
+#!/bin/sh
+
+test_description='upload-pack keeps the packs it sends in a cache'
+. ./test-lib.sh
+
+# add a commit with 10k of incompressible content to the server
+commit_random () {
+	(
+		cd server &&
+		test-genrandom "$1" 10240 >"$1" &&
+		git add "$1" &&
+		test_tick &&
+		git commit -q -m "$1"
+	)
+}
+
+cached_packs () {
+	(cd server/.git/pack-cache && ls pack-*.pack) 2>/dev/null
+}
+
+clone_server () {
+	rm -rf "$1" trace &&
+	GIT_TRACE="$PWD/trace" git clone -q --no-local "file://$PWD/server" "$1" &&
+	(cd "$1" && git fsck) &&
+	test "$(cd "$1" && git rev-parse HEAD)" = \
+		"$(cd server && git rev-parse HEAD)"
+}
+
+test_expect_success 'setup' '
+	git init server &&
+	commit_random a &&
+	(cd server && git config uploadpack.packCacheSize 1m)
+'
+
+test_expect_success 'a clone is cached' '
+	clone_server one &&
+	grep "upload-pack: cached pack" trace &&
+	cached_packs >actual &&
+	test_line_count = 1 actual
+'
+
+test_expect_success 'the same clone is sent from the cache' '
+	clone_server two &&
+	grep "upload-pack: sending cached pack" trace &&
+	cached_packs >actual &&
+	test_line_count = 1 actual
+'
+
+test_expect_success 'changed refs lead to a new pack' '
+	commit_random b &&
+	clone_server three &&
+	! grep "upload-pack: sending cached pack" trace &&
+	cached_packs >actual &&
+	test_line_count = 2 actual
+'
+
+test_expect_success 'a fetch is cached by what the client has' '
+	rm -f trace &&
+	(cd one && GIT_TRACE="$PWD/../trace" git fetch -q && git fsck) &&
+	grep "upload-pack: cached pack" trace &&
+	cached_packs >actual &&
+	test_line_count = 3 actual
+'
+
+test_expect_success 'the least recently used packs are removed' '
+	rm -rf server/.git/pack-cache &&
+	(cd server && git update-ref refs/heads/master HEAD^ HEAD) &&
+	clone_server four &&
+	cached_packs >pack-a &&
+	(cd server && git update-ref refs/heads/master master@{1}) &&
+	clone_server five &&
+	cached_packs | grep -v -F -f pack-a >pack-b &&
+	test_line_count = 1 pack-b &&
+	test-chmtime =-20 server/.git/pack-cache/$(cat pack-b) &&
+	test-chmtime =-10 server/.git/pack-cache/$(cat pack-a) &&
+	(cd server && git config uploadpack.packCacheSize 45000) &&
+	commit_random c &&
+	clone_server six &&
+	grep "upload-pack: evicting .*$(cat pack-b)" trace &&
+	cached_packs >actual &&
+	test_line_count = 2 actual &&
+	grep -F -f pack-a actual
+'
+
+test_expect_success 'packs larger than the cache are not kept' '
+	(cd server && git config uploadpack.packCacheSize 1k) &&
+	cached_packs >expect &&
+	commit_random d &&
+	clone_server seven &&
+	! grep "upload-pack: cached pack" trace &&
+	cached_packs >actual &&
+	test_cmp expect actual
+'
+
+test_expect_success 'there is no cache without uploadpack.packCacheSize' '
+	(cd server && git config --unset uploadpack.packCacheSize) &&
+	clone_server eight &&
+	! grep "upload-pack: .*cached pack" trace
+'
+
+test_done
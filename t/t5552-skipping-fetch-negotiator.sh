@@ -0,0 +1,80 @@
+#!/bin/sh
+
+test_description='fetch negotiation algorithms'
+. ./test-lib.sh
+
+# make $2 empty commits on top of $1, naming the last one $3
+commits () {
+	parent=$(git rev-parse "$1") &&
+	for i in $(test_seq 1 $2)
+	do
+		test_tick &&
+		parent=$(echo "$3 $i" | git commit-tree "$tree" -p "$parent") ||
+		return 1
+	done &&
+	git update-ref "refs/heads/$3" "$parent"
+}
+
+count_haves () {
+	grep "fetch-pack> have\|fetch> have" "$1" | wc -l
+}
+
+# fetch "side" into a copy of the client with the negotiation algorithm $1
+fetch_with () {
+	rm -rf "client-$1" &&
+	cp -R client "client-$1" &&
+	(
+		cd "client-$1" &&
+		ls .git/objects/pack/*.idx >old-packs &&
+		GIT_TRACE="$(pwd)/trace" GIT_TRACE_PACKET="$(pwd)/packets" \
+		git -c fetch.negotiationAlgorithm=$1 -c fetch.unpackLimit=1 \
+			fetch origin side &&
+		git rev-parse FETCH_HEAD >actual &&
+		test_cmp ../expect actual &&
+		ls .git/objects/pack/*.idx >packs &&
+		git verify-pack -v $(comm -13 old-packs packs) >objects
+	)
+}
+
+test_expect_success 'setup' '
+	test_commit base &&
+	tree=$(git rev-parse HEAD^{tree}) &&
+	commits base 100 side &&
+	git clone --no-local . client &&
+	(
+		cd client &&
+		commits origin/side 300 mine &&
+		git update-ref -d refs/remotes/origin/side
+	) &&
+	commits side 1 side &&
+	commits master 1 master &&
+	git rev-parse side >expect
+'
+
+test_expect_success 'consecutive negotiation sends every commit' '
+	fetch_with consecutive &&
+	grep "consecutive negotiation" client-consecutive/trace &&
+	test $(count_haves client-consecutive/packets) -gt 300 &&
+	grep "^[0-9a-f]\{40\} commit" client-consecutive/objects >commits &&
+	test_line_count = 1 commits
+'
+
+test_expect_success 'skipping negotiation sends fewer commits' '
+	fetch_with skipping &&
+	grep "skipping negotiation" client-skipping/trace &&
+	test $(count_haves client-skipping/packets) -lt 50
+'
+
+test_expect_success 'skipping negotiation narrows down the common commit' '
+	grep "^[0-9a-f]\{40\} commit" client-skipping/objects >commits &&
+	test_line_count = 1 commits
+'
+
+test_expect_success 'unknown negotiation algorithms are rejected' '
+	rm -rf client-bogus &&
+	cp -R client client-bogus &&
+	test_must_fail git --git-dir=client-bogus/.git \
+		-c fetch.negotiationAlgorithm=bogus fetch origin side
+'
+
+test_done
@@ -36,6 +36,16 @@ test_expect_success 'fetch changes via git protocol' '
 	test_cmp file clone/file
 '
 
+test_expect_success 'fetch asks the daemon for matching refs only' '
+	git push public master:refs/pull/1/head &&
+	(cd clone &&
+	 GIT_TRACE_PACKET="$(pwd)/trace" git fetch &&
+	 grep "fetch> ref-prefix refs/heads/" trace &&
+	 grep "fetch< .* refs/heads/master" trace &&
+	 ! grep "refs/pull/" trace
+	)
+'
+
 test_expect_failure 'remote detects correct HEAD' '
 	git push public master:other &&
 	(cd clone &&
@@ -142,5 +152,94 @@ test_expect_success 'push disabled'      "test_remote_error    'service not enab
 test_expect_success 'read access denied' "test_remote_error -x 'no such repository'      fetch repo.git       "
 test_expect_success 'not exported'       "test_remote_error -n 'repository not exported' fetch repo.git       "
 
+stop_git_daemon
+start_git_daemon --workers=2 --max-repo-connections=1 --stats
+
+# Talk to the daemon directly; each argument is a request to send on a
+# connection of its own and the first pkt-line of each response is
+# printed.  The response to a request prefixed with "&" is only read
+# after the next "close", which closes the oldest open connection.
+# "stats=<regex>" prints the statistics once a line of them matches.
+daemon_session () {
+	"$PERL_PATH" -MIO::Socket::INET -e '
+		my $port = shift;
+		sub pkt_read {
+			my ($s) = @_;
+			my $len;
+			read($s, $len, 4) == 4 or return "EOF";
+			$len = hex($len);
+			return "0000" if !$len;
+			read($s, my $buf, $len - 4);
+			$buf =~ s/\0.*//s;
+			chomp $buf;
+			return $buf;
+		}
+		sub request {
+			my ($req) = @_;
+			my $s = IO::Socket::INET->new(PeerAddr => "127.0.0.1",
+				PeerPort => $port) or die;
+			printf $s "%04x%s\0host=localhost\0", length($req) + 20, $req;
+			return $s;
+		}
+		sub stats {
+			my $s = request("git-daemon-stats");
+			my @stats;
+			while ((my $line = pkt_read($s)) !~ /^(0000|EOF)$/) {
+				push @stats, "$line\n";
+			}
+			return @stats;
+		}
+		my (@conns, @pending);
+		for my $req (@ARGV) {
+			if ($req eq "close") {
+				close(shift @conns);
+				print "$_->[1]: ", pkt_read($_->[0]), "\n" for @pending;
+				@pending = ();
+			} elsif ($req =~ /^stats=(.*)/) {
+				my ($re, @stats) = $1;
+				for (1..100) {
+					@stats = stats();
+					last if grep { /$re/ } @stats;
+					select(undef, undef, undef, 0.1);
+				}
+				print @stats;
+			} elsif ($req =~ s/^&//) {
+				push @conns, request($req);
+				push @pending, [$conns[-1], $req];
+			} else {
+				push @conns, request($req);
+				print "$req: ", pkt_read($conns[-1]), "\n";
+			}
+		}
+	' "$LIB_GIT_DAEMON_PORT" "$@"
+}
+
+test_expect_success 'clone and fetch through pre-forked workers' '
+	: >"$GIT_DAEMON_DOCUMENT_ROOT_PATH/repo.git/git-daemon-export-ok" &&
+	git clone "$GIT_DAEMON_URL/repo.git" clone-workers &&
+	test_cmp file clone-workers/file &&
+	(cd clone-workers && git fetch)
+'
+
+test_expect_success 'the daemon reports statistics' '
+	daemon_session "stats=^workers\\.busy 1$" >stats &&
+	grep "^workers\.busy 1$" stats &&
+	grep "^connections\.served 3$" stats &&
+	grep "^connections\.dropped 0$" stats &&
+	grep "^service-time\.max-ms [0-9]*$" stats &&
+	! grep "^repository" stats
+'
+
+test_expect_success 'clients of one repository wait for each other' '
+	repo=$(cd "$GIT_DAEMON_DOCUMENT_ROOT_PATH/repo.git" && pwd -P) &&
+	daemon_session "git-upload-pack /repo.git" "&git-upload-pack /repo.git" \
+		"stats=^repository 1 1 " close >actual &&
+	sed -n "s/^repository //p" actual >repos &&
+	echo "1 1 $repo" >expect &&
+	test_cmp expect repos &&
+	grep "^git-upload-pack /repo.git: [0-9a-f]* HEAD$" actual >served &&
+	test_line_count = 2 served
+'
+
 stop_git_daemon
 test_done
@@ -0,0 +1,125 @@
+#!/bin/sh
+
+test_description='git blame keeps its results in a cache'
+. ./test-lib.sh
+
+cache_files () {
+	(cd .git/blame-cache && find . -type f) 2>/dev/null
+}
+
+# blame with and without the cache and compare the results
+check_blame () {
+	git -c blame.cache=false blame "$@" >expect &&
+	rm -f trace &&
+	GIT_TRACE="$PWD/trace" git blame "$@" >actual &&
+	test_cmp expect actual
+}
+
+test_expect_success 'setup' '
+	printf "%s\n" 1 2 3 4 5 6 7 8 9 >file &&
+	git add file &&
+	test_tick &&
+	git commit -m one &&
+	printf "%s\n" 1 2 three 4 5 6 7 8 9 10 >file &&
+	test_tick &&
+	git commit -a -m two &&
+	git mv file moved &&
+	printf "%s\n" 0 1 2 three 4 5 6 7 8 9 10 >moved &&
+	test_tick &&
+	git commit -a -m three &&
+	git checkout -b side &&
+	sed -e "s/^5$/five/" moved >tmp && mv tmp moved &&
+	test_tick &&
+	git commit -a -m side &&
+	git checkout master &&
+	sed -e "s/^8$/eight/" moved >tmp && mv tmp moved &&
+	test_tick &&
+	git commit -a -m four &&
+	test_tick &&
+	git merge side &&
+	git config blame.cache true
+'
+
+test_expect_success 'blame writes the cache' '
+	check_blame --porcelain HEAD^ -- moved &&
+	! grep "using cached blame" trace &&
+	cache_files >files &&
+	test_line_count = 1 files
+'
+
+test_expect_success 'the same blame is read from the cache' '
+	check_blame --porcelain HEAD^ -- moved &&
+	grep "using cached blame for $(git rev-parse HEAD^) moved" trace &&
+	cache_files >files &&
+	test_line_count = 1 files
+'
+
+test_expect_success 'blame of a descendant resumes from the cache' '
+	check_blame --porcelain HEAD -- moved &&
+	grep "using cached blame for $(git rev-parse HEAD^) moved" trace &&
+	cache_files >files &&
+	test_line_count = 2 files
+'
+
+test_expect_success 'cached root commits are boundaries unless --root' '
+	check_blame HEAD moved &&
+	grep "^^" actual &&
+	check_blame --root HEAD moved &&
+	! grep "^^" actual
+'
+
+test_expect_success 'cached blame is used for a line range' '
+	check_blame -L 3,5 HEAD moved &&
+	grep "using cached blame for $(git rev-parse HEAD) moved" trace
+'
+
+test_expect_success 'only a whole file is written to the cache' '
+	rm -rf .git/blame-cache &&
+	check_blame -L 3,5 HEAD moved &&
+	test_must_fail cache_files
+'
+
+test_expect_success 'the cache is not used with -C or a limited history' '
+	check_blame HEAD^ -- moved &&
+	check_blame -C HEAD moved &&
+	! grep "cached blame" trace &&
+	check_blame HEAD~3.. -- moved &&
+	! grep "cached blame" trace &&
+	cache_files >files &&
+	test_line_count = 1 files
+'
+
+test_expect_success 'a damaged cache file is ignored' '
+	file=.git/blame-cache/$(cache_files) &&
+	chmod +w "$file" &&
+	echo garbage >>"$file" &&
+	check_blame --porcelain HEAD^ -- moved &&
+	grep "ignoring bad cached blame" trace
+'
+
+test_expect_success 'the cache is not used with grafts' '
+	rm -rf .git/blame-cache &&
+	check_blame HEAD -- moved &&
+	check_blame HEAD -- moved &&
+	grep "using cached blame for $(git rev-parse HEAD) moved" trace &&
+	git rev-parse HEAD >.git/info/grafts &&
+	test_when_finished "rm -f .git/info/grafts" &&
+	check_blame HEAD -- moved &&
+	! grep "cached blame" trace &&
+	! grep -v "^\^$(git rev-parse --short HEAD) " actual
+'
+
+test_expect_success 'the cache is not used with replace refs' '
+	git replace HEAD~2 HEAD~3 &&
+	test_when_finished "git replace -d HEAD~2" &&
+	check_blame HEAD -- moved &&
+	! grep "cached blame" trace &&
+	(
+		GIT_NO_REPLACE_OBJECTS=1 &&
+		export GIT_NO_REPLACE_OBJECTS &&
+		check_blame HEAD -- moved
+	) &&
+	grep "using cached blame" trace
+'
+
+test_done
@@ -0,0 +1,54 @@
+#!/bin/sh
+
+test_description='git blame resolves the viewport first'
+. ./test-lib.sh
+
+# print the first result line reported by "blame --incremental"
+first_line () {
+	sed -n -e "s/^[0-9a-f]\{40\} [0-9]* \([0-9]*\) [0-9]*$/\1/p" "$1" |
+	head -n 1
+}
+
+test_expect_success 'setup' '
+	printf "%s\n" 1 2 3 4 5 6 7 8 9 >file &&
+	git add file &&
+	test_tick &&
+	git commit -m initial &&
+	git checkout -b side &&
+	sed -e "s/^2$/two/" file >tmp && mv tmp file &&
+	test_tick &&
+	git commit -a -m side &&
+	git checkout master &&
+	sed -e "s/^8$/eight/" file >tmp && mv tmp file &&
+	test_tick &&
+	git commit -a -m master &&
+	test_tick &&
+	git merge side
+'
+
+test_expect_success 'lines are resolved from the top without a viewport' '
+	git blame --incremental file >out &&
+	test "$(first_line out)" = 8
+'
+
+test_expect_success 'the viewport is resolved first' '
+	git blame --incremental --viewport 2,2 file >out &&
+	test "$(first_line out)" = 2 &&
+	git blame --incremental --viewport /two/ file >out &&
+	test "$(first_line out)" = 2
+'
+
+test_expect_success 'the lines outside the viewport are still blamed' '
+	git blame file >expect &&
+	git blame --viewport 2,3 file >actual &&
+	test_cmp expect actual &&
+	git blame -L 2,5 file >expect &&
+	git blame -L 2,5 --viewport 4,9 file >actual &&
+	test_cmp expect actual
+'
+
+test_expect_success 'a viewport past the end of the file is an error' '
+	test_must_fail git blame --viewport 5,20 file
+'
+
+test_done
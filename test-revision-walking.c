@@ -12,6 +12,7 @@
 #include "commit.h"
 #include "diff.h"
 #include "revision.h"
+#include "object.h"
 
 static void print_commit(struct commit *commit)
 {
@@ -61,6 +62,25 @@ int main(int argc, char **argv)
 		return 0;
 	}
 
+	if (!strcmp(argv[1], "run-in-pools")) {
+		unsigned int nr = get_max_object_index();
+		int i;
+
+		for (i = 1; i <= 2; i++) {
+			struct object_pool *pool = new_object_pool();
+
+			use_object_pool(pool);
+			printf("pool %d\n", i);
+			if (!run_revision_walk())
+				return 1;
+			use_object_pool(NULL);
+			free_object_pool(pool);
+		}
+		if (get_max_object_index() != nr)
+			die("objects were added to the default pool");
+		return 0;
+	}
+
 	fprintf(stderr, "check usage\n");
 	return 1;
 }
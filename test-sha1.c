@@ -1,5 +1,78 @@
 #include "cache.h"
 
+#ifndef git_SHA1_Backend
+#define git_SHA1_Backend() "default"
+#endif
+#ifndef git_SHA1_Many_Backend
+#define git_SHA1_Many_Backend() git_SHA1_Backend()
+#endif
+
+#define BATCH 16
+
+/*
+ * Hash "total" megabytes of memory in "size" kilobyte objects and
+ * report the throughput of the SHA-1 implementation in use.  With
+ * "batch", hash_sha1_files() is given BATCH objects at a time.
+ */
+static int bench(int batch, unsigned size, unsigned total)
+{
+	git_SHA_CTX ctx;
+	unsigned char sha1[20];
+	struct hash_sha1_job jobs[BATCH];
+	struct timeval start, end;
+	unsigned long i, nr;
+	char *buffer;
+	double secs;
+
+	size *= 1024;
+	nr = (unsigned long)total * 1024 * 1024 / size;
+	if (!nr)
+		nr = 1;
+	buffer = xmalloc(size);
+	for (i = 0; i < size; i++)
+		buffer[i] = i;
+
+	for (i = 0; i < BATCH; i++) {
+		jobs[i].buf = buffer;
+		jobs[i].len = size;
+		jobs[i].type = "blob";
+	}
+
+	gettimeofday(&start, NULL);
+	if (batch) {
+		nr = (nr + BATCH - 1) / BATCH * BATCH;
+		for (i = 0; i < nr; i += BATCH)
+			hash_sha1_files(jobs, BATCH);
+	} else {
+		for (i = 0; i < nr; i++) {
+			git_SHA1_Init(&ctx);
+			git_SHA1_Update(&ctx, buffer, size);
+			git_SHA1_Final(sha1, &ctx);
+		}
+	}
+	gettimeofday(&end, NULL);
+
+	secs = (end.tv_sec - start.tv_sec) +
+		(end.tv_usec - start.tv_usec) / 1000000.0;
+	printf("%s%s %uk: %.1f MB/s\n",
+	       batch ? "batch " : "",
+	       batch ? git_SHA1_Many_Backend() : git_SHA1_Backend(),
+	       size / 1024,
+	       secs > 0 ? (double)nr * size / secs / (1024 * 1024) : 0);
+	free(buffer);
+	return 0;
+}
+
+static unsigned bench_arg(const char *arg)
+{
+	char *end;
+	unsigned long n = strtoul(arg, &end, 10);
+
+	if (!*arg || *end || !n || n > UINT_MAX / 1024)
+		die("usage: test-sha1 --bench [--batch] [<kilobytes> [<megabytes>]]");
+	return n;
+}
+
 int main(int ac, char **av)
 {
 	git_SHA_CTX ctx;
@@ -7,6 +80,14 @@ int main(int ac, char **av)
 	unsigned bufsz = 8192;
 	char *buffer;
 
+	if (ac >= 2 && !strcmp(av[1], "--bench")) {
+		int batch = ac >= 3 && !strcmp(av[2], "--batch");
+		av += batch;
+		ac -= batch;
+		return bench(batch, ac >= 3 ? bench_arg(av[2]) : 8,
+			     ac >= 4 ? bench_arg(av[3]) : 256);
+	}
+
 	if (ac == 2)
 		bufsz = strtoul(av[1], NULL, 10) * 1024 * 1024;
 
@@ -3,6 +3,16 @@
 dd if=/dev/zero bs=1048576 count=100 2>/dev/null |
 /usr/bin/time ./test-sha1 >/dev/null
 
+# throughput of each implementation that can be chosen at run time
+for backend in block sha-ni avx2
+do
+	for size in 1 8 64 1024
+	do
+		GIT_SHA1_BACKEND=$backend ./test-sha1 --bench $size &&
+		GIT_SHA1_BACKEND=$backend ./test-sha1 --bench --batch $size
+	done
+done
+
 while read expect cnt pfx
 do
 	case "$expect" in '#'*) continue ;; esac
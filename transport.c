@@ -8,6 +8,7 @@
 #include "bundle.h"
 #include "dir.h"
 #include "refs.h"
+#include "packed-refs.h"
 #include "branch.h"
 #include "url.h"
 #include "submodule.h"
@@ -95,13 +96,43 @@ static int read_loose_refs(struct strbuf *path, int name_offset,
 	return 0;
 }
 
+static int insert_packed_ref_fn(const char *refname, const unsigned char *sha1,
+				const unsigned char *peeled, void *cb_data)
+{
+	struct ref ***listp = cb_data;
+	struct ref **list = *listp;
+	int cmp = cmp;
+
+	while ((*list)->next &&
+			(cmp = strcmp(refname, (*list)->next->name)) > 0)
+		list = &(*list)->next;
+	if (!(*list)->next || cmp < 0) {
+		struct ref *next = alloc_ref(refname);
+		hashcpy(next->old_sha1, sha1);
+		next->next = (*list)->next;
+		(*list)->next = next;
+		list = &(*list)->next;
+	}
+	*listp = list;
+	return 0;
+}
+
 /* insert the packed refs for which no loose refs were found */
 
 static void insert_packed_refs(const char *packed_refs, struct ref **list)
 {
-	FILE *f = fopen(packed_refs, "r");
+	struct packed_ref_table *table = open_packed_ref_table(packed_refs);
+	FILE *f;
 	static char buffer[PATH_MAX];
 
+	if (table) {
+		for_each_packed_ref_in_table(table, "",
+					     insert_packed_ref_fn, &list);
+		close_packed_ref_table(table);
+		return;
+	}
+
+	f = fopen(packed_refs, "r");
 	if (!f)
 		return;
 
@@ -489,14 +520,17 @@ static int set_git_option(struct git_transport_options *opts,
 static int connect_setup(struct transport *transport, int for_push, int verbose)
 {
 	struct git_transport_data *data = transport->data;
+	int flags = verbose ? CONNECT_VERBOSE : 0;
 
 	if (data->conn)
 		return 0;
 
+	if (!for_push && transport->ref_prefixes)
+		flags |= CONNECT_LS_REFS;
 	data->conn = git_connect(data->fd, transport->url,
 				 for_push ? data->options.receivepack :
 				 data->options.uploadpack,
-				 verbose ? CONNECT_VERBOSE : 0);
+				 flags);
 
 	return 0;
 }
@@ -507,8 +541,9 @@ static struct ref *get_refs_via_connect(struct transport *transport, int for_pus
 	struct ref *refs;
 
 	connect_setup(transport, for_push, 0);
-	get_remote_heads(data->fd[0], &refs,
-			 for_push ? REF_NORMAL : 0, &data->extra_have);
+	get_remote_heads_by_prefix(data->fd, &refs,
+				   for_push ? REF_NORMAL : 0, &data->extra_have,
+				   for_push ? NULL : transport->ref_prefixes);
 	data->got_remote_heads = 1;
 
 	return refs;
@@ -541,7 +576,8 @@ static int fetch_refs_via_pack(struct transport *transport,
 
 	if (!data->got_remote_heads) {
 		connect_setup(transport, 0, 0);
-		get_remote_heads(data->fd[0], &refs_tmp, 0, NULL);
+		get_remote_heads_by_prefix(data->fd, &refs_tmp, 0, NULL,
+					   transport->ref_prefixes);
 		data->got_remote_heads = 1;
 	}
 
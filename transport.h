@@ -25,6 +25,13 @@ struct transport {
 	 */
 	unsigned got_remote_refs : 1;
 
+	/**
+	 * If set, only refs whose names start with one of these prefixes
+	 * are of interest to a fetch; servers that support it are asked
+	 * to advertise just those.
+	 **/
+	const struct string_list *ref_prefixes;
+
 	/**
 	 * Returns 0 if successful, positive if the option is not
 	 * recognized or is inapplicable, and negative if the option
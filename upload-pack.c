@@ -8,10 +8,10 @@
 #include "exec_cmd.h"
 #include "diff.h"
 #include "revision.h"
-#include "list-objects.h"
 #include "run-command.h"
 #include "sigchain.h"
 #include "version.h"
+#include "string-list.h"
 
 static const char upload_pack_usage[] = "git upload-pack [--strict] [--timeout=<n>] <dir>";
 
@@ -44,6 +44,12 @@ static int use_sideband;
 static int debug_fd;
 static int advertise_refs;
 static int stateless_rpc;
+/* the client names the refs it wants to hear about; see send_refs_by_prefix() */
+static int ls_refs;
+/* some refs were left out of the advertisement */
+static int refs_filtered;
+/* see "Pack cache" below */
+static unsigned long pack_cache_size;
 
 static void reset_timeout(void)
 {
@@ -72,74 +78,247 @@ static ssize_t send_client_data(int fd, const char *data, ssize_t sz)
 	return safe_write(fd, data, sz);
 }
 
-static FILE *pack_pipe = NULL;
-static void show_commit(struct commit *commit, void *data)
+static int write_one_shallow(const struct commit_graft *graft, void *cb_data)
 {
-	if (commit->object.flags & BOUNDARY)
-		fputc('-', pack_pipe);
-	if (fputs(sha1_to_hex(commit->object.sha1), pack_pipe) < 0)
-		die("broken output pipe");
-	fputc('\n', pack_pipe);
-	fflush(pack_pipe);
-	free(commit->buffer);
-	commit->buffer = NULL;
+	FILE *fp = cb_data;
+	if (graft->nr_parent == -1)
+		fprintf(fp, "--shallow %s\n", sha1_to_hex(graft->sha1));
+	return 0;
 }
 
-static void show_object(struct object *obj,
-			const struct name_path *path, const char *component,
-			void *cb_data)
+/*
+ * Pack cache.
+ *
+ * With uploadpack.packCacheSize set, the pack data we send is also
+ * written to $GIT_DIR/pack-cache, named after everything that decides
+ * its contents: the objects wanted and had, the capabilities that shape
+ * the pack, and the state of all refs.  A later request that comes to
+ * the same name is answered from the file without running pack-objects.
+ * The least recently used packs are removed to stay within the size.
+ */
+static char pack_cache_hex[41];
+static char *pack_cache_tmp;
+static int pack_cache_fd = -1;
+static unsigned long pack_cache_written;
+
+static int hash_ref(const char *refname, const unsigned char *sha1,
+		    int flag, void *cb_data)
 {
-	show_object_with_name(pack_pipe, obj, path, component);
+	git_SHA_CTX *ctx = cb_data;
+	git_SHA1_Update(ctx, sha1, 20);
+	git_SHA1_Update(ctx, refname, strlen(refname) + 1);
+	return 0;
 }
 
-static void show_edge(struct commit *commit)
+static int object_entry_cmp(const void *a_, const void *b_)
 {
-	fprintf(pack_pipe, "-%s\n", sha1_to_hex(commit->object.sha1));
+	const struct object_array_entry *a = a_, *b = b_;
+	return hashcmp(a->item->sha1, b->item->sha1);
 }
 
-static int do_rev_list(int in, int out, void *user_data)
+static void hash_objects(git_SHA_CTX *ctx, const char *what,
+			 const struct object_array *array)
 {
+	struct object_array_entry *sorted;
 	int i;
-	struct rev_info revs;
 
-	pack_pipe = xfdopen(out, "w");
-	init_revisions(&revs, NULL);
-	revs.tag_objects = 1;
-	revs.tree_objects = 1;
-	revs.blob_objects = 1;
-	if (use_thin_pack)
-		revs.edge_hint = 1;
+	sorted = xmemdupz(array->objects, array->nr * sizeof(*sorted));
+	qsort(sorted, array->nr, sizeof(*sorted), object_entry_cmp);
+	git_SHA1_Update(ctx, what, strlen(what) + 1);
+	for (i = 0; i < array->nr; i++)
+		git_SHA1_Update(ctx, sorted[i].item->sha1, 20);
+	free(sorted);
+}
 
-	for (i = 0; i < want_obj.nr; i++) {
-		struct object *o = want_obj.objects[i].item;
-		/* why??? */
-		o->flags &= ~UNINTERESTING;
-		add_pending_object(&revs, o, NULL);
-	}
-	for (i = 0; i < have_obj.nr; i++) {
-		struct object *o = have_obj.objects[i].item;
-		o->flags |= UNINTERESTING;
-		add_pending_object(&revs, o, NULL);
+static void compute_pack_cache_name(int create_full_pack)
+{
+	git_SHA_CTX ctx;
+	unsigned char sha1[20];
+	char flags[5];
+
+	flags[0] = create_full_pack ? 'a' : '-';
+	flags[1] = use_thin_pack ? 't' : '-';
+	flags[2] = use_ofs_delta ? 'o' : '-';
+	flags[3] = use_include_tag ? 'i' : '-';
+	flags[4] = '\0';
+
+	git_SHA1_Init(&ctx);
+	git_SHA1_Update(&ctx, "pack-cache v1", 14);
+	git_SHA1_Update(&ctx, flags, sizeof(flags));
+	hash_objects(&ctx, "want", &want_obj);
+	hash_objects(&ctx, "have", &have_obj);
+	head_ref(hash_ref, &ctx);
+	for_each_ref(hash_ref, &ctx);
+	git_SHA1_Final(sha1, &ctx);
+	memcpy(pack_cache_hex, sha1_to_hex(sha1), sizeof(pack_cache_hex));
+}
+
+static const char *pack_cache_path(void)
+{
+	return git_path("pack-cache/pack-%s.pack", pack_cache_hex);
+}
+
+/* Send the cached pack, if there is one; return -1 if there is not. */
+static int send_cached_pack(void)
+{
+	const char *path = pack_cache_path();
+	char data[8192];
+	ssize_t sz;
+	int fd;
+
+	fd = open(path, O_RDONLY);
+	if (fd < 0)
+		return -1;
+	trace_printf("upload-pack: sending cached pack %s\n", pack_cache_hex);
+	utime(path, NULL);	/* mark it as recently used */
+
+	while ((sz = xread(fd, data, sizeof(data))) > 0) {
+		reset_timeout();
+		if (send_client_data(1, data, sz) < 0)
+			die("git upload-pack: unable to send the cached pack");
 	}
-	setup_revisions(0, NULL, &revs, NULL);
-	if (prepare_revision_walk(&revs))
-		die("revision walk setup failed");
-	mark_edges_uninteresting(revs.commits, &revs, show_edge);
-	if (use_thin_pack)
-		for (i = 0; i < extra_edge_obj.nr; i++)
-			fprintf(pack_pipe, "-%s\n", sha1_to_hex(
-					extra_edge_obj.objects[i].item->sha1));
-	traverse_commit_list(&revs, show_commit, show_object, NULL);
-	fflush(pack_pipe);
-	fclose(pack_pipe);
+	if (sz < 0)
+		die_errno("git upload-pack: unable to read '%s'", path);
+	close(fd);
+	if (use_sideband)
+		packet_flush(1);
 	return 0;
 }
 
+static void remove_pack_cache_tmp(void)
+{
+	if (pack_cache_fd >= 0)
+		close(pack_cache_fd);
+	pack_cache_fd = -1;
+	if (pack_cache_tmp)
+		unlink_or_warn(pack_cache_tmp);
+	free(pack_cache_tmp);
+	pack_cache_tmp = NULL;
+}
+
+static void start_pack_cache(void)
+{
+	static int atexit_registered;
+
+	pack_cache_tmp = xstrdup(git_path("pack-cache/tmp_pack_XXXXXX"));
+	if (safe_create_leading_directories(pack_cache_tmp) ||
+	    (pack_cache_fd = git_mkstemp_mode(pack_cache_tmp, 0444)) < 0) {
+		/* we may well be serving a repository we cannot write to */
+		trace_printf("upload-pack: cannot cache packs: %s\n",
+			     strerror(errno));
+		free(pack_cache_tmp);
+		pack_cache_tmp = NULL;
+		return;
+	}
+	pack_cache_written = 0;
+	if (!atexit_registered) {
+		atexit(remove_pack_cache_tmp);
+		atexit_registered = 1;
+	}
+}
+
+static void write_pack_cache(const char *data, size_t len)
+{
+	if (pack_cache_fd < 0)
+		return;
+	pack_cache_written += len;
+	if (pack_cache_written > pack_cache_size ||
+	    write_in_full(pack_cache_fd, data, len) != len)
+		remove_pack_cache_tmp();
+}
+
+struct cached_pack {
+	char *path;
+	off_t size;
+	time_t mtime;
+};
+
+static int cached_pack_cmp(const void *a_, const void *b_)
+{
+	const struct cached_pack *a = a_, *b = b_;
+
+	/* most recently used first */
+	return a->mtime < b->mtime ? 1 : a->mtime > b->mtime ? -1 : 0;
+}
+
+static void prune_pack_cache(void)
+{
+	struct cached_pack *packs = NULL;
+	int nr = 0, alloc = 0, i;
+	unsigned long total = 0;
+	time_t stale = time(NULL) - 24 * 3600;
+	struct strbuf path = STRBUF_INIT;
+	struct dirent *de;
+	size_t dirlen;
+	DIR *dir;
+
+	strbuf_addstr(&path, git_path("pack-cache/"));
+	dirlen = path.len;
+	dir = opendir(path.buf);
+	if (!dir)
+		return;
+	while ((de = readdir(dir)) != NULL) {
+		struct stat st;
+
+		strbuf_setlen(&path, dirlen);
+		strbuf_addstr(&path, de->d_name);
+		if (lstat(path.buf, &st) || !S_ISREG(st.st_mode))
+			continue;
+		/* left behind by an upload-pack that was killed */
+		if (!prefixcmp(de->d_name, "tmp_pack_")) {
+			if (st.st_mtime < stale)
+				unlink_or_warn(path.buf);
+			continue;
+		}
+		if (prefixcmp(de->d_name, "pack-") ||
+		    suffixcmp(de->d_name, ".pack"))
+			continue;
+		ALLOC_GROW(packs, nr + 1, alloc);
+		packs[nr].path = xstrdup(path.buf);
+		packs[nr].size = st.st_size;
+		packs[nr].mtime = st.st_mtime;
+		nr++;
+	}
+	closedir(dir);
+	strbuf_release(&path);
+
+	qsort(packs, nr, sizeof(*packs), cached_pack_cmp);
+	for (i = 0; i < nr; i++) {
+		total += packs[i].size;
+		if (total > pack_cache_size) {
+			trace_printf("upload-pack: evicting %s\n", packs[i].path);
+			unlink_or_warn(packs[i].path);
+		}
+		free(packs[i].path);
+	}
+	free(packs);
+}
+
+static void finish_pack_cache(void)
+{
+	if (pack_cache_fd < 0)
+		return;
+	if (close(pack_cache_fd)) {
+		pack_cache_fd = -1;
+		remove_pack_cache_tmp();
+		return;
+	}
+	pack_cache_fd = -1;
+	if (rename(pack_cache_tmp, pack_cache_path())) {
+		remove_pack_cache_tmp();
+		return;
+	}
+	trace_printf("upload-pack: cached pack %s\n", pack_cache_hex);
+	free(pack_cache_tmp);
+	pack_cache_tmp = NULL;
+	prune_pack_cache();
+}
+
 static void create_pack_file(void)
 {
-	struct async rev_list;
 	struct child_process pack_objects;
-	int create_full_pack = (nr_our_refs == want_obj.nr && !have_obj.nr);
+	int create_full_pack = (nr_our_refs == want_obj.nr && !have_obj.nr &&
+				!shallow_nr && !refs_filtered);
 	char data[8193], progress[128];
 	char abort_msg[] = "aborting due to possible repository "
 		"corruption on the remote side.";
@@ -147,15 +326,22 @@ static void create_pack_file(void)
 	ssize_t sz;
 	const char *argv[10];
 	int arg = 0;
+	FILE *pipe_fd;
+
+	/* what a shallow client gets depends on more than we hash */
+	if (pack_cache_size && !shallow_nr) {
+		compute_pack_cache_name(create_full_pack);
+		if (!send_cached_pack())
+			return;
+		start_pack_cache();
+	}
 
 	argv[arg++] = "pack-objects";
-	if (!shallow_nr) {
-		argv[arg++] = "--revs";
-		if (create_full_pack)
-			argv[arg++] = "--all";
-		else if (use_thin_pack)
-			argv[arg++] = "--thin";
-	}
+	argv[arg++] = "--revs";
+	if (create_full_pack)
+		argv[arg++] = "--all";
+	else if (use_thin_pack)
+		argv[arg++] = "--thin";
 
 	argv[arg++] = "--stdout";
 	if (!no_progress)
@@ -176,29 +362,30 @@ static void create_pack_file(void)
 	if (start_command(&pack_objects))
 		die("git upload-pack: unable to fork git-pack-objects");
 
-	if (shallow_nr) {
-		memset(&rev_list, 0, sizeof(rev_list));
-		rev_list.proc = do_rev_list;
-		rev_list.out = pack_objects.in;
-		if (start_async(&rev_list))
-			die("git upload-pack: unable to fork git-rev-list");
-	}
-	else {
-		FILE *pipe_fd = xfdopen(pack_objects.in, "w");
-		if (!create_full_pack) {
-			int i;
-			for (i = 0; i < want_obj.nr; i++)
-				fprintf(pipe_fd, "%s\n", sha1_to_hex(want_obj.objects[i].item->sha1));
-			fprintf(pipe_fd, "--not\n");
-			for (i = 0; i < have_obj.nr; i++)
-				fprintf(pipe_fd, "%s\n", sha1_to_hex(have_obj.objects[i].item->sha1));
-		}
-
-		fprintf(pipe_fd, "\n");
-		fflush(pipe_fd);
-		fclose(pipe_fd);
+	/*
+	 * pack-objects walks the history itself; a shallow client's
+	 * boundary is passed to it first, so that the walk stops there.
+	 */
+	pipe_fd = xfdopen(pack_objects.in, "w");
+	if (shallow_nr)
+		for_each_commit_graft(write_one_shallow, pipe_fd);
+	if (!create_full_pack) {
+		int i;
+		for (i = 0; i < want_obj.nr; i++)
+			fprintf(pipe_fd, "%s\n", sha1_to_hex(want_obj.objects[i].item->sha1));
+		fprintf(pipe_fd, "--not\n");
+		for (i = 0; i < have_obj.nr; i++)
+			fprintf(pipe_fd, "%s\n", sha1_to_hex(have_obj.objects[i].item->sha1));
+		/* commits the client is deepening from can be delta bases */
+		if (use_thin_pack)
+			for (i = 0; i < extra_edge_obj.nr; i++)
+				fprintf(pipe_fd, "%s\n", sha1_to_hex(
+						extra_edge_obj.objects[i].item->sha1));
 	}
 
+	fprintf(pipe_fd, "\n");
+	fflush(pipe_fd);
+	fclose(pipe_fd);
 
 	/* We read from pack_objects.err to capture stderr output for
 	 * progress bar, and pack_objects.out to capture the pack data.
@@ -273,7 +460,7 @@ static void create_pack_file(void)
 			sz = xread(pack_objects.out, cp,
 				  sizeof(data) - outsz);
 			if (0 < sz)
-				;
+				write_pack_cache(cp, sz);
 			else if (sz == 0) {
 				close(pack_objects.out);
 				pack_objects.out = -1;
@@ -297,8 +484,6 @@ static void create_pack_file(void)
 		error("git upload-pack: git-pack-objects died with error.");
 		goto fail;
 	}
-	if (shallow_nr && finish_async(&rev_list))
-		goto fail;	/* error was already reported */
 
 	/* flush the data */
 	if (0 <= buffered) {
@@ -310,9 +495,11 @@ static void create_pack_file(void)
 	}
 	if (use_sideband)
 		packet_flush(1);
+	finish_pack_cache();
 	return;
 
  fail:
+	remove_pack_cache_tmp();
 	send_client_data(3, abort_msg, sizeof(abort_msg));
 	die("git upload-pack: %s", abort_msg);
 }
@@ -720,24 +907,32 @@ static void receive_needs(void)
 	free(shallows.objects);
 }
 
+static const char capabilities[] = "multi_ack thin-pack side-band"
+	" side-band-64k ofs-delta shallow no-progress"
+	" include-tag multi_ack_detailed";
+static int capabilities_sent;
+
+static void send_ref_line(const unsigned char *sha1, const char *refname)
+{
+	if (!capabilities_sent)
+		packet_write(1, "%s %s%c%s%s%s agent=%s\n",
+			     sha1_to_hex(sha1), refname,
+			     0, capabilities,
+			     stateless_rpc ? " no-done" : "",
+			     ls_refs ? " ls-refs" : "",
+			     git_user_agent_sanitized());
+	else
+		packet_write(1, "%s %s\n", sha1_to_hex(sha1), refname);
+	capabilities_sent = 1;
+}
+
 static int send_ref(const char *refname, const unsigned char *sha1, int flag, void *cb_data)
 {
-	static const char *capabilities = "multi_ack thin-pack side-band"
-		" side-band-64k ofs-delta shallow no-progress"
-		" include-tag multi_ack_detailed";
 	struct object *o = lookup_unknown_object(sha1);
 	const char *refname_nons = strip_namespace(refname);
 	unsigned char peeled[20];
 
-	if (capabilities)
-		packet_write(1, "%s %s%c%s%s agent=%s\n",
-			     sha1_to_hex(sha1), refname_nons,
-			     0, capabilities,
-			     stateless_rpc ? " no-done" : "",
-			     git_user_agent_sanitized());
-	else
-		packet_write(1, "%s %s\n", sha1_to_hex(sha1), refname_nons);
-	capabilities = NULL;
+	send_ref_line(sha1, refname_nons);
 	if (!(o->flags & OUR_REF)) {
 		o->flags |= OUR_REF;
 		nr_our_refs++;
@@ -747,6 +942,53 @@ static int send_ref(const char *refname, const unsigned char *sha1, int flag, vo
 	return 0;
 }
 
+/*
+ * In "ls-refs" mode we announce only our capabilities, then read the
+ * prefixes of the refs the client is interested in, ending with a
+ * flush.  Only the refs matching one of them are sent, and only those
+ * may be asked for; without any prefix, all refs are sent.
+ */
+static void send_refs_by_prefix(void)
+{
+	struct string_list prefixes = STRING_LIST_INIT_DUP;
+	const char *last = NULL;
+	char line[1000];
+	int i;
+
+	send_ref_line(null_sha1, "capabilities^{}");
+	packet_flush(1);
+
+	for (;;) {
+		int len = packet_read_line(0, line, sizeof(line));
+		reset_timeout();
+		if (!len)
+			break;
+		strip(line, len);
+		if (prefixcmp(line, "ref-prefix "))
+			die("git upload-pack: protocol error, "
+			    "expected ref-prefix, got '%s'", line);
+		string_list_append(&prefixes, line + 11);
+	}
+
+	if (!prefixes.nr)
+		string_list_append(&prefixes, "");
+	sort_string_list(&prefixes);
+	/* "--all" would pack the refs the client did not hear about */
+	refs_filtered = !!*prefixes.items[0].string;
+	for (i = 0; i < prefixes.nr; i++) {
+		const char *prefix = prefixes.items[i].string;
+
+		/* refs/heads/ covers refs/heads/master */
+		if (last && !prefixcmp(prefix, last))
+			continue;
+		last = prefix;
+		if (!prefixcmp("HEAD", prefix))
+			head_ref_namespaced(send_ref, NULL);
+		for_each_namespaced_ref_in(prefix, send_ref, NULL);
+	}
+	string_list_clear(&prefixes, 0);
+}
+
 static int mark_our_ref(const char *refname, const unsigned char *sha1, int flag, void *cb_data)
 {
 	struct object *o = parse_object(sha1);
@@ -761,7 +1003,11 @@ static int mark_our_ref(const char *refname, const unsigned char *sha1, int flag
 
 static void upload_pack(void)
 {
-	if (advertise_refs || !stateless_rpc) {
+	if (ls_refs) {
+		reset_timeout();
+		send_refs_by_prefix();
+		packet_flush(1);
+	} else if (advertise_refs || !stateless_rpc) {
 		reset_timeout();
 		head_ref_namespaced(send_ref, NULL);
 		for_each_namespaced_ref(send_ref, NULL);
@@ -780,6 +1026,29 @@ static void upload_pack(void)
 	}
 }
 
+static int upload_pack_config(const char *var, const char *value, void *unused)
+{
+	if (!strcmp(var, "uploadpack.packcachesize")) {
+		pack_cache_size = git_config_ulong(var, value);
+		return 0;
+	}
+	return 0;
+}
+
+/* Is "ls-refs" one of the colon-separated parameters in GIT_PROTOCOL? */
+static int requested_ls_refs(void)
+{
+	const char *p = getenv(GIT_PROTOCOL_ENVIRONMENT);
+
+	while (p && *p) {
+		const char *end = strchrnul(p, ':');
+		if (end - p == 7 && !memcmp(p, "ls-refs", 7))
+			return 1;
+		p = *end ? end + 1 : end;
+	}
+	return 0;
+}
+
 int main(int argc, char **argv)
 {
 	char *dir;
@@ -831,8 +1100,11 @@ int main(int argc, char **argv)
 		die("'%s' does not appear to be a git repository", dir);
 	if (is_repository_shallow())
 		die("attempt to fetch/clone from a shallow repository");
+	git_config(upload_pack_config, NULL);
 	if (getenv("GIT_DEBUG_SEND_PACK"))
 		debug_fd = atoi(getenv("GIT_DEBUG_SEND_PACK"));
+	if (!stateless_rpc && !advertise_refs)
+		ls_refs = requested_ls_refs();
 	upload_pack();
 	return 0;
 }
@@ -0,0 +1,516 @@
+/*
+ * SHA-1 for x86 CPUs.
+ *
+ * The 64-byte blocks are processed by the SHA extensions (SHA-NI) of
+ * the CPU if it has them, and by block-sha1 otherwise.  Everything
+ * else, i.e. buffering and padding, is done here.
+ *
+ * Independent messages can also be hashed eight at a time, one in each
+ * 32-bit lane of the AVX2 registers.
+ */
+#include "../git-compat-util.h"
+#include "sha1.h"
+
+#if defined(__GNUC__) && (defined(__i386__) || defined(__x86_64__))
+#define X86_SIMD
+#include <cpuid.h>
+#include <immintrin.h>
+#endif
+
+extern void blk_SHA1_Blocks(unsigned int H[5], const void *data,
+			    unsigned long nr);
+
+typedef void sha1_blocks_fn(uint32_t *H, const void *data, unsigned long nr);
+
+#ifdef X86_SIMD
+
+static int cpu_has_sha_ni(void)
+{
+	unsigned int eax, ebx, ecx, edx;
+
+	if (__get_cpuid_max(0, NULL) < 7)
+		return 0;
+	__cpuid(1, eax, ebx, ecx, edx);
+	if (!(ecx & bit_SSSE3) || !(ecx & bit_SSE4_1))
+		return 0;
+	__cpuid_count(7, 0, eax, ebx, ecx, edx);
+	return !!(ebx & (1 << 29)); /* SHA */
+}
+
+static int cpu_has_avx2(void)
+{
+	unsigned int eax, ebx, ecx, edx, xcr0_lo, xcr0_hi;
+
+	if (__get_cpuid_max(0, NULL) < 7)
+		return 0;
+	__cpuid(1, eax, ebx, ecx, edx);
+	if (!(ecx & bit_OSXSAVE))
+		return 0;
+	/* the OS must save the YMM registers */
+	__asm__("xgetbv" : "=a" (xcr0_lo), "=d" (xcr0_hi) : "c" (0));
+	if ((xcr0_lo & 6) != 6)
+		return 0;
+	__cpuid_count(7, 0, eax, ebx, ecx, edx);
+	return !!(ebx & bit_AVX2);
+}
+
+/*
+ * Four rounds, with the message words in msg.  "e" holds the state
+ * before the previous four rounds, from which sha1nexte computes the
+ * "E" of these rounds; "save" is where the state before these rounds
+ * is kept for the next ones.
+ */
+#define SHA_NI_ROUNDS(e, save, msg, fn) do { \
+	e = _mm_sha1nexte_epu32(e, msg); \
+	save = abcd; \
+	abcd = _mm_sha1rnds4_epu32(abcd, e, fn); } while (0)
+
+/* compute the next four message words into m0 */
+#define SHA_NI_SCHEDULE(m0, m1, m2, m3) \
+	m0 = _mm_sha1msg2_epu32(_mm_xor_si128(_mm_sha1msg1_epu32(m0, m1), m2), m3)
+
+#define SHA_NI_LOAD(p) \
+	_mm_shuffle_epi8(_mm_loadu_si128((const __m128i *)(p)), byteswap)
+
+__attribute__((target("sha,ssse3,sse4.1")))
+static void sha1_blocks_sha_ni(uint32_t *H, const void *data, unsigned long nr)
+{
+	const unsigned char *p = data;
+	const __m128i byteswap = _mm_set_epi64x(0x0001020304050607ULL,
+						0x08090a0b0c0d0e0fULL);
+	__m128i abcd, abcd_save, e0, e0_save, e1, m0, m1, m2, m3;
+
+	abcd = _mm_shuffle_epi32(_mm_loadu_si128((const __m128i *)H), 0x1b);
+	e0 = _mm_set_epi32(H[4], 0, 0, 0);
+
+	while (nr--) {
+		abcd_save = abcd;
+		e0_save = e0;
+
+		/* rounds 0-15 take their input from the block */
+		m0 = SHA_NI_LOAD(p);
+		e0 = _mm_add_epi32(e0, m0);
+		e1 = abcd;
+		abcd = _mm_sha1rnds4_epu32(abcd, e0, 0);
+		m1 = SHA_NI_LOAD(p + 16);
+		SHA_NI_ROUNDS(e1, e0, m1, 0);
+		m2 = SHA_NI_LOAD(p + 32);
+		SHA_NI_ROUNDS(e0, e1, m2, 0);
+		m3 = SHA_NI_LOAD(p + 48);
+		SHA_NI_ROUNDS(e1, e0, m3, 0);
+
+		/* rounds 16-79 from the message schedule */
+		SHA_NI_SCHEDULE(m0, m1, m2, m3); SHA_NI_ROUNDS(e0, e1, m0, 0);
+		SHA_NI_SCHEDULE(m1, m2, m3, m0); SHA_NI_ROUNDS(e1, e0, m1, 1);
+		SHA_NI_SCHEDULE(m2, m3, m0, m1); SHA_NI_ROUNDS(e0, e1, m2, 1);
+		SHA_NI_SCHEDULE(m3, m0, m1, m2); SHA_NI_ROUNDS(e1, e0, m3, 1);
+		SHA_NI_SCHEDULE(m0, m1, m2, m3); SHA_NI_ROUNDS(e0, e1, m0, 1);
+		SHA_NI_SCHEDULE(m1, m2, m3, m0); SHA_NI_ROUNDS(e1, e0, m1, 1);
+		SHA_NI_SCHEDULE(m2, m3, m0, m1); SHA_NI_ROUNDS(e0, e1, m2, 2);
+		SHA_NI_SCHEDULE(m3, m0, m1, m2); SHA_NI_ROUNDS(e1, e0, m3, 2);
+		SHA_NI_SCHEDULE(m0, m1, m2, m3); SHA_NI_ROUNDS(e0, e1, m0, 2);
+		SHA_NI_SCHEDULE(m1, m2, m3, m0); SHA_NI_ROUNDS(e1, e0, m1, 2);
+		SHA_NI_SCHEDULE(m2, m3, m0, m1); SHA_NI_ROUNDS(e0, e1, m2, 2);
+		SHA_NI_SCHEDULE(m3, m0, m1, m2); SHA_NI_ROUNDS(e1, e0, m3, 3);
+		SHA_NI_SCHEDULE(m0, m1, m2, m3); SHA_NI_ROUNDS(e0, e1, m0, 3);
+		SHA_NI_SCHEDULE(m1, m2, m3, m0); SHA_NI_ROUNDS(e1, e0, m1, 3);
+		SHA_NI_SCHEDULE(m2, m3, m0, m1); SHA_NI_ROUNDS(e0, e1, m2, 3);
+		SHA_NI_SCHEDULE(m3, m0, m1, m2); SHA_NI_ROUNDS(e1, e0, m3, 3);
+
+		e0 = _mm_sha1nexte_epu32(e0, e0_save);
+		abcd = _mm_add_epi32(abcd, abcd_save);
+		p += 64;
+	}
+
+	_mm_storeu_si128((__m128i *)H, _mm_shuffle_epi32(abcd, 0x1b));
+	H[4] = _mm_extract_epi32(e0, 3);
+}
+
+#define X8_ROL(x, n) \
+	_mm256_or_si256(_mm256_slli_epi32(x, n), _mm256_srli_epi32(x, 32 - (n)))
+
+#define X8_ROUND(fn, k) do { \
+	__m256i tmp = _mm256_add_epi32(_mm256_add_epi32(X8_ROL(a, 5), fn), \
+		_mm256_add_epi32(_mm256_add_epi32(e, k), w[t & 15])); \
+	e = d; d = c; c = X8_ROL(b, 30); b = a; a = tmp; } while (0)
+
+#define X8_MIX(t) \
+	(w[(t) & 15] = X8_ROL(_mm256_xor_si256( \
+		_mm256_xor_si256(w[((t) + 13) & 15], w[((t) + 8) & 15]), \
+		_mm256_xor_si256(w[((t) + 2) & 15], w[(t) & 15])), 1))
+
+/*
+ * Process nr blocks from each of the eight p[], whose states are the
+ * columns of H.
+ */
+__attribute__((target("avx2")))
+static void sha1_blocks_avx2_x8(uint32_t H[5][8], const unsigned char **p,
+				unsigned long nr)
+{
+	const __m256i byteswap = _mm256_set_epi8(
+		12, 13, 14, 15, 8, 9, 10, 11, 4, 5, 6, 7, 0, 1, 2, 3,
+		12, 13, 14, 15, 8, 9, 10, 11, 4, 5, 6, 7, 0, 1, 2, 3);
+	const __m256i k0 = _mm256_set1_epi32(0x5a827999);
+	const __m256i k1 = _mm256_set1_epi32(0x6ed9eba1);
+	const __m256i k2 = _mm256_set1_epi32(0x8f1bbcdc);
+	const __m256i k3 = _mm256_set1_epi32(0xca62c1d6);
+	__m256i a, b, c, d, e, w[16];
+	unsigned long off;
+	int i, t;
+
+	a = _mm256_loadu_si256((const __m256i *)H[0]);
+	b = _mm256_loadu_si256((const __m256i *)H[1]);
+	c = _mm256_loadu_si256((const __m256i *)H[2]);
+	d = _mm256_loadu_si256((const __m256i *)H[3]);
+	e = _mm256_loadu_si256((const __m256i *)H[4]);
+
+	for (off = 0; off < nr * 64; off += 64) {
+		__m256i sa = a, sb = b, sc = c, sd = d, se = e;
+
+		/* transpose the blocks so that w[t] holds word t of each */
+		for (i = 0; i < 16; i += 8) {
+			__m256i r[8], u[8];
+
+			for (t = 0; t < 8; t++)
+				r[t] = _mm256_loadu_si256((const __m256i *)
+							  (p[t] + off + i * 4));
+			for (t = 0; t < 8; t += 2) {
+				u[t] = _mm256_unpacklo_epi32(r[t], r[t + 1]);
+				u[t + 1] = _mm256_unpackhi_epi32(r[t], r[t + 1]);
+			}
+			for (t = 0; t < 8; t += 4) {
+				r[t] = _mm256_unpacklo_epi64(u[t], u[t + 2]);
+				r[t + 1] = _mm256_unpackhi_epi64(u[t], u[t + 2]);
+				r[t + 2] = _mm256_unpacklo_epi64(u[t + 1], u[t + 3]);
+				r[t + 3] = _mm256_unpackhi_epi64(u[t + 1], u[t + 3]);
+			}
+			for (t = 0; t < 4; t++) {
+				w[i + t] = _mm256_shuffle_epi8(
+					_mm256_permute2x128_si256(r[t], r[t + 4], 0x20),
+					byteswap);
+				w[i + t + 4] = _mm256_shuffle_epi8(
+					_mm256_permute2x128_si256(r[t], r[t + 4], 0x31),
+					byteswap);
+			}
+		}
+
+		for (t = 0; t < 16; t++)
+			X8_ROUND(_mm256_xor_si256(d, _mm256_and_si256(b,
+					_mm256_xor_si256(c, d))), k0);
+		for (; t < 20; t++) {
+			X8_MIX(t);
+			X8_ROUND(_mm256_xor_si256(d, _mm256_and_si256(b,
+					_mm256_xor_si256(c, d))), k0);
+		}
+		for (; t < 40; t++) {
+			X8_MIX(t);
+			X8_ROUND(_mm256_xor_si256(b, _mm256_xor_si256(c, d)), k1);
+		}
+		for (; t < 60; t++) {
+			X8_MIX(t);
+			X8_ROUND(_mm256_or_si256(_mm256_and_si256(b, c),
+					_mm256_and_si256(d, _mm256_or_si256(b, c))), k2);
+		}
+		for (; t < 80; t++) {
+			X8_MIX(t);
+			X8_ROUND(_mm256_xor_si256(b, _mm256_xor_si256(c, d)), k3);
+		}
+
+		a = _mm256_add_epi32(a, sa);
+		b = _mm256_add_epi32(b, sb);
+		c = _mm256_add_epi32(c, sc);
+		d = _mm256_add_epi32(d, sd);
+		e = _mm256_add_epi32(e, se);
+	}
+
+	_mm256_storeu_si256((__m256i *)H[0], a);
+	_mm256_storeu_si256((__m256i *)H[1], b);
+	_mm256_storeu_si256((__m256i *)H[2], c);
+	_mm256_storeu_si256((__m256i *)H[3], d);
+	_mm256_storeu_si256((__m256i *)H[4], e);
+}
+
+#endif /* X86_SIMD */
+
+static sha1_blocks_fn *sha1_blocks;
+static const char *backend;
+static int use_avx2;
+
+static void choose_backend(void)
+{
+	const char *want = getenv("GIT_SHA1_BACKEND");
+
+#ifdef X86_SIMD
+	use_avx2 = (!want || !strcmp(want, "avx2")) && cpu_has_avx2();
+	if ((!want || strcmp(want, "block")) && cpu_has_sha_ni()) {
+		sha1_blocks = sha1_blocks_sha_ni;
+		backend = "sha-ni";
+		return;
+	}
+#endif
+	sha1_blocks = blk_SHA1_Blocks;
+	backend = "block";
+}
+
+const char *x86_SHA1_Backend(void)
+{
+	if (!backend)
+		choose_backend();
+	return backend;
+}
+
+void x86_SHA1_Init(x86_SHA_CTX *c)
+{
+	if (!sha1_blocks)
+		choose_backend();
+	c->H[0] = 0x67452301;
+	c->H[1] = 0xefcdab89;
+	c->H[2] = 0x98badcfe;
+	c->H[3] = 0x10325476;
+	c->H[4] = 0xc3d2e1f0;
+	c->len = 0;
+	c->cnt = 0;
+}
+
+void x86_SHA1_Update(x86_SHA_CTX *c, const void *ptr, unsigned long n)
+{
+	const unsigned char *p = ptr;
+	unsigned long nb;
+
+	c->len += n;
+	if (c->cnt) {
+		nb = 64 - c->cnt;
+		if (nb > n)
+			nb = n;
+		memcpy(c->buf + c->cnt, p, nb);
+		c->cnt += nb;
+		p += nb;
+		n -= nb;
+		if (c->cnt < 64)
+			return;
+		sha1_blocks(c->H, c->buf, 1);
+		c->cnt = 0;
+	}
+	nb = n >> 6;
+	if (nb) {
+		sha1_blocks(c->H, p, nb);
+		p += nb << 6;
+		n -= nb << 6;
+	}
+	memcpy(c->buf, p, n);
+	c->cnt = n;
+}
+
+void x86_SHA1_Final(unsigned char *hash, x86_SHA_CTX *c)
+{
+	static const unsigned char pad[64] = { 0x80 };
+	uint32_t len[2];
+	int i;
+
+	len[0] = htonl((uint32_t)(c->len >> 29));
+	len[1] = htonl((uint32_t)(c->len << 3));
+	x86_SHA1_Update(c, pad, 1 + (119 - c->cnt) % 64);
+	x86_SHA1_Update(c, len, 8);
+	for (i = 0; i < 5; i++) {
+		uint32_t h = htonl(c->H[i]);
+		memcpy(hash + i * 4, &h, 4);
+	}
+}
+
+const char *x86_SHA1_Many_Backend(void)
+{
+	if (!backend)
+		choose_backend();
+	return use_avx2 ? "avx2" : backend;
+}
+
+static void hash_one(x86_SHA1_Msg *m)
+{
+	x86_SHA_CTX c;
+
+	x86_SHA1_Init(&c);
+	x86_SHA1_Update(&c, m->hdr, m->hdrlen);
+	x86_SHA1_Update(&c, m->buf, m->len);
+	x86_SHA1_Final(m->sha1, &c);
+}
+
+#ifdef X86_SIMD
+
+/*
+ * A message in one of the lanes.  It is fed to the kernel as runs of
+ * blocks: those that straddle the header and the padding are copied
+ * into "scratch", the others are read from where they are.
+ */
+struct x8_lane {
+	x86_SHA1_Msg *msg;
+	uint64_t total, next;
+	const unsigned char *p;
+	unsigned long nr;
+	int last;
+	unsigned char scratch[128];
+};
+
+static void copy_message(x86_SHA1_Msg *m, uint64_t off, unsigned long n,
+			 unsigned char *dst)
+{
+	if (off < m->hdrlen) {
+		unsigned long len = m->hdrlen - off;
+		if (len > n)
+			len = n;
+		memcpy(dst, (const unsigned char *)m->hdr + off, len);
+		dst += len;
+		off += len;
+		n -= len;
+	}
+	memcpy(dst, (const unsigned char *)m->buf + (off - m->hdrlen), n);
+}
+
+/* find the next run of blocks; return 0 if the message is done */
+static int next_run(struct x8_lane *l)
+{
+	x86_SHA1_Msg *m = l->msg;
+	uint64_t full = l->total & ~(uint64_t)63;
+
+	if (l->last)
+		return 0;
+	if (l->next < full && l->next < m->hdrlen) {
+		copy_message(m, l->next, 64, l->scratch);
+		l->p = l->scratch;
+		l->nr = 1;
+	} else if (l->next < full) {
+		l->p = (const unsigned char *)m->buf + (l->next - m->hdrlen);
+		l->nr = (full - l->next) / 64;
+	} else {
+		unsigned long rest = l->total - full;
+		uint32_t bits[2];
+
+		l->nr = rest + 9 > 64 ? 2 : 1;
+		memset(l->scratch, 0, sizeof(l->scratch));
+		copy_message(m, full, rest, l->scratch);
+		l->scratch[rest] = 0x80;
+		bits[0] = htonl((uint32_t)(l->total >> 29));
+		bits[1] = htonl((uint32_t)(l->total << 3));
+		memcpy(l->scratch + l->nr * 64 - 8, bits, 8);
+		l->p = l->scratch;
+		l->last = 1;
+	}
+	l->next += l->nr * 64;
+	return 1;
+}
+
+static void start_lane(struct x8_lane *l, uint32_t H[5][8], int i,
+		       x86_SHA1_Msg *m)
+{
+	static const uint32_t init[5] = {
+		0x67452301, 0xefcdab89, 0x98badcfe, 0x10325476, 0xc3d2e1f0
+	};
+	int j;
+
+	for (j = 0; j < 5; j++)
+		H[j][i] = init[j];
+	l->msg = m;
+	l->total = (uint64_t)m->hdrlen + m->len;
+	l->next = 0;
+	l->last = 0;
+	next_run(l);
+}
+
+static void finish_lane(struct x8_lane *l, uint32_t H[5][8], int i)
+{
+	int j;
+
+	for (j = 0; j < 5; j++) {
+		uint32_t h = htonl(H[j][i]);
+		memcpy(l->msg->sha1 + j * 4, &h, 4);
+	}
+	l->msg = NULL;
+}
+
+/*
+ * Once there are not enough messages left to keep the lanes busy, the
+ * rest is cheaper to hash one after another.
+ */
+#define X8_MIN_LANES 3
+
+static void hash_many_avx2(x86_SHA1_Msg *msg, int nr)
+{
+	struct x8_lane lanes[8];
+	uint32_t H[5][8];
+	const unsigned char *p[8];
+	int i, j, active = 0, next_msg = 0;
+
+	memset(H, 0, sizeof(H));
+	for (i = 0; i < 8; i++)
+		lanes[i].msg = NULL;
+	for (;;) {
+		unsigned long n = ULONG_MAX;
+
+		for (i = 0; i < 8 && next_msg < nr; i++) {
+			if (lanes[i].msg)
+				continue;
+			start_lane(&lanes[i], H, i, &msg[next_msg++]);
+			active++;
+		}
+		if (active < X8_MIN_LANES)
+			break;
+
+		for (i = 0; i < 8; i++)
+			if (lanes[i].msg && lanes[i].nr < n)
+				n = lanes[i].nr;
+		/* idle lanes hash whatever an active one does */
+		for (i = 0; i < 8; i++)
+			if (lanes[i].msg)
+				break;
+		for (j = 0; j < 8; j++)
+			p[j] = lanes[j].msg ? lanes[j].p : lanes[i].p;
+		sha1_blocks_avx2_x8(H, p, n);
+
+		for (i = 0; i < 8; i++) {
+			struct x8_lane *l = &lanes[i];
+
+			if (!l->msg)
+				continue;
+			l->p += n * 64;
+			l->nr -= n;
+			if (!l->nr && !next_run(l)) {
+				finish_lane(l, H, i);
+				active--;
+			}
+		}
+	}
+
+	/* finish the messages still in a lane one by one */
+	for (i = 0; i < 8; i++) {
+		struct x8_lane *l = &lanes[i];
+		uint32_t h[5];
+
+		if (!l->msg)
+			continue;
+		for (j = 0; j < 5; j++)
+			h[j] = H[j][i];
+		do {
+			sha1_blocks(h, l->p, l->nr);
+		} while (next_run(l));
+		for (j = 0; j < 5; j++)
+			H[j][i] = h[j];
+		finish_lane(l, H, i);
+	}
+}
+
+#endif /* X86_SIMD */
+
+void x86_SHA1_Many(x86_SHA1_Msg *msg, int nr)
+{
+	int i;
+
+	if (!backend)
+		choose_backend();
+#ifdef X86_SIMD
+	if (use_avx2) {
+		hash_many_avx2(msg, nr);
+		return;
+	}
+#endif
+	for (i = 0; i < nr; i++)
+		hash_one(&msg[i]);
+}
@@ -0,0 +1,50 @@
+/*
+ * SHA-1 for x86 CPUs, using the SHA extensions when the CPU has them
+ * and the block-sha1 routine otherwise.  The choice is made at run
+ * time, the first time a hash is started.
+ */
+#include <stdint.h>
+
+typedef struct {
+	uint32_t H[5];
+	uint32_t cnt;
+	uint64_t len;
+	unsigned char buf[64];
+} x86_SHA_CTX;
+
+void x86_SHA1_Init(x86_SHA_CTX *c);
+void x86_SHA1_Update(x86_SHA_CTX *c, const void *p, unsigned long n);
+void x86_SHA1_Final(unsigned char *hash, x86_SHA_CTX *c);
+
+/*
+ * The name of the implementation in use, "sha-ni" or "block".  The
+ * GIT_SHA1_BACKEND environment variable can ask for "block" even on
+ * CPUs with the SHA extensions.
+ */
+const char *x86_SHA1_Backend(void);
+
+/*
+ * Hash several messages, each made of hdrlen bytes at hdr followed by
+ * len bytes at buf, and store their names in sha1.  CPUs with AVX2
+ * hash eight of them side by side; GIT_SHA1_BACKEND=block or sha-ni
+ * hashes them one after another instead.
+ */
+typedef struct {
+	const void *hdr;
+	unsigned long hdrlen;
+	const void *buf;
+	unsigned long len;
+	unsigned char *sha1;
+} x86_SHA1_Msg;
+
+void x86_SHA1_Many(x86_SHA1_Msg *msg, int nr);
+const char *x86_SHA1_Many_Backend(void);
+
+#define git_SHA_CTX	x86_SHA_CTX
+#define git_SHA1_Init	x86_SHA1_Init
+#define git_SHA1_Update	x86_SHA1_Update
+#define git_SHA1_Final	x86_SHA1_Final
+#define git_SHA1_Backend	x86_SHA1_Backend
+#define git_SHA1_Msg	x86_SHA1_Msg
+#define git_SHA1_Many	x86_SHA1_Many
+#define git_SHA1_Many_Backend	x86_SHA1_Many_Backend